@@ -5,314 +5,879 @@
  * 2024 by liuqingshuige
  */
 #include "audio.h"
+#include "pcmlog.h"
 
-static char *log_time(void)
+
+static const unsigned int s_trySleep[10] = {2000, 4000, 6000, 8000, 16000, 24000, 32000, 40000, 45000, 90000}; // 重新打开的间隔，单位ms
+PcmRecord::PcmRecord(PcmEventLoop *loop, const char *name)
 {
-    static char ctime_buf[128] = {0};
-    struct tm* t;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
+    m_loop = loop;
+    m_name = name;
+    m_pool = NULL;
+    m_tasks = 0;
+    m_retired = 0;
+    m_samplerate = m_channel = m_ptime = 0;
+    m_profile = pcm_capture_profile(PCM_PROFILE_DEFAULT);
+    m_fixedRate = m_fixedChannel = 0;
+    m_periodFrames = 0;
+    m_rebuild = false;
+    m_format = PCM_FMT_S16;
+    m_capsValid = false;
+    memset(&m_caps, 0, sizeof(m_caps));
+    m_tryTimes = m_failTimes = 0;
+    m_frameSeq = 0;
+    m_readErrors = m_opens = m_openFailures = 0;
+    m_opened = 0;
+    m_ended = 0;
+    m_statsInterval = 0;
+    m_statsAt = -1;
+    m_reopenAt = -1;
+    m_reconfigAt = -1;
+    m_vadOn = false;
+    m_vadEnable = 0;
+    pcm_vad_default_config(&m_vadConfig);
+    m_vadChanged = 0;
+    m_ring.create(PCM_RECORD_RING_SLOTS, PCM_PERIOD_MAX_BYTES);
+    m_source = pcm_source_create(name);
 
-    t = localtime(&tv.tv_sec);
-    snprintf(ctime_buf, sizeof(ctime_buf), "%04d-%02d-%02d %02d:%02d:%02d.%03d", 
-        t->tm_year+1900,
-        t->tm_mon+1,
-        t->tm_mday,
-        t->tm_hour,
-        t->tm_min,
-        t->tm_sec,
-        (int)tv.tv_usec/1000);
-    return ctime_buf;
+    /* PCM_CAPTURE_MODE=mmap直接从DMA缓冲取数据，设备不支持时自动退回readi */
+    const char *env = getenv("PCM_CAPTURE_MODE");
+    m_captureMode = (env && !strcmp(env, "mmap")) ? PCM_CAPTURE_MMAP : PCM_CAPTURE_READI;
 }
-#define LOG(fmt, ...) printf("[%s %s:%d] " fmt, log_time(), __FUNCTION__, __LINE__, ##__VA_ARGS__)
 
+PcmRecord::~PcmRecord()
+{
+    stop();
+    setDspPool(NULL);
+    while (__atomic_load_n(&m_tasks, __ATOMIC_ACQUIRE) > 0) // 线程池是共用的，等本设备的任务执行完
+        usleep(1000);
+    clearChannel();
+    delete m_source;
+}
 
-PcmRecord PcmRecord::m_instance;
-PcmRecord::PcmRecord()
+PcmRecord *PcmRecord::instance()
 {
-    m_running = false;
-    m_pcmHandle = NULL;
-    m_threadId = 0;
-    start(16000, 1, 16, 20); // 当前仅支持位宽16bit，帧长20ms
+    return PcmDeviceManager::instance()->defaultDevice();
 }
 
-PcmRecord::~PcmRecord()
+bool PcmRecord::start(unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int profile)
 {
-    stop();
-    clearChannel();
+    m_profile = pcm_capture_profile(profile);
+    if (!m_profile)
+        m_profile = pcm_capture_profile(PCM_PROFILE_DEFAULT);
+    if (m_profile->ptime)
+        ptime = m_profile->ptime;
+    m_source->setProfile(m_profile);
+    m_fixedRate = samplerate;
+    m_fixedChannel = channel_cnt;
+    m_format = format;
+    m_ptime = ptime;
+    /* 自动协商的设备在打开前按当时的通道确定，先给一个初值 */
+    m_samplerate = samplerate ? samplerate : PCM_RECORD_DEFAULT_RATE;
+    m_channel = channel_cnt ? channel_cnt : 1;
+    m_periodFrames = m_samplerate * ptime / 1000;
+    m_source->setNonblock(true);
+    m_reopenAt = 0; // 加入事件循环后立即打开
+    return m_loop->addHandler(this);
 }
 
-bool PcmRecord::start(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits, unsigned int ptime)
+void PcmRecord::startExternal(unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime)
 {
-    m_running = true;
-    m_samplerate = samplerate;
-    m_channel = channel_cnt;
-    m_bits = bits;
+    m_fixedRate = m_samplerate = samplerate;
+    m_fixedChannel = m_channel = channel_cnt;
+    m_format = format;
     m_ptime = ptime;
-    pthread_create(&m_threadId, NULL, PcmRecordThreadStub, this);
-    return m_running;
+    m_periodFrames = samplerate * ptime / 1000;
 }
 
+/*
+ * 写入一个周期，与捕获线程读到一个周期相同：写入共享缓冲后分发给转换节点
+ * tstamp：周期第一个采样的时间，CLOCK_MONOTONIC，单位ns，0表示取当前时间
+ */
+void PcmRecord::pushFrame(const char *data, int size, long long tstamp)
+{
+    PcmFrameInfo_t info;
+    memset(&info, 0, sizeof(info));
+    if (!tstamp)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        tstamp = now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+    info.seq = m_frameSeq;
+    info.tstamp = tstamp;
+    if (size > m_ring.slotBytes())
+        size = m_ring.slotBytes();
+    char *slot = m_ring.beginFrame();
+    memcpy(slot, data, size);
+    PcmVad *vad = captureVad();
+    if (vad)
+        vad->process(slot, size, &info);
+    m_ring.commitFrame(size, &info);
+    pcm_stat_add(&m_frameSeq, 1);
+    dispatchNodes();
+}
+
+/*
+ * 从事件循环移除，返回后不会再有捕获回调，不等待阻塞的读取
+ */
 void PcmRecord::stop(void)
 {
-    m_running = false;
-    if (m_threadId)
-        pthread_join(m_threadId, 0);
-    m_threadId = 0;
+    m_loop->removeHandler(this);
+    m_source->close();
+    __atomic_store_n(&m_opened, 0, __ATOMIC_RELAXED);
 }
 
-bool PcmRecord::open(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits, unsigned int ptime)
+int PcmRecord::getPollFds(struct pollfd *pfds, int space)
 {
-    snd_pcm_format_t format;
-    int ret = 0, dir = 0;
-    unsigned int sampleRate = samplerate;
-    unsigned int buffer_time, period_time;
-    snd_pcm_uframes_t frames;
-    snd_pcm_hw_params_t *pcm_params; // 配置硬件参数结构体
+    return m_source->pollDescriptors(pfds, space);
+}
 
-    /* 打开一个PCM采集设备 */
-    ret = snd_pcm_open(&m_pcmHandle, "default", SND_PCM_STREAM_CAPTURE, 0);
-    if (ret < 0)
-    {
-        LOG("unable to open pcm device: %s\n", snd_strerror(ret));
+bool PcmRecord::handleEvents(struct pollfd *pfds, int count)
+{
+    unsigned short revents = m_source->pollRevents(pfds, count);
+    if (!(revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)))
         return false;
-    }
 
-    /* params申请内存--这是栈内存 */
-    snd_pcm_hw_params_alloca(&pcm_params);
-    /* 使用pcm设备初始化params */
-    ret = snd_pcm_hw_params_any(m_pcmHandle, pcm_params);
-    if (ret < 0)
+    /* 直接读到共享缓冲的槽里，只写入一次，各通道按自己的读游标取用，耗时与通道数无关；
+    积压多个周期时一次读完。不按实时节奏的源只读到最慢的通道队列满为止 */
+    int periods = 0;
+    int limit = m_source->unpaced() ? sourceRoom() : PCM_RECORD_RING_SLOTS;
+    PcmVad *vad = captureVad();
+    while (periods < limit)
     {
-        LOG("config pcm device: %s\n", snd_strerror(ret));
-        goto exit_1;
+        int ret = m_source->readFrame(&m_ring, m_frameSeq, vad);
+        if (ret == PCM_CAPTURE_AGAIN)
+            break;
+        if (ret == PCM_CAPTURE_EOF)
+        {
+            LOG("%s: end of stream after %llu periods\n", m_name.c_str(), m_frameSeq);
+            m_source->close();
+            __atomic_store_n(&m_opened, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&m_ended, 1, __ATOMIC_RELAXED);
+            m_reopenAt = -1;
+            if (periods > 0)
+                dispatchNodes();
+            return true;
+        }
+        if (ret <= 0)
+        {
+            pcm_stat_add(&m_readErrors, 1);
+            if (++m_failTimes >= 100) // 连续100帧没有取得数据说明声卡可能被移除了或者其他错误
+            {
+                m_failTimes = 0;
+                m_source->close(); // 尝试重新打开
+                __atomic_store_n(&m_opened, 0, __ATOMIC_RELAXED);
+                m_reopenAt = pcm_now_ms() + s_trySleep[m_tryTimes++ % 10];
+                if (periods > 0)
+                    dispatchNodes();
+                return true;
+            }
+            break;
+        }
+        m_failTimes = 0;
+        pcm_stat_add(&m_frameSeq, 1);
+        periods++;
     }
 
-    /* 设置多路数据在buffer中的存储方式
-    SND_PCM_ACCESS_RW_INTERLEAVED每个周期(period)左右声道的数据交叉存放 */
-    ret = snd_pcm_hw_params_set_access(m_pcmHandle, pcm_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    if (ret < 0)
+    if (periods > 0)
+        dispatchNodes();
+    return false;
+}
+
+long long PcmRecord::getDeadline(void)
+{
+    long long deadline = m_source->isOpen() ? -1 : m_reopenAt;
+    long long reconfig = __atomic_load_n(&m_reconfigAt, __ATOMIC_ACQUIRE);
+    if (reconfig >= 0 && (deadline < 0 || reconfig < deadline))
+        deadline = reconfig;
+    long long stats = __atomic_load_n(&m_statsAt, __ATOMIC_ACQUIRE);
+    if (stats >= 0 && (deadline < 0 || stats < deadline))
+        deadline = stats;
+    return deadline;
+}
+
+bool PcmRecord::handleTimeout(void)
+{
+    long long now = pcm_now_ms();
+    bool changed = false;
+
+    long long stats = __atomic_load_n(&m_statsAt, __ATOMIC_ACQUIRE);
+    if (stats >= 0 && stats <= now)
     {
-        LOG("config set_access: %s\n", snd_strerror(ret));
-        goto exit_1;
+        int interval = __atomic_load_n(&m_statsInterval, __ATOMIC_RELAXED);
+        __atomic_compare_exchange_n(&m_statsAt, &stats, interval > 0 ? now + interval : -1LL, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        dumpStats();
     }
 
-    /* 设置采样格式 */
-    switch (bits)
+    /* 通道变化后重新协商，结果与当前不同时关闭设备，下面按新参数重新打开 */
+    long long reconfig = __atomic_load_n(&m_reconfigAt, __ATOMIC_ACQUIRE);
+    if (reconfig >= 0 && reconfig <= now &&
+        __atomic_compare_exchange_n(&m_reconfigAt, &reconfig, -1LL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     {
-    case 8: format = SND_PCM_FORMAT_S8; break;
-    case 16: format = SND_PCM_FORMAT_S16_LE; break;
-    case 24: format = SND_PCM_FORMAT_S24_LE; break;
-    case 32: format = SND_PCM_FORMAT_S32_LE; break;
-    default: format = SND_PCM_FORMAT_S16_LE; break;
+        unsigned int samplerate = m_samplerate, channel_cnt = m_channel;
+        negotiate(&samplerate, &channel_cnt);
+        if (m_source->isOpen() && (samplerate != m_samplerate || channel_cnt != m_channel))
+        {
+            LOG("reconfigure %s: %u/%u -> %u/%u\n", m_name.c_str(), m_samplerate, m_channel, samplerate, channel_cnt);
+            m_source->close();
+            __atomic_store_n(&m_opened, 0, __ATOMIC_RELAXED);
+            m_reopenAt = now;
+            changed = true;
+        }
     }
-    ret = snd_pcm_hw_params_set_format(m_pcmHandle, pcm_params, format);
-    if (ret < 0)
+
+    if (m_source->isOpen() || m_reopenAt < 0 || m_reopenAt > now)
+        return changed;
+
+    if (!m_fixedRate || !m_fixedChannel)
     {
-        LOG("config set_format: %s\n", snd_strerror(ret));
-        goto exit_1;
+        unsigned int samplerate = m_samplerate, channel_cnt = m_channel;
+        if (!m_capsValid)
+            m_capsValid = m_source->probe(m_name.c_str(), m_format, &m_caps);
+        negotiate(&samplerate, &channel_cnt);
+        if (samplerate != m_samplerate || channel_cnt != m_channel)
+            setFormat(samplerate, channel_cnt);
     }
 
-    /* 设置声道数 */
-    ret = snd_pcm_hw_params_set_channels(m_pcmHandle, pcm_params, channel_cnt);
-    if (ret < 0)
+    if (!m_source->open(m_name.c_str(), m_samplerate, m_channel, m_format, m_ptime, m_captureMode))
     {
-        LOG("config set_channel: %s\n", snd_strerror(ret));
-        goto exit_1;
+        pcm_stat_add(&m_openFailures, 1);
+        m_reopenAt = now + s_trySleep[m_tryTimes++ % 10];
+        return changed;
     }
+    m_failTimes = 0;
+    pcm_stat_add(&m_opens, 1);
+    __atomic_store_n(&m_opened, 1, __ATOMIC_RELAXED);
 
-    /* 设置采样率,如果采样率不支持，会用硬件支持最接近的采样率 */
-    ret = snd_pcm_hw_params_set_rate_near(m_pcmHandle, pcm_params, &sampleRate, &dir);
-    if (ret < 0)
+    /* 转换节点按设备实际的周期建立，不再由ptime推算(44.1k系列采样率每毫秒的帧数不是整数) */
+    unsigned int frames = m_source->periodFrames();
+    unsigned int max_frames = m_ring.slotBytes() / (m_channel * pcm_format_bytes(m_format));
+    if (frames == 0 || frames > max_frames)
+        frames = max_frames;
+    if (m_rebuild || frames != m_periodFrames)
     {
-        LOG("config set_rate_near: %s\n", snd_strerror(ret));
-        goto exit_1;
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        m_periodFrames = frames;
+        rebuildNodes();
+        m_rebuild = false;
     }
+    return true;
+}
 
-    /* 获取中最大缓冲时间，单位us */
-    snd_pcm_hw_params_get_buffer_time_max(pcm_params, &buffer_time, 0);
-    if (buffer_time > 1000000)
-        buffer_time = 1000000;
-    /* 设置缓冲时间 */
-    ret = snd_pcm_hw_params_set_buffer_time_near(m_pcmHandle, pcm_params, &buffer_time, 0);
-    if (ret < 0)
+/*
+ * 按通道需求选择捕获参数，请求时指定的参数不变
+ * 采样率优先选硬件原生支持、且是所有通道采样率公倍数的，其次是最高通道采样率的倍数，
+ * 再次是不低于最高通道采样率的；都没有时取最高的原生采样率。没有通道时按PCM_RECORD_DEFAULT_RATE选择
+ */
+void PcmRecord::negotiate(unsigned int *samplerate, unsigned int *channel_cnt)
+{
+    std::vector<unsigned int> rates;
+    unsigned int max_rate = 0, max_chan = 0;
     {
-        LOG("config set_buffer_time_near: %s\n", snd_strerror(ret));
-        goto exit_1;
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        for (size_t i=0; i<m_channels.size(); i++)
+        {
+            rates.push_back(m_channels[i]->samplerate);
+            if (m_channels[i]->samplerate > max_rate)
+                max_rate = m_channels[i]->samplerate;
+            /* 指定了声道映射的通道需要映射的输入声道数 */
+            unsigned int need = m_channels[i]->mapped ? m_channels[i]->map.in_chan : m_channels[i]->channel;
+            if (need > max_chan)
+                max_chan = need;
+        }
     }
-
-    /* 设置周期 */
-    period_time = ptime*1000; // 20ms
-    ret = snd_pcm_hw_params_set_period_time_near(m_pcmHandle, pcm_params, &period_time, 0);
-    if (ret < 0)
+    if (rates.empty())
     {
-        LOG("config set_period_time_near: %s\n", snd_strerror(ret));
-        goto exit_1;
+        rates.push_back(PCM_RECORD_DEFAULT_RATE);
+        max_rate = PCM_RECORD_DEFAULT_RATE;
+        max_chan = 1;
     }
 
-    /* 设置非阻塞--2024-6-6*/
-	//ret = snd_pcm_nonblock(m_pcmHandle, 1); // 0 = block, 1 = nonblock mode, 2 = abort
-	//LOG("set pcm_nonblock ret: %d\n", ret);
+    unsigned int chan = m_fixedChannel;
+    if (!chan)
+    {
+        chan = max_chan;
+        if (m_capsValid && chan < m_caps.min_channels)
+            chan = m_caps.min_channels;
+        if (m_capsValid && chan > m_caps.max_channels)
+            chan = m_caps.max_channels;
+        if (chan < 1 || chan > PCM_CHANNEL_MAX) // 超出声道映射支持的范围时交给plug层
+            chan = max_chan;
+    }
 
-    /* 让这些参数作用于PCM设备 */
-    ret = snd_pcm_hw_params(m_pcmHandle, pcm_params);
-    if (ret < 0)
+    unsigned int rate = m_fixedRate;
+    if (!rate)
     {
-        LOG("unable toset hw params: %s\n", snd_strerror(ret));
-        goto exit_1;
+        rate = max_rate; // 没有原生能力信息时按最高需求打开，由plug层适配
+        int best = -1;
+        for (int i = 0; m_capsValid && i < m_caps.rate_count; i++)
+        {
+            unsigned int r = m_caps.rates[i];
+            if (pcm_format_bytes(m_format) * chan * (r / 1000 + 1) * m_ptime > PCM_PERIOD_MAX_BYTES)
+                continue;
+
+            int score = 0;
+            if (r >= max_rate)
+            {
+                score = (r % max_rate == 0) ? 2 : 1;
+                bool all = true;
+                for (size_t k = 0; k < rates.size() && all; k++)
+                    all = (r % rates[k] == 0);
+                if (all)
+                    score = 3;
+            }
+            /* 同分时能满足需求的取低的，都低于需求时取高的 */
+            if (score > best || (score == best && (score > 0 ? r < rate : r > rate)))
+            {
+                best = score;
+                rate = r;
+            }
+        }
     }
 
-    /* 获取帧大小 */
-    snd_pcm_hw_params_get_period_size(pcm_params, &m_captureFrames, &dir);
-    m_captureSize = snd_pcm_frames_to_bytes(m_pcmHandle, m_captureFrames);
-    LOG("snd_pcm_uframes_t: %lu frame, bytes: %u\n", m_captureFrames, m_captureSize);
-    return true;
+    *samplerate = rate;
+    *channel_cnt = chan;
+}
 
-exit_1:
-    snd_pcm_close(m_pcmHandle);
-    m_pcmHandle = 0;
-    return false;
+/*
+ * 设备关闭期间改变捕获格式：转换完上游剩余的旧格式周期，打开后重建
+ */
+void PcmRecord::setFormat(unsigned int samplerate, unsigned int channel_cnt)
+{
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    for (size_t i=0; i<m_nodes.size(); i++)
+        m_nodes[i]->pump();
+    LOG("capture %s: %u/%u/%s\n", m_name.c_str(), samplerate, channel_cnt, pcm_format_name(m_format));
+    m_samplerate = samplerate;
+    m_channel = channel_cnt;
+    m_periodFrames = samplerate * m_ptime / 1000;
+    m_rebuild = true;
 }
 
-void PcmRecord::close(void)
+/*
+ * 捕获格式或周期改变后在原节点上重建转换，调用者持有m_mutex，设备已打开还未读取。
+ * 格式不再与捕获相同的直读通道改读转换节点，格式变得相同的通道改为直读，
+ * 各通道读完旧缓冲里的帧后才切换
+ */
+void PcmRecord::rebuildNodes(void)
 {
-    if (m_pcmHandle)
+    for (size_t i=0; i<m_nodes.size(); i++) // 上游节点总在下游之前
+    {
+        PcmConvertNode_t *node = m_nodes[i];
+        if (node->parent)
+            node->configure(node->parent->samplerate, node->parent->channel, node->parent->format, node->parent->out_frames);
+        else
+            node->configure(m_samplerate, m_channel, m_format, m_periodFrames);
+    }
+
+    for (size_t i=0; i<m_channels.size(); i++)
     {
-        snd_pcm_drain(m_pcmHandle);
-        snd_pcm_close(m_pcmHandle);
-        m_pcmHandle = NULL;
+        PcmChannel_t *ch = m_channels[i];
+        MutexLockGuard chLockGuard(&ch->lock);
+        ch->applySwitch(true); // 上一次的切换还没完成
+        if (ch->retired)
+        {
+            releaseNode(ch->retired);
+            ch->retired = NULL;
+        }
+
+        bool direct = (ch->samplerate == m_samplerate && ch->channel == m_channel && ch->format == m_format &&
+            !ch->mapped && !ch->processed && !ch->codec);
+        if (direct == (ch->node == NULL))
+            continue;
+        ch->beginSwitch(direct ? NULL : acquireNode(ch->samplerate, ch->channel, ch->format, ch->engine,
+            ch->mapped ? &ch->map : NULL, ch->processed ? &ch->chain : NULL, ch->codec));
     }
 }
 
 /*
- * 读取一帧PCM数据
- * buffer：保存读取的PCM数据
- * buflen：buffer长度，单位字节
- * return：返回实际读取的字节数，失败返回0
+ * 通道变化后延迟重新协商，短时间内的多次变化只重新配置一次
  */
-int PcmRecord::read(char *buffer, int buflen)
+void PcmRecord::scheduleReconfig(void)
 {
-    int ret = 0;
+    if (m_fixedRate && m_fixedChannel)
+        return;
+    __atomic_store_n(&m_reconfigAt, pcm_now_ms() + PCM_RECONFIG_DELAY_MS, __ATOMIC_RELEASE);
+    m_loop->wakeup();
+}
 
-    if (m_pcmHandle)
+/*
+ * 创建一个录音通道
+ * samplerate：采样率，如8000，16000，44100等
+ * channel_cnt：声道数1~PCM_CHANNEL_MAX，与捕获声道数不同时按map或默认映射转换
+ * format：采样格式PCM_FMT_S16/S24_3LE/S32/FLOAT
+ * engine：需要重采样时使用的引擎，RESAMPLE_ENGINE_SRC或RESAMPLE_ENGINE_FIXED
+ * map：声道映射，out_chan须等于channel_cnt，in_chan须等于请求的捕获声道数(自动协商时按它打开设备)
+ * dsp：处理链，格式与捕获相同时也经过转换节点
+ * codec：输出编码，format须为PCM_FMT_S16(编码前的格式)，每帧是编码后的一个周期，不支持按窗口读取
+ * return：成功返回通道句柄，失败返回NULL
+ */
+void *PcmRecord::createChannel(unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    unsigned int frame_ms, unsigned int hop_ms, const PcmChannelMap_t *map, const PcmDspConfig_t *dsp, int codec)
+{
+    PcmChannel_t *ch = NULL;
+    if (map && pcm_chmap_identity(map))
+        map = NULL; // 原样输出与默认映射相同，可以直读或共用节点
+    if (dsp && !pcm_dsp_active(dsp))
+        dsp = NULL;
+    if (map && (map->out_chan != channel_cnt || map->in_chan < 1 || map->in_chan > PCM_CHANNEL_MAX ||
+        (m_fixedChannel && map->in_chan != m_fixedChannel)))
     {
-        ret = snd_pcm_readi(m_pcmHandle, buffer, m_captureFrames); // 从PCM读取交错帧
-        if (ret == -EPIPE) // -EPIPE for the xrun and -ESTRPIPE for the suspended status
-        {
-            LOG("overrun...\n");
-            ret = 0;
-            snd_pcm_prepare(m_pcmHandle);
-        }
-        else if (ret < 0)
+        LOG("channel map %u->%u does not fit %u channels from %u capture channels\n", map->in_chan, map->out_chan,
+            channel_cnt, m_fixedChannel);
+        return NULL;
+    }
+    if (codec < PCM_CODEC_NONE || codec >= PCM_CODEC_COUNT || (codec && (format != PCM_FMT_S16 || frame_ms)))
+    {
+        LOG("unsupported codec %d for %s channel, window %ums\n", codec, pcm_format_name(format), frame_ms);
+        return NULL;
+    }
+    if (hop_ms == 0)
+        hop_ms = frame_ms;
+    if (hop_ms > frame_ms)
+    {
+        LOG("hop %ums longer than frame %ums\n", hop_ms, frame_ms);
+        return NULL;
+    }
+
+    /* 一个窗口跨越的周期数加上起点偏移和读取余量，不能超过转换节点的槽数 */
+    unsigned int window_frames = (unsigned long long)samplerate * frame_ms / 1000;
+    unsigned int hop_frames = (unsigned long long)samplerate * hop_ms / 1000;
+    int window_depth = frame_ms ? (int)((frame_ms + m_ptime - 1) / m_ptime) + 2 : 0;
+    if (frame_ms && (window_frames == 0 || hop_frames == 0 || window_depth > PCM_NODE_RING_SLOTS - 1))
+    {
+        LOG("unsupported window %ums/%ums at %u Hz, ptime %ums\n", frame_ms, hop_ms, samplerate, m_ptime);
+        return NULL;
+    }
+
+    if (pcm_format_bytes(format) > 0 && channel_cnt >= 1 && channel_cnt <= PCM_CHANNEL_MAX)
+    {
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        PcmConvertNode_t *node = NULL;
+        if (samplerate != m_samplerate || channel_cnt != m_channel || format != m_format || map || dsp || codec)
+            node = acquireNode(samplerate, channel_cnt, format, engine, map, dsp, codec);
+        ch = new PcmChannel_t(this, &m_ring, &m_retired, node, samplerate, channel_cnt, format, engine, map, dsp, codec);
+        int depth = m_profile->queue_depth;
+        if (frame_ms)
         {
-            LOG("error read: %d, %s\n", ret, snd_strerror(ret)); // -ENODEV
-            ret = 0;
+            ch->setWindow(window_frames, hop_frames);
+            if (window_depth > depth)
+                depth = window_depth;
         }
-        else if (ret != m_captureFrames)
+        if (depth != ch->depth)
+            ch->setQueueDepth(depth);
+        m_channels.push_back(ch);
+    }
+    if (ch)
+    {
+        scheduleReconfig();
+        consumed(); // 全速回放等第一个通道建立后开始
+    }
+    return ch;
+}
+
+/*
+ * 销毁通道，同时从数组中移除
+ */
+void PcmRecord::destroyChannel(void *channel)
+{
+    {
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        for (size_t i=0; i<m_channels.size(); i++)
         {
-            LOG("less read: %s\n", snd_strerror(ret));
+            PcmChannel_t *ch = m_channels[i];
+            if (ch == channel)
+            {
+                m_channels.erase(m_channels.begin() + i);
+                releaseChannel(ch);
+                LOG("remain %lu chn\n", m_channels.size());
+                break;
+            }
         }
     }
-    return ret * (m_bits>>3);
+    scheduleReconfig();
 }
 
-void *PcmRecord::PcmRecordThreadStub(void *param)
+/*
+ * 释放通道持有的节点并销毁通道，调用者持有m_mutex
+ */
+void PcmRecord::releaseChannel(PcmChannel_t *ch)
 {
-    PcmRecord *inst = (PcmRecord *)param;
-    inst->PcmRecordThread();
-    return NULL;
+    if (ch->node)
+        releaseNode(ch->node);
+    if (ch->switching && ch->next_node)
+        releaseNode(ch->next_node);
+    if (ch->retired)
+        releaseNode(ch->retired);
+    delete ch;
 }
 
-void PcmRecord::PcmRecordThread(void)
+/*
+ * 查找或创建指定输出格式的转换节点，调用者持有m_mutex
+ * 已有节点的采样率是目标采样率的整数倍且低于捕获采样率时，从该节点级联转换，
+ * 复用和级联都只在使用相同重采样引擎和相同声道映射的节点之间进行；
+ * 复用还要求处理链和编码相同，带处理链或编码的节点不作为上游(下游会重复处理或读到编码数据)。
+ * 不带处理链的编码节点也可以从同采样率的节点级联，只做编码
+ */
+PcmConvertNode_t *PcmRecord::acquireNode(unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    const PcmChannelMap_t *map, const PcmDspConfig_t *dsp, int codec)
 {
-    int ret = 0;
-    char buffer[7680] = {0}; // 48000Hz 2chn 16bit(2byte) 20ms --> 48000*20/1000=960*2*2=1920*2=3840
-    bool success = false;
-    unsigned int try_sleep[10] = {2000, 4000, 6000, 8000, 16000, 24000, 32000, 40000, 45000, 90000};
-    unsigned char try_times = 0, fail_times = 0;
-
-    success = open(m_samplerate, m_channel, m_bits, m_ptime);
-    LOG("start capture thread\n");
-    while (m_running)
+    PcmConvertNode_t *parent = NULL;
+    for (size_t i=0; i<m_nodes.size(); i++)
     {
-        if (!success)
-        {
-            usleep(try_sleep[try_times%10] * 1000);
-            try_times++;
-            success = open(m_samplerate, m_channel, m_bits, m_ptime);
+        PcmConvertNode_t *node = m_nodes[i];
+        if (node->engine != engine || !node->sameMap(map))
             continue;
+        if (node->samplerate == samplerate && node->channel == channel_cnt && node->format == format && node->sameDsp(dsp) &&
+            node->codec == codec)
+        {
+            node->refs++;
+            return node;
         }
-
-        ret = read(buffer, sizeof(buffer));
-        if (ret > 0) // 将数据给到注册的音频通道
+        bool encode_only = (codec && !dsp && node->samplerate == samplerate);
+        if (node->plain() && node->channel == channel_cnt && node->format == format &&
+            ((node->samplerate > samplerate && node->samplerate < m_samplerate && node->samplerate % samplerate == 0) ||
+            encode_only) &&
+            (!parent || node->samplerate < parent->samplerate))
         {
-            fail_times = 0;
-            feedChannel(buffer, ret);
+            parent = node;
         }
-        else
+    }
+
+    PcmConvertNode_t *node = NULL;
+    if (parent)
+    {
+        parent->refs++;
+        node = new PcmConvertNode_t(&parent->out, parent, samplerate, channel_cnt, format,
+            parent->samplerate, parent->channel, parent->format, parent->out_frames, m_ptime, engine, map, dsp, codec);
+    }
+    else
+    {
+        node = new PcmConvertNode_t(&m_ring, NULL, samplerate, channel_cnt, format,
+            m_samplerate, m_channel, m_format, m_periodFrames, m_ptime, engine, map, dsp, codec);
+    }
+    node->async = (m_pool != NULL);
+    m_nodes.push_back(node);
+    LOG("new node %u/%u/%s from %u/%u%s%s%s%s, total %lu node\n", samplerate, channel_cnt, pcm_format_name(format),
+        node->origin_samplerate, node->origin_channel, map ? " mapped" : "", dsp ? " dsp" : "", codec ? " " : "",
+        codec ? pcm_codec_name(codec) : "", m_nodes.size());
+    return node;
+}
+
+/*
+ * 释放节点引用，无人引用时销毁，调用者持有m_mutex
+ */
+void PcmRecord::releaseNode(PcmConvertNode_t *node)
+{
+    if (--node->refs > 0)
+        return;
+
+    for (size_t i=0; i<m_nodes.size(); i++)
+    {
+        if (m_nodes[i] == node)
         {
-            fail_times++;
-            if (fail_times >= 100) // 连续100帧没有取得数据说明声卡可能被移除了或者其他错误
-            {
-				fail_times = 0;
-                success = false; // 尝试重新打开
-                close();
-            }
+            m_nodes.erase(m_nodes.begin() + i);
+            break;
         }
     }
-    close();
-    LOG("exit capture thread\n");
+
+    PcmConvertNode_t *parent = node->parent;
+    LOG("free node %u/%u/%s: %llu frames, %llu us cpu, %.1f us/frame\n",
+        node->samplerate, node->channel, pcm_format_name(node->format), node->frames, node->cpu_ns / 1000,
+        node->frames ? node->cpu_ns / 1000.0 / node->frames : 0.0);
+    delete node;
+    if (parent)
+        releaseNode(parent);
 }
 
 /*
- * 创建一个录音通道
- * samplerate：采样率，如8000，16000，44100等
- * channel_cnt：1：单声道，2：双声道，仅支持这2个
- * bits：位宽，当前仅支持16bit
- * return：成功返回通道句柄，失败返回NULL
+ * 获取所有转换节点的统计
+ * return：实际填充的个数
  */
-void *PcmRecord::createChannel(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits)
+int PcmRecord::getNodeStats(PcmNodeStat_t *stats, int max)
 {
-    PcmChannel_t *ch = NULL;
-    if ((bits == 16) && (channel_cnt == 1 || channel_cnt == 2))
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    int n = 0;
+    for (size_t i=0; i<m_nodes.size() && n<max; i++, n++)
+    {
+        PcmConvertNode_t *node = m_nodes[i];
+        stats[n].samplerate = node->samplerate;
+        stats[n].channel = node->channel;
+        stats[n].format = node->format;
+        stats[n].source_samplerate = node->origin_samplerate;
+        stats[n].source_channel = node->origin_channel;
+        stats[n].mapped = node->mapped;
+        stats[n].dsp = node->processed;
+        stats[n].agc_gain_db = node->processed ? node->dsp.agcGainDb() : 0;
+        stats[n].clipped = node->processed ? node->dsp.clipped() : 0;
+        stats[n].codec = node->codec;
+        stats[n].engine = node->resampler ? node->resampler->resample_get_engine() : -1;
+        stats[n].users = node->refs;
+        stats[n].frames = __atomic_load_n(&node->frames, __ATOMIC_RELAXED);
+        stats[n].runs = __atomic_load_n(&node->runs, __ATOMIC_RELAXED);
+        stats[n].cpu_ns = __atomic_load_n(&node->cpu_ns, __ATOMIC_RELAXED);
+        stats[n].bytes = __atomic_load_n(&node->bytes, __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+void PcmRecord::getStats(PcmDeviceStat_t *stat)
+{
+    memset(stat, 0, sizeof(*stat));
+    snprintf(stat->name, sizeof(stat->name), "%s", m_name.c_str());
     {
-        ch = new PcmChannel_t(samplerate, channel_cnt, bits, m_samplerate, m_channel, m_bits, m_ptime);
         MutexLockGuard mutexlockGuard(&m_mutex);
-        m_channels.push_back(ch);
+        stat->samplerate = m_samplerate;
+        stat->channel = m_channel;
+        stat->format = m_format;
+        stat->channels = (int)m_channels.size();
+        stat->nodes = (int)m_nodes.size();
     }
-    return ch;
+    unsigned long long opens = __atomic_load_n(&m_opens, __ATOMIC_RELAXED);
+    stat->opened = __atomic_load_n(&m_opened, __ATOMIC_RELAXED);
+    stat->ended = __atomic_load_n(&m_ended, __ATOMIC_RELAXED);
+    stat->periods = __atomic_load_n(&m_frameSeq, __ATOMIC_RELAXED);
+    stat->xruns = m_source->xruns();
+    stat->short_reads = m_source->shortReads();
+    stat->read_errors = __atomic_load_n(&m_readErrors, __ATOMIC_RELAXED);
+    stat->reopens = opens > 0 ? opens - 1 : 0;
+    stat->open_failures = __atomic_load_n(&m_openFailures, __ATOMIC_RELAXED);
+    m_loop->getSched(&stat->sched_policy, &stat->sched_priority);
+    stat->memory_locked = pcm_memory_locked();
+
+    PcmVadStat_t vad;
+    m_vad.getStats(&vad);
+    {
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        stat->vad = m_vadEnable;
+    }
+    stat->peak_db = vad.peak_db;
+    stat->rms_db = vad.rms_db;
+    stat->noise_db = vad.noise_db;
+    stat->speech = vad.speech;
+    stat->speech_periods = vad.speech_periods;
+    stat->silence_periods = vad.silence_periods;
+    stat->segments = vad.segments;
 }
 
 /*
- * 销毁通道，同时从数组中移除
+ * return：通道不属于本设备返回false
  */
-void PcmRecord::destroyChannel(void *channel)
+bool PcmRecord::getChannelStats(void *channel, PcmChannelStat_t *stat)
+{
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    for (size_t i=0; i<m_channels.size(); i++)
+    {
+        PcmChannel_t *ch = m_channels[i];
+        if (ch != channel)
+            continue;
+        stat->samplerate = ch->samplerate;
+        stat->channel = ch->channel;
+        stat->format = ch->format;
+        stat->mapped = ch->mapped;
+        stat->dsp = ch->processed;
+        stat->codec = ch->codec;
+        stat->speech_only = ch->reader.speech_only;
+        stat->direct = (__atomic_load_n(&ch->node, __ATOMIC_RELAXED) == NULL);
+        stat->queue_depth = __atomic_load_n(&ch->depth, __ATOMIC_RELAXED);
+        stat->window_frames = ch->window / (ch->channel * pcm_format_bytes(ch->format));
+        stat->hop_frames = ch->hop / (ch->channel * pcm_format_bytes(ch->format));
+        stat->high_water = __atomic_load_n(&ch->reader.high_water, __ATOMIC_RELAXED);
+        stat->served = __atomic_load_n(&ch->reader.served, __ATOMIC_RELAXED);
+        stat->dropped = __atomic_load_n(&ch->reader.dropped, __ATOMIC_RELAXED);
+        stat->skipped = __atomic_load_n(&ch->reader.skipped, __ATOMIC_RELAXED);
+        unsigned long long count = __atomic_load_n(&ch->latency_count, __ATOMIC_RELAXED);
+        stat->latency_avg_us = count ? __atomic_load_n(&ch->latency_sum, __ATOMIC_RELAXED) / count / 1000 : 0;
+        stat->latency_max_us = __atomic_load_n(&ch->latency_max, __ATOMIC_RELAXED) / 1000;
+        return true;
+    }
+    return false;
+}
+
+void PcmRecord::setStatsInterval(int interval_ms)
+{
+    __atomic_store_n(&m_statsInterval, interval_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_statsAt, interval_ms > 0 ? pcm_now_ms() + interval_ms : -1LL, __ATOMIC_RELEASE);
+    m_loop->wakeup();
+}
+
+/*
+ * 统计快照，每行一个对象，key=value格式便于本地采集程序解析
+ */
+void PcmRecord::dumpStats(void)
+{
+    PcmDeviceStat_t dev;
+    getStats(&dev);
+    LOG("stats device=%s rate=%u ch=%u fmt=%s opened=%d ended=%d channels=%d nodes=%d periods=%llu xruns=%llu short_reads=%llu read_errors=%llu reopens=%llu open_failures=%llu sched=%s:%d mlock=%d\n",
+        dev.name, dev.samplerate, dev.channel, pcm_format_name(dev.format), dev.opened, dev.ended, dev.channels, dev.nodes,
+        dev.periods, dev.xruns, dev.short_reads, dev.read_errors, dev.reopens, dev.open_failures,
+        pcm_sched_policy_name(dev.sched_policy), dev.sched_priority, dev.memory_locked);
+    if (dev.vad)
+        LOG("stats device=%s vad=1 peak_db=%.1f rms_db=%.1f noise_db=%.1f speech=%d speech_periods=%llu silence_periods=%llu segments=%llu\n",
+            dev.name, dev.peak_db, dev.rms_db, dev.noise_db, dev.speech, dev.speech_periods, dev.silence_periods, dev.segments);
+
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    for (size_t i=0; i<m_channels.size(); i++)
+    {
+        PcmChannel_t *ch = m_channels[i];
+        int frame_bytes = ch->channel * pcm_format_bytes(ch->format);
+        unsigned long long count = __atomic_load_n(&ch->latency_count, __ATOMIC_RELAXED);
+        LOG("stats device=%s channel=%p rate=%u ch=%u fmt=%s mapped=%d dsp=%d codec=%s speech_only=%d direct=%d window=%d hop=%d depth=%d high_water=%llu served=%llu dropped=%llu skipped=%llu latency_avg_us=%llu latency_max_us=%llu\n",
+            dev.name, ch, ch->samplerate, ch->channel, pcm_format_name(ch->format), ch->mapped, ch->processed,
+            pcm_codec_name(ch->codec), ch->reader.speech_only,
+            __atomic_load_n(&ch->node, __ATOMIC_RELAXED) == NULL, ch->window / frame_bytes, ch->hop / frame_bytes,
+            __atomic_load_n(&ch->depth, __ATOMIC_RELAXED),
+            __atomic_load_n(&ch->reader.high_water, __ATOMIC_RELAXED),
+            __atomic_load_n(&ch->reader.served, __ATOMIC_RELAXED),
+            __atomic_load_n(&ch->reader.dropped, __ATOMIC_RELAXED),
+            __atomic_load_n(&ch->reader.skipped, __ATOMIC_RELAXED),
+            count ? __atomic_load_n(&ch->latency_sum, __ATOMIC_RELAXED) / count / 1000 : 0ULL,
+            __atomic_load_n(&ch->latency_max, __ATOMIC_RELAXED) / 1000);
+    }
+    for (size_t i=0; i<m_nodes.size(); i++)
+    {
+        PcmConvertNode_t *node = m_nodes[i];
+        unsigned long long runs = __atomic_load_n(&node->runs, __ATOMIC_RELAXED);
+        unsigned long long cpu_ns = __atomic_load_n(&node->cpu_ns, __ATOMIC_RELAXED);
+        LOG("stats device=%s node=%u/%u/%s from=%u/%u mapped=%d dsp=%d agc_gain_db=%.1f clipped=%llu codec=%s frames=%llu bytes=%llu runs=%llu ns_per_run=%llu\n",
+            dev.name, node->samplerate, node->channel, pcm_format_name(node->format), node->origin_samplerate,
+            node->origin_channel, node->mapped, node->processed, node->processed ? node->dsp.agcGainDb() : 0.0f,
+            node->processed ? node->dsp.clipped() : 0ULL, pcm_codec_name(node->codec),
+            __atomic_load_n(&node->frames, __ATOMIC_RELAXED), __atomic_load_n(&node->bytes, __ATOMIC_RELAXED),
+            runs, runs ? cpu_ns / runs : 0);
+    }
+}
+
+/* ring中从seq起未读的帧数，读者超前(刚切换)时为0 */
+static unsigned long long ring_backlog(PcmFrameRing_t *ring, PcmRingReader_t *reader)
+{
+    unsigned long long head = ring->head();
+    unsigned long long seq = __atomic_load_n(&reader->seq, __ATOMIC_RELAXED);
+    return head > seq ? head - seq : 0;
+}
+
+/*
+ * 不按实时节奏的源本次可读的周期数：每个通道的积压(含各级转换节点未转换的周期)
+ * 不超过队列深度，没有通道时不读
+ */
+int PcmRecord::sourceRoom(void)
 {
     MutexLockGuard mutexlockGuard(&m_mutex);
-    for (int i=0; i<m_channels.size(); i++)
+    int room = m_channels.empty() ? 0 : PCM_RECORD_RING_SLOTS;
+    for (size_t i=0; i<m_channels.size(); i++)
     {
         PcmChannel_t *ch = m_channels[i];
-        if (ch == channel)
+        unsigned long long backlog = ring_backlog(ch->ring, &ch->reader);
+        for (PcmConvertNode_t *node = __atomic_load_n(&ch->node, __ATOMIC_RELAXED); node; node = node->parent)
+            backlog += ring_backlog(node->source, &node->reader);
+        long long left = (long long)__atomic_load_n(&ch->reader.depth, __ATOMIC_RELAXED) - (long long)backlog;
+        if (left < room)
+            room = left > 0 ? (int)left : 0;
+    }
+    return room;
+}
+
+/*
+ * 线程池模式下把每个转换节点投递给线程池，
+ * 上一周期的任务还没执行的节点不重复投递，积压的周期在一次pump中处理完
+ */
+void PcmRecord::dispatchNodes(void)
+{
+    bool retired = __atomic_exchange_n(&m_retired, 0, __ATOMIC_ACQ_REL) != 0;
+    if (!retired && !__atomic_load_n(&m_pool, __ATOMIC_ACQUIRE)) // 拉取模式没有待释放的节点时不加锁
+        return;
+
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    for (size_t i=0; retired && i<m_channels.size(); i++) // 读取线程切换后留下的节点
+    {
+        PcmConvertNode_t *node = __atomic_exchange_n(&m_channels[i]->retired, (PcmConvertNode_t *)NULL, __ATOMIC_ACQ_REL);
+        if (node)
+            releaseNode(node);
+    }
+    if (!m_pool)
+        return;
+
+    for (size_t i=0; i<m_nodes.size(); i++)
+    {
+        PcmConvertNode_t *node = m_nodes[i];
+        if (__atomic_exchange_n(&node->queued, 1, __ATOMIC_ACQ_REL) == 0)
         {
-            m_channels.erase(m_channels.begin() + i);
-            delete ch;
-            LOG("remain %lu chn\n", m_channels.size());
-            break;
+            node->refs++; // 任务持有一个引用，执行完释放
+            __atomic_add_fetch(&m_tasks, 1, __ATOMIC_RELAXED);
+            m_pool->submit(NodeTaskStub, this, node);
         }
     }
 }
 
+void PcmRecord::NodeTaskStub(void *obj, void *arg)
+{
+    PcmRecord *inst = (PcmRecord *)obj;
+    PcmConvertNode_t *node = (PcmConvertNode_t *)arg;
+
+    __atomic_store_n(&node->queued, 0, __ATOMIC_RELEASE);
+    node->pump();
+
+    {
+        MutexLockGuard mutexlockGuard(&inst->m_mutex);
+        inst->releaseNode(node);
+    }
+    __atomic_sub_fetch(&inst->m_tasks, 1, __ATOMIC_RELEASE); // 最后一次访问inst，之后设备可以销毁
+}
+
+void PcmRecord::setDspPool(DspWorkerPool *pool)
+{
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    __atomic_store_n(&m_pool, pool, __ATOMIC_RELEASE); // dispatchNodes()先不加锁读取
+    for (size_t i=0; i<m_nodes.size(); i++)
+        __atomic_store_n(&m_nodes[i]->async, pool != NULL, __ATOMIC_RELEASE);
+}
+
 /*
- * PcmRecordThread()调用
+ * 设置由捕获线程在读取下一个周期前生效，不与正在进行的检测竞争
  */
-void PcmRecord::feedChannel(const char *buffer, int len)
+void PcmRecord::setVad(bool enable, const PcmVadConfig_t *cfg)
 {
     MutexLockGuard mutexlockGuard(&m_mutex);
-    for (int i=0; i<m_channels.size(); i++)
+    m_vadEnable = enable;
+    if (cfg)
+        m_vadConfig = *cfg;
+    else
+        pcm_vad_default_config(&m_vadConfig);
+    __atomic_store_n(&m_vadChanged, 1, __ATOMIC_RELEASE);
+}
+
+/* 捕获线程调用：生效待定的设置，格式变化时重新开始检测；return：不做检测返回NULL */
+PcmVad *PcmRecord::captureVad(void)
+{
+    if (__atomic_exchange_n(&m_vadChanged, 0, __ATOMIC_ACQUIRE))
     {
-        PcmChannel_t *ch = m_channels[i];
-        ch->queue.putFrame(buffer, len);
+        MutexLockGuard mutexlockGuard(&m_mutex);
+        m_vadOn = m_vadEnable;
+        m_vad.configure(&m_vadConfig);
+        LOG("%s: vad %s threshold=%.1fdB floor=%.1fdBFS hangover=%ums attack=%ums\n", m_name.c_str(),
+            m_vadOn ? "on" : "off", m_vadConfig.threshold_db, m_vadConfig.floor_db, m_vadConfig.hangover_ms,
+            m_vadConfig.attack_ms);
     }
+    if (!m_vadOn)
+        return NULL;
+    m_vad.setFormat(m_samplerate, m_channel, m_format);
+    return &m_vad;
+}
+
+/*
+ * return：通道不属于本设备或是按窗口读取的通道返回false
+ */
+bool PcmRecord::setChannelSpeechOnly(void *channel, bool enable)
+{
+    MutexLockGuard mutexlockGuard(&m_mutex);
+    for (size_t i=0; i<m_channels.size(); i++)
+    {
+        if (m_channels[i] == channel)
+            return m_channels[i]->setSpeechOnly(enable);
+    }
+    return false;
 }
 
 /*
@@ -326,36 +891,580 @@ void PcmRecord::clearChannel(void)
     {
         PcmChannel_t *ch = *it;
         m_channels.erase(it);
-        delete ch;
+        releaseChannel(ch);
     }
 }
 
 /*
  * 获取一帧音频数据保存在buffer中
  * buflen：buffer长度，单位字节
+ * info：返回帧的捕获周期序号和捕获时间，可为NULL
  * return：成功返回实际的音频长度，单位字节，失败返回0，缓冲区长度不够返回-1
  */
-int PcmRecord::readChannel(void *channel, char *buffer, int buflen, int timeout_ms)
+int PcmRecord::readChannel(void *channel, char *buffer, int buflen, int timeout_ms, PcmFrameInfo_t *info)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)channel;
+    if (!ch)
+        return 0;
+    int ret = ch->getData(buffer, buflen, timeout_ms, info);
+    consumed();
+    return ret;
+}
+
+/*
+ * 获取所有已到的音频帧，按顺序连续保存在buffer中
+ * max_frames：最多帧数，<=0表示只受buflen限制
+ * frames：返回实际帧数，可为NULL
+ * info：返回第一帧的捕获信息，可为NULL，之后各帧的序号依次加1(序号不连续时中间有丢帧)
+ * return：成功返回总长度，单位字节，超时返回0，缓冲区连一帧都放不下返回-1
+ */
+int PcmRecord::readChannelFrames(void *channel, char *buffer, int buflen, int max_frames, int timeout_ms, int *frames,
+    PcmFrameInfo_t *info)
 {
     PcmChannel_t *ch = (PcmChannel_t *)channel;
-    return ch ? ch->getData(buffer, buflen, timeout_ms) : 0;
+    if (frames)
+        *frames = 0;
+    if (!ch)
+        return 0;
+    int ret = ch->getFrames(buffer, buflen, max_frames, timeout_ms, frames, info);
+    consumed();
+    return ret;
+}
+
+/*
+ * 借出一帧，view指向库内的帧缓冲，只读，用完调用releaseFrame()
+ * return：成功返回帧长度，单位字节，超时返回0，上一帧未归还返回-1
+ */
+int PcmRecord::borrowFrame(void *channel, PcmFrameView_t *view, int timeout_ms)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)channel;
+    return ch ? ch->borrowFrame(view, timeout_ms) : 0;
+}
+
+bool PcmRecord::releaseFrame(void *channel, const PcmFrameView_t *view)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)channel;
+    if (!ch)
+        return false;
+    bool ret = ch->releaseFrame(view);
+    consumed();
+    return ret;
+}
+
+/////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+// 设备管理
+PcmDeviceManager::PcmDeviceManager()
+{
+    m_pool = NULL;
+    m_default = NULL;
+    /* PCM_STATS_INTERVAL=毫秒数，定期输出统计快照 */
+    const char *env = getenv("PCM_STATS_INTERVAL");
+    m_statsInterval = env ? atoi(env) : 0;
+
+    /*
+     * PCM_CAPTURE_SCHED/PCM_DSP_SCHED=fifo:80、rr:50，PCM_CAPTURE_CPUS/PCM_DSP_CPUS=2、0-3，
+     * PCM_MLOCK=1锁定内存，不修改程序即可对比实时调度的效果
+     */
+    loadSchedEnv(PCM_THREAD_CAPTURE, "PCM_CAPTURE_SCHED", "PCM_CAPTURE_CPUS");
+    loadSchedEnv(PCM_THREAD_DSP, "PCM_DSP_SCHED", "PCM_DSP_CPUS");
+    env = getenv("PCM_MLOCK");
+    if (env && atoi(env) > 0)
+        pcm_memory_lock();
+    m_loop.setSched(&m_sched[PCM_THREAD_CAPTURE]);
+    m_loop.start();
+}
+
+void PcmDeviceManager::loadSchedEnv(int thread, const char *sched_env, const char *cpus_env)
+{
+    PcmThreadSched_t *sched = &m_sched[thread];
+    pcm_sched_init(sched);
+
+    const char *env = getenv(sched_env);
+    if (env && !pcm_sched_parse_policy(env, sched))
+    {
+        LOG("invalid %s=%s, use default scheduling\n", sched_env, env);
+        pcm_sched_init(sched);
+    }
+    env = getenv(cpus_env);
+    if (env && !pcm_sched_parse_cpus(env, sched))
+        LOG("invalid %s=%s, not bound\n", cpus_env, env);
+}
+
+PcmDeviceManager::~PcmDeviceManager()
+{
+    m_loop.stop(); // 先停捕获，设备析构时不再有回调
+    for (size_t i=0; i<m_devices.size(); i++)
+        delete m_devices[i];
+    m_devices.clear();
+    m_refs.clear();
+    setDspThreads(0);
+}
+
+PcmDeviceManager *PcmDeviceManager::instance()
+{
+    static PcmDeviceManager manager;
+    return &manager;
+}
+
+/*
+ * 打开捕获设备
+ * name：ALSA PCM名称，如"default"、"hw:1,0"、"plughw:CARD=Array,DEV=0"，
+ *     或"replay:文件[,选项]"、"tone[:频率]"、"noise"，见pcm_source_create()
+ * samplerate/channel_cnt/format：捕获参数，采样率和声道数为0时自动协商；ptime：周期，单位ms
+ * profile：PCM_PROFILE_*，配置了周期时忽略ptime
+ * return：成功返回设备，同名设备已用不同参数打开时返回NULL
+ */
+PcmRecord *PcmDeviceManager::openDevice(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime,
+    int profile)
+{
+    const PcmCaptureProfile_t *config = pcm_capture_profile(profile);
+    if (!config)
+        return NULL;
+    if (config->ptime)
+        ptime = config->ptime;
+    if (!name || pcm_format_bytes(format) <= 0 || channel_cnt > PCM_CHANNEL_MAX || !ptime)
+        return NULL;
+    if (pcm_format_bytes(format) * (channel_cnt ? channel_cnt : 1) * (samplerate / 1000 + 1) * ptime > PCM_PERIOD_MAX_BYTES)
+    {
+        LOG("period too large: %s %u/%u/%s %ums\n", name, samplerate, channel_cnt, pcm_format_name(format), ptime);
+        return NULL;
+    }
+
+    MutexLockGuard guard(&m_lock);
+    for (size_t i=0; i<m_devices.size(); i++)
+    {
+        PcmRecord *dev = m_devices[i];
+        if (strcmp(dev->name(), name))
+            continue;
+        if (!dev->matches(samplerate, channel_cnt, format, ptime, profile))
+        {
+            LOG("device %s already opened with other parameters\n", name);
+            return NULL;
+        }
+        m_refs[i]++;
+        return dev;
+    }
+
+    PcmRecord *dev = new PcmRecord(&m_loop, name);
+    dev->setDspPool(m_pool);
+    if (m_statsInterval > 0)
+        dev->setStatsInterval(m_statsInterval);
+    dev->start(samplerate, channel_cnt, format, ptime, profile);
+    m_devices.push_back(dev);
+    m_refs.push_back(1);
+    LOG("open device %s %u/%u/%s %ums %s, total %lu device\n", name, samplerate, channel_cnt,
+        pcm_format_name(format), ptime, config->name, m_devices.size());
+    return dev;
+}
+
+/*
+ * 释放设备引用，无人引用时停止捕获并销毁设备，设备上的通道须先关闭
+ */
+void PcmDeviceManager::closeDevice(PcmRecord *device)
+{
+    {
+        MutexLockGuard guard(&m_lock);
+        for (size_t i=0; i<m_devices.size(); i++)
+        {
+            if (m_devices[i] != device)
+                continue;
+            if (--m_refs[i] > 0)
+                return;
+            m_devices.erase(m_devices.begin() + i);
+            m_refs.erase(m_refs.begin() + i);
+            if (device == m_default)
+                m_default = NULL;
+            break;
+        }
+    }
+    LOG("close device %s\n", device->name());
+    delete device; // 锁外销毁，等待线程池任务时不阻塞其他设备的打开
+}
+
+PcmRecord *PcmDeviceManager::defaultDevice(void)
+{
+    MutexLockGuard guard(&m_lock);
+    if (m_default)
+        return m_default;
+
+    for (size_t i=0; i<m_devices.size(); i++)
+    {
+        if (!strcmp(m_devices[i]->name(), "default")) // 已由AI_OpenDevice打开
+        {
+            m_refs[i]++;
+            m_default = m_devices[i];
+            return m_default;
+        }
+    }
+
+    /* 高精度麦克风可用环境变量指定原生格式捕获，如PCM_CAPTURE_FORMAT=s24_3le */
+    int format = PCM_FMT_S16;
+    const char *env = getenv("PCM_CAPTURE_FORMAT");
+    if (env && pcm_format_parse(env) >= 0)
+        format = pcm_format_parse(env);
+
+    /* 延迟配置，如PCM_CAPTURE_PROFILE=ultra_low */
+    int profile = PCM_PROFILE_DEFAULT;
+    env = getenv("PCM_CAPTURE_PROFILE");
+    if (env && pcm_capture_profile_parse(env) >= 0)
+        profile = pcm_capture_profile_parse(env);
+
+    m_default = new PcmRecord(&m_loop, "default");
+    m_default->setDspPool(m_pool);
+    if (m_statsInterval > 0)
+        m_default->setStatsInterval(m_statsInterval);
+    m_default->start(0, 0, format, 20, profile); // 帧长20ms，采样率和声道数按通道需求协商
+    m_devices.push_back(m_default);
+    m_refs.push_back(1); // 默认设备一直保留到进程退出
+    return m_default;
+}
+
+/*
+ * 设置所有设备共用的DSP线程池
+ * threads：0：关闭，由调用AI_GetFrame的线程转换(默认)；<0：使用CPU核数；>0：线程数
+ */
+bool PcmDeviceManager::setDspThreads(int threads)
+{
+    DspWorkerPool *old = NULL;
+    DspWorkerPool *pool = NULL;
+
+    if (threads != 0)
+    {
+        pool = new DspWorkerPool();
+        MutexLockGuard guard(&m_lock);
+        pool->setSched(&m_sched[PCM_THREAD_DSP]);
+        pool->start(threads);
+    }
+
+    {
+        MutexLockGuard guard(&m_lock);
+        old = m_pool;
+        m_pool = pool;
+        for (size_t i=0; i<m_devices.size(); i++)
+            m_devices[i]->setDspPool(pool);
+    }
+
+    if (old) // 在锁外停止，残留任务释放节点时需要设备的锁
+    {
+        DspPoolStat_t stat;
+        old->stop();
+        old->getStats(&stat);
+        LOG("dsp pool stop: %d threads, %llu tasks, %llu stolen, max wait %llu us\n",
+            stat.threads, stat.tasks, stat.steals, stat.max_wait_ns / 1000);
+        delete old;
+    }
+    if (pool)
+        LOG("dsp pool start: %d threads\n", pool->threads());
+    return true;
+}
+
+void PcmDeviceManager::setStatsInterval(int interval_ms)
+{
+    MutexLockGuard guard(&m_lock);
+    m_statsInterval = interval_ms;
+    for (size_t i=0; i<m_devices.size(); i++)
+        m_devices[i]->setStatsInterval(interval_ms);
+}
+
+bool PcmDeviceManager::setThreadSched(int thread, const PcmThreadSched_t *sched)
+{
+    if (thread < 0 || thread >= PCM_THREAD_COUNT)
+        return false;
+
+    MutexLockGuard guard(&m_lock);
+    m_sched[thread] = *sched;
+    if (thread == PCM_THREAD_CAPTURE)
+        return m_loop.setSched(sched);
+    return m_pool ? m_pool->setSched(sched) : true;
 }
 
 /////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 // 实例定义
 void *AI_EnableChn(unsigned int samplerate, unsigned int channel_cnt)
 {
-    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, 16);
+    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, PCM_FMT_S16);
+}
+
+/*
+ * 同AI_EnableChn，可指定输出采样格式和重采样引擎：
+ * format：PCM_FMT_S16/S24_3LE/S32/FLOAT
+ * engine：RESAMPLE_ENGINE_SRC：libsamplerate；RESAMPLE_ENGINE_FIXED：内置定点多相FIR，比例不支持或非16bit时退回libsamplerate
+ */
+void *AI_EnableChnEx(unsigned int samplerate, unsigned int channel_cnt, int format, int engine)
+{
+    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, format, engine);
 }
 
 void AI_DisableChn(void *ChnID)
 {
-    PcmRecord::instance()->destroyChannel(ChnID);
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    if (ch)
+        ch->device->destroyChannel(ChnID);
 }
 
 int AI_GetFrame(void *ChnID, char *pstFrm, int len, int timeout_ms)
 {
-    return PcmRecord::instance()->readChannel(ChnID, pstFrm, len, timeout_ms);
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return ch ? ch->device->readChannel(ChnID, pstFrm, len, timeout_ms) : 0;
+}
+
+/*
+ * 同AI_GetFrame，同时返回帧的捕获信息：
+ * info->seq：捕获周期序号，跳号表示因消费太慢被丢弃；
+ * info->tstamp：周期第一个采样的捕获时间(驱动时间戳，CLOCK_MONOTONIC，ns)，与当前时间之差即为延迟
+ */
+int AI_GetFrameEx(void *ChnID, char *pstFrm, int len, int timeout_ms, PcmFrameInfo_t *info)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return ch ? ch->device->readChannel(ChnID, pstFrm, len, timeout_ms, info) : 0;
+}
+
+/*
+ * 一次取出积压的多帧，消费者落后时不必逐帧调用；第一帧最多等待timeout_ms
+ */
+int AI_GetFrames(void *ChnID, char *pstFrm, int len, int max_frames, int timeout_ms, int *frames, PcmFrameInfo_t *info)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    if (!ch)
+    {
+        if (frames)
+            *frames = 0;
+        return 0;
+    }
+    return ch->device->readChannelFrames(ChnID, pstFrm, len, max_frames, timeout_ms, frames, info);
+}
+
+/*
+ * 零拷贝读取：只转发或编码数据的消费者直接使用库内的缓冲，不再拷贝
+ * 借出的帧在缓冲转一圈前(捕获缓冲约1.28s，转换节点16帧)须归还，归还前不要在该通道上调用AI_GetFrame
+ */
+int AI_BorrowFrame(void *ChnID, PcmFrameView_t *view, int timeout_ms)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return (ch && view) ? ch->device->borrowFrame(ChnID, view, timeout_ms) : 0;
+}
+
+/*
+ * return：0：借出期间数据有效；-1：期间被覆盖(消费者太慢)，应丢弃这帧的处理结果
+ */
+int AI_ReleaseFrame(void *ChnID, PcmFrameView_t *view)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return (ch && view && ch->device->releaseFrame(ChnID, view)) ? 0 : -1;
+}
+
+int AI_GetNodeStats(PcmNodeStat_t *stats, int max)
+{
+    return PcmRecord::instance()->getNodeStats(stats, max);
+}
+
+/*
+ * threads：0：由调用AI_GetFrame的线程转换(默认)；<0：使用CPU核数；>0：DSP线程数
+ */
+int AI_SetDspThreads(int threads)
+{
+    return PcmDeviceManager::instance()->setDspThreads(threads) ? 0 : -1;
+}
+
+/*
+ * 打开捕获设备，同名设备已打开且参数相同时返回同一个设备
+ * name：ALSA PCM名称，如"default"、"hw:1,0"、"plughw:CARD=Array,DEV=0"，
+ *     回放文件"replay:/data/rec.wav"(加",fast"按通道读取的速度回放)，信号发生器"tone:440"、"noise"
+ * samplerate/channel_cnt：0表示按硬件原生能力和通道需求自动选择，通道变化时在线重新配置
+ * format：捕获采样格式PCM_FMT_*；ptime：周期，单位ms
+ * return：成功返回设备句柄，失败返回NULL
+ */
+void *AI_OpenDevice(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime)
+{
+    return PcmDeviceManager::instance()->openDevice(name, samplerate, channel_cnt, format, ptime);
+}
+
+/*
+ * 按延迟配置打开捕获设备，周期、ALSA缓冲、唤醒阈值和通道队列深度由配置决定
+ * profile：PCM_PROFILE_ULTRA_LOW(4ms周期)、PCM_PROFILE_BALANCED(10ms)、PCM_PROFILE_POWER_SAVE(40ms)，
+ *     PCM_PROFILE_DEFAULT同AI_OpenDevice的20ms；达到的延迟见AI_GetChnStats的latency_avg_us/latency_max_us
+ */
+void *AI_OpenDeviceProfile(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, int profile)
+{
+    return PcmDeviceManager::instance()->openDevice(name, samplerate, channel_cnt, format, 20, profile);
+}
+
+/*
+ * 按声卡号和设备号打开，经plug层以便硬件不支持时自动转换格式
+ */
+void *AI_OpenDeviceIndex(int card, int device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "plughw:%d,%d", card, device);
+    return AI_OpenDevice(name, samplerate, channel_cnt, format, ptime);
+}
+
+void AI_CloseDevice(void *DevID)
+{
+    if (DevID)
+        PcmDeviceManager::instance()->closeDevice((PcmRecord *)DevID);
+}
+
+/*
+ * 同AI_EnableChnEx，在指定设备上创建通道
+ */
+void *AI_EnableDevChn(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine)
+{
+    return DevID ? ((PcmRecord *)DevID)->createChannel(samplerate, channel_cnt, format, engine) : NULL;
+}
+
+/*
+ * 创建按窗口读取的通道：AI_GetFrame每次返回frame_ms的数据，下一次从hop_ms之后开始，
+ * hop_ms小于frame_ms时相邻窗口重叠(如ASR的25ms窗10ms移)，hop_ms为0表示不重叠
+ * 窗口直接从库内的帧缓冲拼接，与设备周期无关；AI_BorrowFrame在窗口不跨周期时不拷贝
+ * info的seq为窗口起点所在的捕获周期，tstamp为窗口第一个采样的时间
+ */
+void *AI_EnableChnWindow(unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    unsigned int frame_ms, unsigned int hop_ms)
+{
+    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, format, engine, frame_ms, hop_ms);
+}
+
+void *AI_EnableDevChnWindow(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    unsigned int frame_ms, unsigned int hop_ms)
+{
+    return DevID ? ((PcmRecord *)DevID)->createChannel(samplerate, channel_cnt, format, engine, frame_ms, hop_ms) : NULL;
+}
+
+/*
+ * 创建按声道映射读取的通道，如从4麦克风阵列取平均得到单声道：
+ *     PcmChannelMap_t map;
+ *     pcm_chmap_default(&map, 4, 1);
+ *     AI_EnableDevChnMap(dev, 16000, PCM_FMT_S16, RESAMPLE_ENGINE_SRC, &map);
+ * 自动协商的设备按map->in_chan打开；同一映射的通道共用转换节点
+ */
+void *AI_EnableChnMap(unsigned int samplerate, int format, int engine, const PcmChannelMap_t *map)
+{
+    return map ? PcmRecord::instance()->createChannel(samplerate, map->out_chan, format, engine, 0, 0, map) : NULL;
+}
+
+void *AI_EnableDevChnMap(void *DevID, unsigned int samplerate, int format, int engine, const PcmChannelMap_t *map)
+{
+    return DevID && map ? ((PcmRecord *)DevID)->createChannel(samplerate, map->out_chan, format, engine, 0, 0, map) : NULL;
+}
+
+/*
+ * 创建带处理链的通道，如去直流、100Hz高通、自动增益到-20dBFS：
+ *     PcmDspConfig_t dsp;
+ *     pcm_dsp_parse(&dsp, "dc,hpf=100,agc=-20");
+ *     AI_EnableDevChnDsp(dev, 16000, 1, PCM_FMT_S16, RESAMPLE_ENGINE_SRC, &dsp);
+ * 处理在共享转换节点输出时完成，与int16/float转换合并为一遍；格式与捕获相同的通道也经过转换节点
+ */
+void *AI_EnableChnDsp(unsigned int samplerate, unsigned int channel_cnt, int format, int engine, const PcmDspConfig_t *dsp)
+{
+    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, format, engine, 0, 0, NULL, dsp);
+}
+
+void *AI_EnableDevChnDsp(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    const PcmDspConfig_t *dsp)
+{
+    return DevID ? ((PcmRecord *)DevID)->createChannel(samplerate, channel_cnt, format, engine, 0, 0, NULL, dsp) : NULL;
+}
+
+/*
+ * 创建编码输出的通道，如电话业务的8kHz单声道G.711 μ-law：
+ *     AI_EnableDevChnCodec(dev, 8000, 1, RESAMPLE_ENGINE_SRC, PCM_CODEC_ULAW);
+ * 每帧是一个周期编码后的数据(20ms为160字节)，ADPCM每帧是一个可单独解码的块，见pcm_adpcm_encode()；
+ * 已有同采样率的16bit节点时从它级联，只做编码
+ */
+void *AI_EnableChnCodec(unsigned int samplerate, unsigned int channel_cnt, int engine, int codec)
+{
+    return PcmRecord::instance()->createChannel(samplerate, channel_cnt, PCM_FMT_S16, engine, 0, 0, NULL, NULL, codec);
+}
+
+void *AI_EnableDevChnCodec(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int engine, int codec)
+{
+    return DevID ? ((PcmRecord *)DevID)->createChannel(samplerate, channel_cnt, PCM_FMT_S16, engine, 0, 0, NULL, NULL, codec)
+        : NULL;
+}
+
+int AI_GetDevNodeStats(void *DevID, PcmNodeStat_t *stats, int max)
+{
+    return DevID ? ((PcmRecord *)DevID)->getNodeStats(stats, max) : 0;
+}
+
+/*
+ * DevID为NULL时查询默认设备
+ * return：0成功，-1失败
+ */
+int AI_GetDevStats(void *DevID, PcmDeviceStat_t *stat)
+{
+    if (!stat)
+        return -1;
+    PcmRecord *dev = DevID ? (PcmRecord *)DevID : PcmRecord::instance();
+    dev->getStats(stat);
+    return 0;
+}
+
+int AI_GetChnStats(void *ChnID, PcmChannelStat_t *stat)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return (ch && stat && ch->device->getChannelStats(ChnID, stat)) ? 0 : -1;
+}
+
+/*
+ * interval_ms：每隔多久用LOG输出一次所有设备、通道和转换节点的统计，<=0关闭
+ * 也可用环境变量PCM_STATS_INTERVAL设置
+ */
+int AI_SetStatsInterval(int interval_ms)
+{
+    PcmDeviceManager::instance()->setStatsInterval(interval_ms);
+    return 0;
+}
+
+/*
+ * 开启/关闭设备的语音检测，DevID为NULL时为默认设备；cfg为NULL时用默认参数，见pcm_vad_default_config()
+ * 开启后每个周期的电平和检测结果在帧信息的peak/rms/vad中，设备的电平见AI_GetDevStats
+ */
+int AI_SetDevVad(void *DevID, int enable, const PcmVadConfig_t *cfg)
+{
+    PcmRecord *dev = DevID ? (PcmRecord *)DevID : PcmRecord::instance();
+    dev->setVad(enable != 0, cfg);
+    return 0;
 }
 
+/*
+ * 通道只读语音帧(含语音段结束的那一帧，vad带PCM_VAD_END)，静音时AI_GetFrame等待到超时，
+ * 消费者的CPU随静音比例下降；info->gap为这一帧之前跳过的静音周期数，>0表示与上一帧不连续
+ * 设备未开启语音检测时读到所有帧；按窗口读取的通道不支持，返回-1
+ */
+int AI_SetChnSpeechOnly(void *ChnID, int enable)
+{
+    PcmChannel_t *ch = (PcmChannel_t *)ChnID;
+    return (ch && ch->device->setChannelSpeechOnly(ChnID, enable != 0)) ? 0 : -1;
+}
+
+/*
+ * 设置捕获线程或DSP线程池的调度策略和CPU亲和性
+ * thread：PCM_THREAD_CAPTURE/PCM_THREAD_DSP；policy：SCHED_OTHER/SCHED_FIFO/SCHED_RR；priority：1~99
+ * cpus：CPU列表如"2"、"0,2"、"4-7"，NULL或""不绑定
+ * 也可用环境变量PCM_CAPTURE_SCHED、PCM_CAPTURE_CPUS、PCM_DSP_SCHED、PCM_DSP_CPUS设置
+ * return：全部生效返回0，参数错误或没有权限返回-1(没有权限时线程保持原来的调度)
+ */
+int AI_SetThreadSched(int thread, int policy, int priority, const char *cpus)
+{
+    PcmThreadSched_t sched;
+    pcm_sched_init(&sched);
+    if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)
+        return -1;
+    sched.policy = policy;
+    sched.priority = policy == SCHED_OTHER ? 0 : priority;
+    if (!pcm_sched_parse_cpus(cpus, &sched))
+        return -1;
+    return PcmDeviceManager::instance()->setThreadSched(thread, &sched) ? 0 : -1;
+}
 
+/*
+ * 锁定进程内存(mlockall)并关闭malloc归还内存，捕获线程和DSP线程预先访问栈
+ * 应在打开设备、创建通道之前调用，此后分配的缓冲都在锁定的内存中
+ * 也可用环境变量PCM_MLOCK=1设置；return：没有权限或超出RLIMIT_MEMLOCK返回-1
+ */
+int AI_LockMemory(void)
+{
+    return pcm_memory_lock() ? 0 : -1;
+}
@@ -13,296 +13,1063 @@
 #include <time.h>
 #include <sys/time.h>
 
-#include <queue>
 #include <vector>
 #include <string>
 
 #include <alsa/asoundlib.h>
 #include "mutex.h"
+#include "pcmring.h"
 #include "resampler.h"
+#include "dspworker.h"
+#include "pcmkernel.h"
+#include "pcmformat.h"
+#include "pcmsource.h"
+#include "pcmloop.h"
+#include "pcmsched.h"
+#include "pcmvad.h"
+#include "pcmdsp.h"
+#include "pcmcodec.h"
 
 using namespace std;
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// 一帧音/视频
-typedef struct PcmFrame_t
-{
-	PcmFrame_t()
-    {
-		size = 0;
-		data = NULL;
-	}
-	~PcmFrame_t()
-	{
-		//ReleaseFrame();
-	}
-	inline bool setFrame(const char *pdata, int sz)
-	{
-		this->data = new char[sz];
-		this->size = sz;
-		memcpy(this->data, pdata, sz);
-		return true;
-	}
-	inline void releaseFrame()
-	{
-		if (data)
-			delete []data;
-		data = NULL;
-		size = 0;
-	}
-	char *getData() {return data;}
-	int getSize() {return size;}
-
-	int size;
-	char *data;
-}PcmFrame_t;
-typedef std::queue<PcmFrame_t> PcmFrameQueue_t;
-
-typedef struct PcmFrameQueueOps_t
-{
-	Mutex lock;
-    Condition cond;
-	PcmFrameQueue_t frameQueue;
-	int queueDepth;
-
-	PcmFrameQueueOps_t()
-    {
-		queueDepth = 4;
-	}
-	~PcmFrameQueueOps_t() {}
-	void setQueueDepth(int depth)
-	{
-        MutexLockGuard mutexlockGuard(&lock);
-		if (depth > 0)
-            queueDepth = depth;
-	}
-	void clearFrame()
-	{
-		MutexLockGuard mutexlockGuard(&lock);
-		for (int i=0; i<frameQueue.size(); ++i)
-        {
-			PcmFrame_t stFrame = frameQueue.front();
-			stFrame.releaseFrame();
-			frameQueue.pop();
-		}
-	}
-    /* 需要调用frame.releaseFrame() */
-	bool getFrame(PcmFrame_t &frame, int timeout_ms)
-	{
-		MutexLockGuard mutexlockGuard(&lock);
-		if (frameQueue.size() == 0)
-        {
-			if (cond.timedWait(&lock, timeout_ms))
-			{
-                frame = frameQueue.front();
-                frameQueue.pop();
-                return true;
-            }
-			return false;
-		}
-
-		frame = frameQueue.front();
-		frameQueue.pop();
-		return true;
-	}
-	void putFrame(const char *pData, int dwSize)
-	{
-        MutexLockGuard mutexlockGuard(&lock);
-		PcmFrame_t stFrame;
-
-		if (stFrame.setFrame(pData, dwSize))
-			frameQueue.push(stFrame);
-
-		if (frameQueue.size() > queueDepth)
-        {
-			frameQueue.front().releaseFrame();
-			frameQueue.pop();
-		}
-        cond.signal();
-	}
-}PcmFrameQueueOps_t;
+#define PCM_PERIOD_MAX_BYTES 32768 // 48000Hz 8chn 32bit 20ms或16bit 40ms
+#define PCM_RECORD_RING_SLOTS 64 // 共享环形缓冲槽数(约1.28s)
+#define PCM_NODE_RING_SLOTS 16 // 转换节点输出的槽数，queueDepth不能超过它-1
+#define PCM_NODE_BATCH_MAX 8 // 积压时一次重采样处理的最多周期数
+#define PCM_PERIOD_SLACK 2 // 设备实际周期可能比请求的ptime长，转换节点的输出槽按ptime的这个倍数分配
+#define PCM_RECORD_DEFAULT_RATE 16000 // 自动协商的设备没有通道时的采样率
+#define PCM_RECONFIG_DELAY_MS 50 // 通道变化后延迟重新配置设备，合并短时间内的多次变化
 
 ///>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-// 注册音频结构
-typedef struct PcmChannel_t
+/*
+ * 共享转换节点：同一输出格式(采样率,声道数,采样格式)每个周期只转换一次，
+ * 结果写入节点自己的环形缓冲，供所有同格式的通道读取。
+ * 上游可以是捕获线程的缓冲，也可以是另一个节点(级联，如48k->16k->8k)。
+ * 可带处理链(去直流/高通/增益/AGC)，在转为输出格式的同一遍中完成，同一处理链的通道共用。
+ * 编码节点(G.711/ADPCM)先转为16bit到pcm_buf，再编码写入输出缓冲，缓冲中的每帧是编码后的一个周期。
+ * 转换默认由读取通道的线程按需驱动(pump)；开启DSP线程池后由捕获线程每周期投递给线程池，
+ * 读取线程只取结果。同一时刻只有一个线程在转换。
+ */
+typedef struct PcmConvertNode_t
 {
-    PcmChannel_t(unsigned int rate, unsigned int chan, unsigned char bits,
-        unsigned int orate, unsigned int ochan, unsigned char obits, unsigned int ptime)
+    PcmConvertNode_t(PcmFrameRing_t *src, PcmConvertNode_t *up, unsigned int rate, unsigned int chan, int fmt,
+        unsigned int orate, unsigned int ochan, int ofmt, unsigned int period, unsigned int ptime, int eng,
+        const PcmChannelMap_t *cmap = NULL, const PcmDspConfig_t *dsp_cfg = NULL, int cdc = PCM_CODEC_NONE)
     {
-        samplerate = rate; channel = chan; width = bits;
-        origin_samplerate = orate; origin_channel = ochan; origin_width = obits;
+        samplerate = rate; channel = chan; format = fmt;
+        mapped = (cmap != NULL);
+        if (cmap)
+            map = *cmap;
+        processed = (dsp_cfg != NULL);
+        if (dsp_cfg)
+            chain = *dsp_cfg;
+        codec = cdc;
+        source = src;
+        parent = up;
+        engine = eng;
         resampler = NULL;
+        refs = 1;
+        queued = 0;
+        async = false;
+        frames = 0;
+        runs = 0;
+        cpu_ns = 0;
+        bytes = 0;
+        conv_in = conv_out = NULL;
+        float_in = float_out = NULL;
+        mix_buf = NULL;
 
-        if (rate != orate)
+        reader.attach(source);
+        /* 输出槽按周期时长的PCM_PERIOD_SLACK倍分配，设备重新配置后实际周期有变化也放得下；
+         * 编码节点的槽按编码后的大小分配 */
+        int slot_frames = rate * ptime * PCM_PERIOD_SLACK / 1000 + 1;
+        pcm_buf = NULL;
+        pcm_bytes = 0;
+        if (codec)
         {
-            samples_per_frame = (orate / 1000 ) * ochan * ptime; // 16bit
-            resampler = new CResampleEx();
-            resampler->resample_create(true, false, ochan, orate, rate, samples_per_frame);
+            pcm_bytes = slot_frames * chan * pcm_format_bytes(fmt);
+            pcm_buf = new short[pcm_bytes / sizeof(short)];
+            out.create(PCM_NODE_RING_SLOTS, pcm_codec_bytes(codec, slot_frames, chan));
         }
+        else
+        {
+            out.create(PCM_NODE_RING_SLOTS, slot_frames * chan * pcm_format_bytes(fmt));
+        }
+        configure(orate, ochan, ofmt, period);
     }
 
-    ~PcmChannel_t()
+    ~PcmConvertNode_t()
+    {
+        reset();
+        delete []pcm_buf;
+    }
+
+    void reset(void)
     {
-        queue.clearFrame();
         if (resampler)
             delete resampler;
+        if (float_in)
+            delete []float_in;
+        if (float_out)
+            delete []float_out;
+        if (mix_buf)
+            delete []mix_buf;
+        resampler = NULL;
+        float_in = float_out = NULL;
+        mix_buf = NULL;
+        conv_in = conv_out = NULL;
+    }
+
+    /* 输出的声道映射是否与map相同，NULL表示默认映射 */
+    bool sameMap(const PcmChannelMap_t *cmap)
+    {
+        return cmap ? (mapped && pcm_chmap_equal(&map, cmap)) : !mapped;
+    }
+    /* 处理链是否与dsp_cfg相同，NULL表示不处理 */
+    bool sameDsp(const PcmDspConfig_t *dsp_cfg)
+    {
+        return dsp_cfg ? (processed && pcm_dsp_equal(&chain, dsp_cfg)) : !processed;
+    }
+    /* 输出是PCM(未编码、未经处理链)，可以作为其他节点的上游 */
+    bool plain(void)
+    {
+        return !processed && !codec;
     }
 
-    /* 单双声道互转
-     * in_size：in_ptr数据大小，单位字节
-     * out_size：out_ptr缓冲区大小，单位字节
+    /*
+     * 按上游格式和每周期的输入帧数(设备实际的周期，级联时为上游节点的输出帧数)建立转换。
+     * 设备重新配置时在原节点上重建，输出缓冲和通道的读游标不变；上游尚未转换的旧格式周期丢弃
      */
-    int operateMonoStereo(char *in_ptr, int in_size, char *out_ptr, int out_size)
+    void configure(unsigned int orate, unsigned int ochan, int ofmt, unsigned int period)
     {
-        if (channel == origin_channel) // 声道数相同，直接返回数据
+        MutexLockGuard mutexlockGuard(&lock);
+        reset();
+        origin_samplerate = orate; origin_channel = ochan; origin_format = ofmt;
+        in_frames = period;
+        samples_per_frame = 0;
+        batch = 1;
+        reader.clearFrame(source);
+
+        /*
+         * 源声道到本节点声道的映射：指定了映射的按指定的(捕获声道数与映射不符时退回默认映射)，
+         * 否则按pcm_chmap_default()；级联的下游节点输入已经是映射后的声道
+         */
+        PcmChannelMap_t route;
+        if (mapped && !parent && map.in_chan == ochan)
+            route = map;
+        else
+            pcm_chmap_default(&route, ochan, channel);
+
+        /* 单双声道之间按较少的声道数重采样。都是16bit时声道转换在重采样的int16/float转换中一并完成，
+         * 否则先转为float(同时转换声道)，重采样后再转为输出格式。
+         * 指定了映射或多于双声道时先混合为本节点的声道再重采样 */
+        bool s16 = (format == PCM_FMT_S16 && ofmt == PCM_FMT_S16);
+        bool premix = (mapped && !parent) || ochan > 2 || channel > 2;
+        unsigned int rchan = premix ? channel : (channel < ochan ? channel : ochan);
+        out_frames = in_frames; // 不重采样时帧数不变
+        dsp_chan = rchan;
+        if (processed)
+            dsp.configure(&chain, samplerate);
+        if (samplerate != orate)
         {
-            if (out_size >= in_size)
+            samples_per_frame = in_frames * rchan;
+            resampler = new CResampleEx();
+            /* 定点引擎只有16bit精度，高精度格式总是用libsamplerate */
+            resampler->resample_create(true, false, rchan, orate, samplerate, samples_per_frame,
+                s16 ? engine : RESAMPLE_ENGINE_SRC);
+            if (s16 && premix && !pcm_chmap_identity(&route))
+            {
+                map_in = route;
+                conv_in = pcm_mix_converter(ofmt, PCM_FMT_S16, &map_in);
+                mix_buf = new short[samples_per_frame];
+            }
+            else if (s16)
+            {
+                resampler->resample_set_mapping(ochan, channel);
+            }
+            if (s16)
+            {
+                if (processed)
+                    resampler->resample_set_dsp(&dsp);
+            }
+            else
             {
-                memcpy(out_ptr, in_ptr, in_size);
-                return in_size;
+                if (premix)
+                    map_in = route;
+                else
+                    pcm_chmap_default(&map_in, ochan, rchan);
+                pcm_chmap_default(&map_out, rchan, channel);
+                conv_in = pcm_mix_converter(ofmt, PCM_FMT_FLOAT, &map_in);
+                conv_out = pcm_mix_converter(PCM_FMT_FLOAT, format, &map_out);
+                float_in = new float[samples_per_frame];
+                float_out = new float[resampler->resample_get_output_size()];
             }
-            return -1; // 缓冲区不够
+            out_frames = resampler->resample_get_output_size() / (s16 ? channel : rchan);
+            batch = resampler->resample_set_batch(PCM_NODE_BATCH_MAX);
         }
-        else // 声道数不同
+        else if (processed)
         {
-            if (origin_channel == 1 && channel == 2) // 单声道转双声道
-            {
-                short *ptr = (short *)in_ptr;
-                char *tmp = new char[in_size<<1];
-                short *ptr1 = (short *)tmp;
+            /* 不重采样时先转为float(同时转换声道)，处理链与转为输出格式一遍完成 */
+            map_in = route;
+            pcm_chmap_default(&map_out, channel, channel);
+            dsp_chan = channel;
+            conv_in = pcm_mix_converter(ofmt, PCM_FMT_FLOAT, &map_in);
+            conv_out = pcm_mix_converter(PCM_FMT_FLOAT, format, &map_out);
+            float_out = new float[targetBytes() / pcm_format_bytes(format)]; // 编码节点的out是编码后的大小
+        }
+        else
+        {
+            map_in = route;
+            conv_in = pcm_mix_converter(ofmt, format, &map_in);
+        }
+        if (codec)
+            encoder.configure(codec, channel); // 重新开始编码，ADPCM从初始状态开始
+    }
 
-                for (int i = 0; i < in_size>>1; i++)
-                {
-                    ptr1[2*i] = ptr1[2*i+1] = ptr[i];
-                }
+    /* 转换结果写入的缓冲：编码节点先写到pcm_buf */
+    char *target(void)
+    {
+        return codec ? (char *)pcm_buf : out.beginFrame();
+    }
+    int targetBytes(void)
+    {
+        return codec ? pcm_bytes : out.slotBytes();
+    }
 
-                if (out_size >= (in_size<<1))
-                {
-                    memcpy(out_ptr, ptr1, (in_size<<1));
-                    delete []tmp;
-                    return (in_size<<1);
-                }
+    /* size：target()中转换结果的字节数；编码节点在这里编码写入out。return：out中这一帧的字节数 */
+    int emit(int size)
+    {
+        if (codec && size > 0)
+            size = encoder.encode(pcm_buf, size / (channel * sizeof(short)), (unsigned char *)out.beginFrame());
+        return size;
+    }
 
-                delete []tmp;
-                return -1; // 缓冲区不够
-            }
-            else if (origin_channel == 2 && channel == 1) // 双声道转单声道
-            {
-                short *ptr = (short *)in_ptr;
-                short *ptr1 = (short *)out_ptr;
+    /*
+     * float结果(chan声道)经处理链后转为输出格式：16bit和float输出直接由处理链写出，
+     * 其他格式或需要上混时处理链就地处理后再转换，数据都还在缓存中
+     */
+    void finish(float *data, char *out_ptr, int frames)
+    {
+        if (processed && dsp_chan == channel && format == PCM_FMT_S16)
+            dsp.runToS16(data, (short *)out_ptr, frames, channel);
+        else if (processed && dsp_chan == channel && format == PCM_FMT_FLOAT)
+            dsp.run(data, (float *)out_ptr, frames, channel);
+        else
+        {
+            if (processed)
+                dsp.run(data, data, frames, dsp_chan);
+            conv_out(data, out_ptr, frames, &map_out);
+        }
+    }
 
-                if (out_size >= (in_size>>1))
-                {
-                    for(int n = 0; n < in_size>>2; n++)
-                    {
-                        *ptr1++ = *ptr++;
-                        ptr++;
-                    }
-                    return (in_size>>2);
-                }
+    /* 把一个上游周期转换为本节点格式，一遍写入out */
+    int convert(const char *in_ptr, int in_size, char *out_ptr, int out_size)
+    {
+        if (!resampler)
+        {
+            int nframes = in_size / (origin_channel * pcm_format_bytes(origin_format));
+            int size = nframes * channel * pcm_format_bytes(format);
+            if (out_size < size)
                 return -1;
+            if (!processed)
+            {
+                conv_in(in_ptr, out_ptr, nframes, &map_in);
+                return size;
             }
+            conv_in(in_ptr, float_out, nframes, &map_in);
+            finish(float_out, out_ptr, nframes);
+            return size;
+        }
 
-            return 0; // 其他声道不支持
+        int real_size = out_frames * channel * pcm_format_bytes(format); // 单位字节
+        if (out_size < real_size || in_size < in_frames * (int)origin_channel * pcm_format_bytes(origin_format))
+            return -1; // 读取不足一个周期时丢弃
+        if (!float_in)
+        {
+            resampler->resample_run(mixS16(in_ptr), (short *)out_ptr);
+            return real_size;
         }
+        conv_in(in_ptr, float_in, in_frames, &map_in);
+        resampler->resample_run_float(float_in, float_out);
+        finish(float_out, out_ptr, out_frames);
+        return real_size;
     }
 
-    int getData(char *buf, int len, int timeout_ms)
+    /* 16bit重采样的输入，需要先混合声道时混合到mix_buf */
+    const short *mixS16(const char *in_ptr)
     {
-        PcmFrame_t frame;
-        bool res = queue.getFrame(frame, timeout_ms); /* 获取一帧原始数据 */
-        if (res)
-        {
-            char *pdata = frame.getData();
-            int size = frame.getSize();
-            int ret = 0;
+        if (!conv_in)
+            return (const short *)in_ptr;
+        conv_in(in_ptr, mix_buf, in_frames, &map_in);
+        return mix_buf;
+    }
+
+    /*
+     * 批量重采样：最多batch个积压的周期装入重采样器，一次处理后逐个写入out
+     * runs：累加重采样的调用次数；written：累加写入out的字节数
+     * return：写入的周期数
+     */
+    unsigned long long convertBatch(const char *pdata, int size, unsigned long long *runs, unsigned long long *written)
+    {
+        int in_size = in_frames * origin_channel * pcm_format_bytes(origin_format);
+        int real_size = out_frames * channel * pcm_format_bytes(format);
+        unsigned long long n = 0;
+        PcmFrameInfo_t info[PCM_NODE_BATCH_MAX];
+        if (targetBytes() < real_size)
+            return 0;
 
-            if (samplerate == origin_samplerate) // 采样率相同
+        while (pdata)
+        {
+            int count = 0;
+            while (pdata && count < batch)
             {
-                ret = operateMonoStereo(pdata, size, buf, len);
+                bool whole = (size >= in_size); // 读取不足一个周期时丢弃
+                if (whole && !float_in)
+                    resampler->resample_load(count, mixS16(pdata));
+                else if (whole)
+                    conv_in(pdata, resampler->resample_batch_input(count), in_frames, &map_in);
+                source->frameInfo(reader.seq, &info[count]);
+                if (reader.doneFrame(source) && whole) // 装入期间源帧被覆盖则丢弃
+                    count++;
+                pdata = reader.nextFrame(source, &size, 0);
             }
-            else // 采样率不相同，需要重采样
+
+            resampler->resample_run_batch(count);
+            *runs += (count > 0);
+            for (int i = 0; i < count; i++, n++)
             {
-                unsigned int osize = resampler->resample_get_output_size(); // 重采样后的采样点数
-                int real_size = osize << 1; // 单位字节
-                short *out_ptr = new short[osize];
+                char *out_ptr = target();
+                if (!float_in)
+                    resampler->resample_fetch(i, (short *)out_ptr);
+                else
+                    finish(resampler->resample_batch_output(i), out_ptr, out_frames);
+                int size = emit(real_size);
+                out.commitFrame(size, &info[i]);
+                *written += size;
+            }
+        }
+        return n;
+    }
 
-                resampler->resample_run((short *)pdata, out_ptr);
-                ret = operateMonoStereo((char *)out_ptr, real_size, buf, len);
-                delete []out_ptr;
+    /* 转换上游所有未处理的周期，任意读取线程都可以调用 */
+    void pump(void)
+    {
+        if (parent)
+            parent->pump();
+
+        MutexLockGuard mutexlockGuard(&lock);
+        int size = 0;
+        const char *pdata = reader.nextFrame(source, &size, 0);
+        if (!pdata)
+            return;
+
+        struct timespec t0, t1;
+        unsigned long long n = 0, r = 0, w = 0;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+        if (resampler && batch > 1)
+            n = convertBatch(pdata, size, &r, &w);
+        else
+        {
+            while (pdata)
+            {
+                PcmFrameInfo_t info;
+                int ret = convert(pdata, size, target(), targetBytes());
+                source->frameInfo(reader.seq, &info);
+                r += (resampler != NULL);
+                if (reader.doneFrame(source) && ret > 0) // 转换期间源帧被覆盖则丢弃，编码状态不前进
+                {
+                    ret = emit(ret);
+                    out.commitFrame(ret, &info);
+                    w += ret;
+                    n++;
+                }
+                pdata = reader.nextFrame(source, &size, 0);
             }
-            frame.releaseFrame();
-            return ret;
         }
-        return 0;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+        __atomic_add_fetch(&frames, n, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&runs, r, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bytes, w, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&cpu_ns, (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec, __ATOMIC_RELAXED);
+    }
+
+    /* 等待捕获线程写入新的周期 */
+    bool waitSource(int timeout_ms)
+    {
+        PcmConvertNode_t *root = this;
+        while (root->parent)
+            root = root->parent;
+        return root->source->waitFrame(__atomic_load_n(&root->reader.seq, __ATOMIC_RELAXED), timeout_ms);
+    }
+
+    void setQueueDepth(int depth)
+    {
+        if (parent)
+            parent->setQueueDepth(depth);
+
+        MutexLockGuard mutexlockGuard(&lock);
+        if (depth > reader.depth)
+            reader.setQueueDepth(source, depth);
     }
 
     unsigned int samplerate;
     unsigned int channel;
-    unsigned char width; // 位宽，当前仅支持16bit
+    int format; // PCM_FMT_*
+    bool mapped; // 按map映射捕获声道，否则按默认映射
+    PcmChannelMap_t map;
+    bool processed; // 输出经过处理链chain
+    PcmDspConfig_t chain;
+    int codec; // 输出编码PCM_CODEC_*，编码节点的format为编码前的PCM_FMT_S16
 
     unsigned int origin_samplerate;
     unsigned int origin_channel;
-    unsigned char origin_width; // 位宽，当前仅支持16bit
-    int samples_per_frame;
+    int origin_format;
+    int samples_per_frame; // 每周期重采样的输入点数
+    int in_frames; // 每周期的输入帧数
+    int out_frames; // 每周期输出的帧数
+    int batch; // 一次重采样的最多周期数，定点引擎为1
 
-    PcmFrameQueueOps_t queue;
+    PcmFrameRing_t *source; // 上游缓冲
+    PcmRingReader_t reader; // 上游读游标
+    PcmConvertNode_t *parent; // 上游节点，直接读捕获缓冲时为NULL
+    PcmFrameRing_t out; // 转换结果
+    Mutex lock;
     CResampleEx *resampler; // 重采样
+    PcmMixConvFunc conv_in; // 不重采样时直接转为输出格式，重采样时转为float，16bit重采样时只混合声道
+    PcmMixConvFunc conv_out; // 重采样后float转为输出格式
+    PcmChannelMap_t map_in, map_out; // conv_in/conv_out的声道映射
+    float *float_in, *float_out; // 非16bit重采样的中间缓冲
+    short *mix_buf; // 16bit重采样前混合声道的缓冲
+    PcmDsp dsp; // 处理链状态，由转换线程独占
+    unsigned int dsp_chan; // 处理链处理的声道数，单声道重采样后上混时为1
+    PcmEncoder encoder; // 编码状态，由转换线程独占
+    short *pcm_buf; // 编码节点编码前的一个周期
+    int pcm_bytes; // pcm_buf的字节数
+    int engine; // 请求的重采样引擎RESAMPLE_ENGINE_*，不同引擎的通道不共用节点
+    int refs; // 引用的通道及下游节点数，由PcmRecord::m_mutex保护
+    int queued; // 已投递给线程池尚未执行
+    bool async; // 由DSP线程池转换
+
+    unsigned long long frames; // 已转换周期数
+    unsigned long long runs; // 重采样调用次数，批量处理算一次
+    unsigned long long cpu_ns; // 转换累计耗费的CPU时间
+    unsigned long long bytes; // 已写入out的字节数，编码节点为编码后的字节数
+}PcmConvertNode_t;
+typedef std::vector<PcmConvertNode_t *>PcmConvertNodeVec;
+
+/*
+ * 借出的一帧：直接指向库内的帧缓冲，只读，不拷贝
+ * 缓冲循环使用，须在环形缓冲转一圈之前归还，归还时检查期间是否被覆盖
+ */
+typedef struct PcmFrameView_t
+{
+    const char *data;
+    int size; // 单位字节
+    unsigned long long seq; // 帧在所读缓冲中的序号，归还时使用
+    PcmFrameInfo_t info; // 捕获周期序号、捕获时间和语音检测结果
+}PcmFrameView_t;
+
+class PcmRecord;
+// 注册音频结构
+typedef struct PcmChannel_t
+{
+    PcmChannel_t(PcmRecord *dev, PcmFrameRing_t *source, int *retire_flag, PcmConvertNode_t *conv, unsigned int rate, unsigned int chan, int fmt, int eng,
+        const PcmChannelMap_t *cmap = NULL, const PcmDspConfig_t *dsp_cfg = NULL, int cdc = PCM_CODEC_NONE)
+    {
+        samplerate = rate; channel = chan; format = fmt;
+        engine = eng;
+        mapped = (cmap != NULL);
+        if (cmap)
+            map = *cmap;
+        processed = (dsp_cfg != NULL);
+        if (dsp_cfg)
+            chain = *dsp_cfg;
+        codec = cdc;
+        device = dev;
+        capture = source;
+        retire_mark = retire_flag;
+        node = conv;
+        depth = reader.depth;
+        switching = false;
+        next_node = retired = NULL;
+        next_ring = NULL;
+        next_seq = 0;
+        borrowed = false;
+        borrow_ring = NULL;
+        borrow_offset = 0;
+        window = hop = 0;
+        window_buf = NULL;
+        latency_sum = latency_count = latency_max = 0;
+
+        /* 与捕获格式相同的通道直接读捕获缓冲，否则读共享转换节点的输出，各自只持有读游标 */
+        ring = node ? &node->out : capture;
+        reader.attach(ring);
+    }
+
+    ~PcmChannel_t()
+    {
+        delete []window_buf;
+    }
+
+    /*
+     * 按窗口读取：每次取window_frames帧，下一次从hop_frames帧之后开始，与设备周期无关
+     * 创建后、开始读取前调用
+     */
+    void setWindow(unsigned int window_frames, unsigned int hop_frames)
+    {
+        int frame_bytes = channel * pcm_format_bytes(format);
+        window = window_frames * frame_bytes;
+        hop = hop_frames * frame_bytes;
+        window_buf = new char[window];
+    }
+
+    /* 统计捕获到读出的延迟，读取线程调用 */
+    void noteLatency(const PcmFrameInfo_t *info)
+    {
+        if (!info->tstamp)
+            return;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long latency = now.tv_sec * 1000000000LL + now.tv_nsec - info->tstamp;
+        if (latency < 0)
+            return;
+        pcm_stat_add(&latency_sum, latency);
+        pcm_stat_add(&latency_count, 1);
+        pcm_stat_max(&latency_max, latency);
+    }
+
+    /* 窗口起点不在槽首时，捕获时间按槽内偏移推算 */
+    void windowInfo(PcmFrameInfo_t *info, int start)
+    {
+        if (info && info->tstamp && start > 0)
+            info->tstamp += (long long)(start / (channel * pcm_format_bytes(format))) * 1000000000LL / samplerate;
+    }
+
+    /* 只读语音帧，按窗口读取的通道不支持(窗口会跨过跳过的静音) */
+    bool setSpeechOnly(bool enable)
+    {
+        MutexLockGuard mutexlockGuard(&lock);
+        if (enable && window > 0)
+            return false;
+        reader.speech_only = enable;
+        reader.gap = 0;
+        return true;
+    }
+
+    void setQueueDepth(int qdepth)
+    {
+        MutexLockGuard mutexlockGuard(&lock);
+        __atomic_store_n(&depth, qdepth, __ATOMIC_RELAXED);
+        reader.setQueueDepth(ring, depth);
+        if (node)
+            node->setQueueDepth(depth);
+    }
+
+    /*
+     * 设备重新配置后改为读next(NULL表示直接读捕获缓冲)，调用者持有lock。
+     * 当前缓冲里重新配置之前的帧读完后才切换，所以切换不丢帧
+     */
+    void beginSwitch(PcmConvertNode_t *next)
+    {
+        next_node = next;
+        next_ring = next ? &next->out : capture;
+        next_seq = next_ring->head();
+        switching = true;
+        __atomic_store_n(&reader.end, ring->head(), __ATOMIC_RELEASE);
+        applySwitch(false);
+    }
+
+    /* force：旧帧没读完也切换，未读的旧帧计入丢弃；原来的节点放到retired并置位retire_mark，由设备在持有m_mutex时释放 */
+    void applySwitch(bool force)
+    {
+        if (!switching || (!force && reader.seq < reader.end))
+            return;
+        if (reader.end > reader.seq && reader.end != PCM_RING_SEQ_BUSY)
+            pcm_stat_add(&reader.dropped, reader.end - reader.seq);
+        if (node)
+        {
+            __atomic_store_n(&retired, node, __ATOMIC_RELEASE);
+            __atomic_store_n(retire_mark, 1, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&node, next_node, __ATOMIC_RELAXED); // 统计查询不持有lock
+        ring = next_ring;
+        reader.seq = next_seq;
+        reader.offset = 0; // 跨切换点的窗口不拼接
+        __atomic_store_n(&reader.end, PCM_RING_SEQ_BUSY, __ATOMIC_RELEASE);
+        reader.depth = depth;
+        reader.setQueueDepth(ring, depth);
+        if (node)
+            node->setQueueDepth(depth);
+        next_node = NULL;
+        switching = false;
+    }
+
+    /* 拷贝接口，等同借出后拷贝再归还 */
+    int getData(char *buf, int len, int timeout_ms, PcmFrameInfo_t *info = NULL)
+    {
+        return getFrames(buf, len, 1, timeout_ms, NULL, info);
+    }
+
+    /* 读取前完成待定的切换，拉取模式下转换积压的周期，调用者持有lock；return：拉取模式的节点 */
+    PcmConvertNode_t *prepareRead(void)
+    {
+        applySwitch(false);
+        if (!node || __atomic_load_n(&node->async, __ATOMIC_ACQUIRE))
+            return NULL;
+        node->pump();
+        return node;
+    }
+
+    /* 不持有lock等待新数据，设备重新配置时不会被读取线程阻塞 */
+    static bool waitData(long long deadline, PcmConvertNode_t *pull, PcmFrameRing_t *wait_ring, unsigned long long wait_seq)
+    {
+        long long remain = deadline - pcm_now_ms();
+        if (remain <= 0)
+            return false;
+        return pull ? pull->waitSource((int)remain) : wait_ring->waitFrame(wait_seq, (int)remain);
+    }
+
+    /* 一次取出积压的多个周期，转换节点只pump一次，积压的周期批量重采样 */
+    int getFrames(char *buf, int len, int max_frames, int timeout_ms, int *count, PcmFrameInfo_t *info = NULL)
+    {
+        PcmFrameInfo_t first;
+        long long deadline = pcm_now_ms() + timeout_ms;
+        if (!info)
+            info = &first;
+        while (true)
+        {
+            PcmConvertNode_t *pull = NULL;
+            PcmFrameRing_t *wait_ring = NULL;
+            unsigned long long wait_seq = 0;
+            {
+                MutexLockGuard mutexlockGuard(&lock);
+                pull = prepareRead();
+                int ret, start = 0;
+                if (window > 0)
+                {
+                    ret = reader.getWindows(ring, buf, len, max_frames, window, hop, count, info, &start);
+                    if (ret > 0)
+                        windowInfo(info, start);
+                }
+                else
+                {
+                    ret = reader.getFrames(ring, buf, len, max_frames, 0, count, info);
+                }
+                if (ret > 0)
+                    noteLatency(info);
+                if (ret != 0)
+                    return ret;
+                if (switching && reader.seq >= reader.end)
+                    continue; // 旧缓冲已读完，立即切换
+                wait_ring = ring;
+                wait_seq = window > 0 ? ring->head() : reader.seq; // 窗口可能还差后面的槽
+            }
+
+            if (!waitData(deadline, pull, wait_ring, wait_seq))
+                return 0; // count已由getFrames()置0
+        }
+    }
+
+    /*
+     * 借出下一帧，不拷贝，用完调用releaseFrame()；借出期间不能再借
+     * return：帧长度，超时返回0，上一帧未归还返回-1
+     */
+    int borrowFrame(PcmFrameView_t *view, int timeout_ms)
+    {
+        long long deadline = pcm_now_ms() + timeout_ms;
+        while (true)
+        {
+            PcmConvertNode_t *pull = NULL;
+            PcmFrameRing_t *wait_ring = NULL;
+            unsigned long long wait_seq = 0;
+            {
+                MutexLockGuard mutexlockGuard(&lock);
+                if (borrowed)
+                    return -1;
+                pull = prepareRead();
+                int size = 0, start = 0;
+                const char *pdata;
+                if (window > 0)
+                {
+                    pdata = reader.nextWindow(ring, window, hop, window_buf, &view->info, &start);
+                    size = window;
+                    windowInfo(&view->info, start);
+                }
+                else
+                {
+                    pdata = reader.nextFrame(ring, &size, 0);
+                    if (pdata)
+                        reader.frameInfo(ring, &view->info);
+                }
+                if (pdata)
+                {
+                    view->data = pdata;
+                    view->size = size;
+                    view->seq = reader.seq;
+                    borrow_ring = ring;
+                    borrow_offset = reader.offset;
+                    borrowed = true;
+                    noteLatency(&view->info);
+                    return size;
+                }
+                if (switching && reader.seq >= reader.end)
+                    continue;
+                wait_ring = ring;
+                wait_seq = window > 0 ? ring->head() : reader.seq;
+            }
+
+            if (!waitData(deadline, pull, wait_ring, wait_seq))
+                return 0;
+        }
+    }
+
+    /* return：借出期间数据未被覆盖返回true，false表示这帧数据无效，应丢弃处理结果 */
+    bool releaseFrame(const PcmFrameView_t *view)
+    {
+        MutexLockGuard mutexlockGuard(&lock);
+        if (!borrowed)
+            return false;
+        borrowed = false;
+        /* 跨槽的窗口在借出时已拼接到window_buf并校验过 */
+        bool valid = (window > 0 && view->data == window_buf) || borrow_ring->checkFrame(view->seq);
+        bool current = borrow_ring == ring && reader.seq == view->seq && reader.offset == borrow_offset; // 借出期间没有切换缓冲
+        if (current && window > 0)
+            reader.doneWindow(ring, hop, valid);
+        else if (current)
+            reader.doneFrame(ring);
+        else if (!valid)
+            pcm_stat_add(&reader.dropped, 1);
+        return valid;
+    }
+
+    unsigned int samplerate;
+    unsigned int channel;
+    int format; // PCM_FMT_*
+    int engine; // 需要转换时使用的重采样引擎
+    bool mapped; // 按map从捕获声道中选取/混合，否则按默认映射
+    PcmChannelMap_t map;
+    bool processed; // 读取经过处理链chain的数据，总是读转换节点
+    PcmDspConfig_t chain;
+    int codec; // 读取编码后的数据PCM_CODEC_*，总是读转换节点，每帧是一个周期
+
+    PcmRecord *device; // 所属的捕获设备
+    PcmFrameRing_t *capture; // 设备的捕获缓冲
+    PcmConvertNode_t *node; // 共享转换节点，格式与捕获相同时为NULL
+    PcmFrameRing_t *ring; // 读取的帧缓冲
+    PcmRingReader_t reader; // 本通道的读游标
+    int depth; // 请求的队列深度
+    Mutex lock; // 读取线程与设备重新配置之间互斥，等待数据时不持有
+
+    bool switching; // 等待切换到next_ring
+    PcmConvertNode_t *next_node;
+    PcmFrameRing_t *next_ring;
+    unsigned long long next_seq; // 切换后从next_ring的这个序号开始读
+    PcmConvertNode_t *retired; // 切换后不再使用、尚未释放的节点
+    int *retire_mark; // 设备的待释放标志，放入retired后置1
+
+    bool borrowed; // 有借出未归还的帧
+    PcmFrameRing_t *borrow_ring; // 借出帧所在的缓冲
+    int borrow_offset; // 借出窗口的起点在槽内的偏移
+
+    /* 捕获到读出的延迟统计，单位ns，只由读取线程写 */
+    unsigned long long latency_sum;
+    unsigned long long latency_count;
+    unsigned long long latency_max;
+
+    int window; // 按窗口读取时每个窗口的字节数，0表示按设备周期读取
+    int hop; // 相邻窗口起点的间隔，单位字节，不大于window
+    char *window_buf; // 借出跨槽的窗口时在这里拼接
 }PcmChannel_t;
 typedef std::vector<PcmChannel_t *>PcmChannelVec;
 
 
-/* 录音得到PCM数据 */
-class PcmRecord
+/* 转换节点统计 */
+typedef struct PcmNodeStat_t
+{
+    unsigned int samplerate;
+    unsigned int channel;
+    int format; // PCM_FMT_*
+    unsigned int source_samplerate; // 输入采样率，级联时为上游节点的输出采样率
+    unsigned int source_channel; // 输入声道数
+    int mapped; // 1：按指定的声道映射转换
+    int dsp; // 1：输出经过处理链
+    float agc_gain_db; // 处理链当前的自动增益
+    unsigned long long clipped; // 处理链饱和的样本数
+    int codec; // 输出编码PCM_CODEC_*
+    int engine; // 实际使用的重采样引擎RESAMPLE_ENGINE_*，不重采样时为-1
+    int users; // 引用的通道及下游节点数
+    unsigned long long frames; // 已转换周期数
+    unsigned long long runs; // 重采样调用次数，cpu_ns/runs即每次重采样的耗时
+    unsigned long long cpu_ns; // 累计CPU时间，单位ns
+    unsigned long long bytes; // 已输出的字节数，编码节点为编码后的字节数
+}PcmNodeStat_t;
+
+/* 通道统计 */
+typedef struct PcmChannelStat_t
+{
+    unsigned int samplerate;
+    unsigned int channel;
+    int format; // PCM_FMT_*
+    int mapped; // 1：指定了声道映射
+    int dsp; // 1：带处理链
+    int codec; // 输出编码PCM_CODEC_*
+    int speech_only; // 1：只读语音帧
+    int direct; // 1：直接读捕获缓冲，0：读转换节点
+    int queue_depth; // 队列深度，积压超过时丢弃最旧的帧
+    unsigned int window_frames; // 每次读取的帧数(每声道样本数)，0表示按设备周期
+    unsigned int hop_frames; // 相邻两次读取起点的间隔
+    unsigned long long high_water; // 读取时观察到的最大积压帧数
+    unsigned long long served; // 已读取的帧数
+    unsigned long long dropped; // 因积压或被覆盖丢弃的帧数
+    unsigned long long skipped; // 只读语音时跳过的静音帧数
+    unsigned long long latency_avg_us; // 帧的第一个采样被捕获到读取返回的平均时间
+    unsigned long long latency_max_us;
+}PcmChannelStat_t;
+
+/* 捕获设备统计 */
+typedef struct PcmDeviceStat_t
+{
+    char name[64];
+    unsigned int samplerate; // 当前捕获参数
+    unsigned int channel;
+    int format; // PCM_FMT_*
+    int opened; // 1：正在捕获
+    int ended; // 1：回放的文件已读完
+    int channels; // 通道数
+    int nodes; // 转换节点数
+    unsigned long long periods; // 已读取的周期数
+    unsigned long long xruns; // 溢出次数
+    unsigned long long short_reads; // 不足一个周期的读取次数
+    unsigned long long read_errors; // 读取失败次数
+    unsigned long long reopens; // 断开或重新配置后重新打开的次数
+    unsigned long long open_failures; // 打开失败次数
+    int sched_policy; // 捕获线程实际的调度策略SCHED_*，设置实时调度失败时为SCHED_OTHER
+    int sched_priority;
+    int memory_locked; // 1：进程内存已锁定
+    int vad; // 1：开启了语音检测，以下电平和检测统计只在开启时有效
+    float peak_db; // 最近一个周期的峰值，dBFS
+    float rms_db; // 最近一个周期的均方根电平，dBFS
+    float noise_db; // 噪声底估计
+    int speech; // 1：当前处于语音段
+    unsigned long long speech_periods; // 判为语音(含拖尾)的周期数
+    unsigned long long silence_periods;
+    unsigned long long segments; // 语音段数
+}PcmDeviceStat_t;
+
+/* 一个捕获设备录音得到PCM数据，每个设备有自己的通道和转换节点 */
+class PcmRecord : public PcmLoopHandler
 {
 public:
+    /* loop：捕获线程，多个设备可共用；name：ALSA PCM名称，如"default"、"plughw:1,0"，
+     * 或回放文件/信号发生器，如"replay:a.wav,fast"、"tone:440"，见pcm_source_create() */
+    PcmRecord(PcmEventLoop *loop, const char *name);
     ~PcmRecord();
-    static PcmRecord *instance()
+    /* 默认设备"default"，第一次使用时打开 */
+    static PcmRecord *instance();
+
+    /*
+     * samplerate/channel_cnt为0时按硬件原生能力和通道需求自动选择，通道变化时重新配置设备
+     * profile：PCM_PROFILE_*，周期、ALSA缓冲和唤醒阈值、通道队列深度，配置了周期时忽略ptime
+     */
+    bool start(unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int profile = PCM_PROFILE_DEFAULT);
+	void stop(void);
+    /* 不打开捕获设备，由调用者用pushFrame()写入数据，用于基准测试和离线处理，不能与start()同时使用 */
+    void startExternal(unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime);
+    void pushFrame(const char *data, int size, long long tstamp = 0);
+    const char *name(void) {return m_name.c_str();}
+    bool matches(unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int profile = PCM_PROFILE_DEFAULT)
     {
-        return &m_instance; // 饿汉
+        const PcmCaptureProfile_t *p = pcm_capture_profile(profile);
+        return samplerate == m_fixedRate && channel_cnt == m_fixedChannel && format == m_format && p == m_profile &&
+            (p->ptime ? p->ptime : ptime) == m_ptime;
     }
 
-    void *createChannel(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits);
+    /* frame_ms：每次读取的时长，0表示按设备周期；hop_ms：相邻两次读取起点的间隔，0表示等于frame_ms，不能大于frame_ms；
+     * map：从捕获声道选取/混合出channel_cnt个声道，map->in_chan为需要的捕获声道数，NULL表示默认映射；
+     * dsp：处理链，NULL表示不处理；codec：输出编码PCM_CODEC_*，format须为PCM_FMT_S16 */
+    void *createChannel(unsigned int samplerate, unsigned int channel_cnt, int format, int engine = RESAMPLE_ENGINE_SRC,
+        unsigned int frame_ms = 0, unsigned int hop_ms = 0, const PcmChannelMap_t *map = NULL, const PcmDspConfig_t *dsp = NULL,
+        int codec = PCM_CODEC_NONE);
     void destroyChannel(void *channel);
-    int readChannel(void *channel, char *buffer, int buflen, int timeout_ms);
+    int readChannel(void *channel, char *buffer, int buflen, int timeout_ms, PcmFrameInfo_t *info = NULL);
+    int readChannelFrames(void *channel, char *buffer, int buflen, int max_frames, int timeout_ms, int *frames,
+        PcmFrameInfo_t *info = NULL);
+    int borrowFrame(void *channel, PcmFrameView_t *view, int timeout_ms);
+    bool releaseFrame(void *channel, const PcmFrameView_t *view);
+    int getNodeStats(PcmNodeStat_t *stats, int max);
+    void getStats(PcmDeviceStat_t *stat);
+    bool getChannelStats(void *channel, PcmChannelStat_t *stat);
+    /* 每interval_ms输出一次统计快照，<=0关闭 */
+    void setStatsInterval(int interval_ms);
+    /* 设置转换节点使用的DSP线程池，NULL表示由读取线程转换；线程池由PcmDeviceManager持有 */
+    void setDspPool(DspWorkerPool *pool);
+    /* 开启/关闭捕获端语音检测，cfg为NULL时用默认参数；在捕获线程读取下一个周期时生效 */
+    void setVad(bool enable, const PcmVadConfig_t *cfg);
+    bool setChannelSpeechOnly(void *channel, bool enable);
 
 private:
-	PcmRecord();
-    void feedChannel(const char *buffer, int len);
     void clearChannel(void);
+    PcmConvertNode_t *acquireNode(unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+        const PcmChannelMap_t *map, const PcmDspConfig_t *dsp, int codec);
+    void releaseNode(PcmConvertNode_t *node);
+    void dispatchNodes(void);
+    static void NodeTaskStub(void *obj, void *arg);
+    void releaseChannel(PcmChannel_t *ch);
+    void scheduleReconfig(void);
+    void negotiate(unsigned int *samplerate, unsigned int *channel_cnt);
+    void setFormat(unsigned int samplerate, unsigned int channel_cnt);
+    void rebuildNodes(void);
+    void dumpStats(void);
+    int sourceRoom(void);
+    void consumed(void) {if (m_source->unpaced()) m_source->notify();}
+    PcmVad *captureVad(void);
 
-    bool start(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits, unsigned int ptime);
-	void stop(void);
-
-	bool open(unsigned int samplerate, unsigned int channel_cnt, unsigned char bits, unsigned int ptime);
-	void close(void);
-    int read(char *buf, int buflen);
-
-	static void *PcmRecordThreadStub(void *param);
-    void PcmRecordThread(void);
+    /* 事件循环回调：poll到数据后读取，设备打开失败或断开后按退避时间重新打开 */
+    int getPollFds(struct pollfd *pfds, int space);
+    bool handleEvents(struct pollfd *pfds, int count);
+    long long getDeadline(void);
+    bool handleTimeout(void);
 
 private:
-	bool m_running;
 	MutexLock m_mutex;
-	pthread_t m_threadId;
+    PcmEventLoop *m_loop; // 捕获线程
+    string m_name; // 设备名
     PcmChannelVec m_channels; // 保存所有注册的音频通道
+    PcmConvertNodeVec m_nodes; // 所有共享转换节点
+    DspWorkerPool *m_pool; // DSP线程池，NULL表示由读取线程转换
+    int m_tasks; // 已投递给线程池尚未执行完的任务数，销毁前等待归零
+    int m_retired; // 有通道切换后留下待释放的节点，捕获线程只在置位时遍历通道
+    PcmFrameRing_t m_ring; // 最近捕获的帧，所有通道共享
 
-    unsigned int m_samplerate;
-    unsigned int m_channel;
-    unsigned char m_bits;
+    unsigned int m_samplerate; // 当前捕获的采样率
+    unsigned int m_channel; // 当前捕获的声道数
+    int m_format; // 捕获的采样格式PCM_FMT_*
     unsigned int m_ptime;
+    const PcmCaptureProfile_t *m_profile; // 延迟配置
+    unsigned int m_fixedRate; // 请求的采样率，0表示自动协商
+    unsigned int m_fixedChannel; // 请求的声道数，0表示自动协商
+    unsigned int m_periodFrames; // 设备实际每周期的帧数，转换节点按它建立
+    bool m_rebuild; // 捕获格式已改变，打开后重建转换节点
+    int m_captureMode; // PCM_CAPTURE_READI/MMAP
+    PcmCaptureCaps_t m_caps; // 硬件原生能力，自动协商用
+    bool m_capsValid;
+
+    PcmSource *m_source; // 捕获源，按设备名创建
+    unsigned int m_tryTimes; // 连续打开失败次数，决定下次重试的间隔
+    unsigned int m_failTimes; // 连续读取失败次数
+    unsigned long long m_frameSeq; // 下一个捕获周期的序号，重新打开后继续递增，即已读取的周期数
+    unsigned long long m_readErrors; // 以下统计只由捕获线程写
+    unsigned long long m_opens;
+    unsigned long long m_openFailures;
+    int m_opened;
+    int m_ended; // 回放的文件已读完，不再重新打开
+    int m_statsInterval; // 统计快照间隔，单位ms，<=0不输出
+    long long m_statsAt; // 下次输出统计快照的时间
+    long long m_reopenAt; // 设备未打开时下次尝试打开的时间
+    long long m_reconfigAt; // 通道变化后重新协商的时间，<0表示不需要，其他线程原子写
+
+    PcmVad m_vad; // 语音检测，只由捕获线程使用
+    bool m_vadOn; // 捕获线程当前是否做语音检测
+    int m_vadEnable; // 请求的开关，与m_vadConfig一起由m_mutex保护
+    PcmVadConfig_t m_vadConfig;
+    int m_vadChanged; // 有待捕获线程生效的设置，原子读写
+};
+typedef std::vector<PcmRecord *>PcmRecordVec;
+
+/*
+ * 捕获设备管理：同一进程同时从多个设备录音，
+ * 所有设备共用一个捕获线程(事件循环)和一个DSP线程池
+ */
+class PcmDeviceManager
+{
+public:
+    ~PcmDeviceManager();
+    static PcmDeviceManager *instance(); // 懒汉，第一次使用时创建
+
+    /* 同名设备已打开且参数相同时增加引用返回同一个设备，参数不同返回NULL；
+     * samplerate/channel_cnt为0表示自动协商 */
+    PcmRecord *openDevice(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime,
+        int profile = PCM_PROFILE_DEFAULT);
+    void closeDevice(PcmRecord *device);
+    PcmRecord *defaultDevice(void);
+    bool setDspThreads(int threads);
+    void setStatsInterval(int interval_ms);
+    /* thread：PCM_THREAD_*；设置保存下来，之后重新创建的DSP线程池也使用 */
+    bool setThreadSched(int thread, const PcmThreadSched_t *sched);
 
-	snd_pcm_t *m_pcmHandle; // PCM句柄
-	snd_pcm_uframes_t m_captureFrames; // samples_per_frame
-	unsigned int m_captureSize; // in bytes
+private:
+    PcmDeviceManager();
+    void loadSchedEnv(int thread, const char *sched_env, const char *cpus_env);
 
-    static PcmRecord m_instance; // 单实例
+private:
+    MutexLock m_lock;
+    PcmEventLoop m_loop; // 所有设备共用的捕获线程
+    DspWorkerPool *m_pool; // 所有设备共用的DSP线程池
+    PcmRecordVec m_devices;
+    std::vector<int> m_refs; // 与m_devices一一对应的引用数
+    PcmRecord *m_default;
+    int m_statsInterval; // 所有设备的统计快照间隔
+    PcmThreadSched_t m_sched[PCM_THREAD_COUNT]; // 捕获线程和DSP线程池的调度设置
 };
 
 ////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 void *AI_EnableChn(unsigned int samplerate, unsigned int channel_cnt);
+void *AI_EnableChnEx(unsigned int samplerate, unsigned int channel_cnt, int format, int engine);
 void AI_DisableChn(void *ChnID);
 int AI_GetFrame(void *ChnID, char *pstFrm, int len, int timeout_ms);
+int AI_GetFrameEx(void *ChnID, char *pstFrm, int len, int timeout_ms, PcmFrameInfo_t *info);
+int AI_GetFrames(void *ChnID, char *pstFrm, int len, int max_frames, int timeout_ms, int *frames, PcmFrameInfo_t *info);
+int AI_BorrowFrame(void *ChnID, PcmFrameView_t *view, int timeout_ms);
+int AI_ReleaseFrame(void *ChnID, PcmFrameView_t *view);
+int AI_GetNodeStats(PcmNodeStat_t *stats, int max);
+int AI_SetDspThreads(int threads);
+
+/*
+ * 设备相关：不带Dev的接口使用默认设备"default"(20ms，采样率和声道数按通道需求自动协商)
+ */
+void *AI_OpenDevice(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime);
+void *AI_OpenDeviceProfile(const char *name, unsigned int samplerate, unsigned int channel_cnt, int format, int profile);
+void *AI_OpenDeviceIndex(int card, int device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime);
+void AI_CloseDevice(void *DevID);
+void *AI_EnableDevChn(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine);
+/* 每次读取frame_ms的数据，相邻两次起点间隔hop_ms(可重叠)，与设备周期无关 */
+void *AI_EnableChnWindow(unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    unsigned int frame_ms, unsigned int hop_ms);
+void *AI_EnableDevChnWindow(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    unsigned int frame_ms, unsigned int hop_ms);
+/* 按声道映射从多声道(如麦克风阵列)捕获中选取/混合，声道数为map->out_chan，见pcm_chmap_parse() */
+void *AI_EnableChnMap(unsigned int samplerate, int format, int engine, const PcmChannelMap_t *map);
+void *AI_EnableDevChnMap(void *DevID, unsigned int samplerate, int format, int engine, const PcmChannelMap_t *map);
+/* 带处理链(去直流/高通/增益/AGC)的通道，同一格式和处理链的通道共用一份处理，见pcm_dsp_parse() */
+void *AI_EnableChnDsp(unsigned int samplerate, unsigned int channel_cnt, int format, int engine, const PcmDspConfig_t *dsp);
+void *AI_EnableDevChnDsp(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int format, int engine,
+    const PcmDspConfig_t *dsp);
+/* 编码输出的通道(G.711 μ-law/A-law或IMA-ADPCM，见pcmcodec.h)，每帧是编码后的一个周期，
+ * 同一采样率、声道数和编码的通道共用一份编码 */
+void *AI_EnableChnCodec(unsigned int samplerate, unsigned int channel_cnt, int engine, int codec);
+void *AI_EnableDevChnCodec(void *DevID, unsigned int samplerate, unsigned int channel_cnt, int engine, int codec);
+int AI_GetDevNodeStats(void *DevID, PcmNodeStat_t *stats, int max);
+
+/*
+ * 运行统计：计数器都是单写者原子变量，查询不影响捕获线程
+ */
+int AI_GetDevStats(void *DevID, PcmDeviceStat_t *stat);
+int AI_GetChnStats(void *ChnID, PcmChannelStat_t *stat);
+int AI_SetStatsInterval(int interval_ms);
+
+/*
+ * 语音检测：设备每个捕获周期计量一次电平并判断语音，结果在PcmFrameInfo_t的peak/rms/vad中，
+ * 只读语音的通道跳过静音帧，跳过的周期数在下一帧的info->gap中
+ */
+int AI_SetDevVad(void *DevID, int enable, const PcmVadConfig_t *cfg);
+int AI_SetChnSpeechOnly(void *ChnID, int enable);
+
+/*
+ * 实时调度：没有权限时保持默认调度并返回-1，捕获不受影响；效果可对照设备统计中的xruns
+ */
+int AI_SetThreadSched(int thread, int policy, int priority, const char *cpus);
+int AI_LockMemory(void);
 
 
 #endif
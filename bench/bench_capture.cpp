@@ -0,0 +1,180 @@
+/*
+ * 捕获方式基准：readi读到栈缓冲再拷进共享缓冲(原来的做法)、readi直接读到共享缓冲的槽、
+ * mmap从DMA缓冲直接拷到槽，对比每周期的拷贝量和捕获线程CPU时间
+ * 另测一个事件循环线程同时服务多个非阻塞句柄时每周期的CPU时间和stop()耗时
+ * 用法：bench_capture [设备名，默认null] [周期数，默认500] [事件循环句柄数，默认4]
+ * 可用null设备或file插件(如加载录音文件的slave)在没有声卡的机器上运行
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pcmcapture.h"
+#include "pcmloop.h"
+
+#define RATE 48000
+#define CHANNELS 2
+#define PTIME 20
+#define RING_SLOTS 64
+#define SLOT_BYTES 15360
+
+enum
+{
+    CASE_LEGACY = 0,
+    CASE_READI_SLOT,
+    CASE_MMAP_SLOT,
+    CASE_COUNT
+};
+static const char *case_name[CASE_COUNT] = {"readi+putFrame", "readi->slot", "mmap->slot"};
+
+static double thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_case(const char *device, int id, int periods)
+{
+    PcmCapture cap;
+    PcmFrameRing_t ring;
+    char buffer[SLOT_BYTES];
+    int mode = (id == CASE_MMAP_SLOT) ? PCM_CAPTURE_MMAP : PCM_CAPTURE_READI;
+
+    ring.create(RING_SLOTS, SLOT_BYTES);
+    if (!cap.open(device, RATE, CHANNELS, PCM_FMT_S16, PTIME, mode))
+    {
+        printf("case=%s device=%s open failed\n", case_name[id], device);
+        return;
+    }
+
+    unsigned long long bytes = 0, copies = 0;
+    int got = 0, fails = 0;
+    double cpu0 = thread_cpu_ns(), wall0 = pcm_now_ns();
+    while (got < periods && fails < 100)
+    {
+        int ret = 0;
+        if (id == CASE_LEGACY)
+        {
+            ret = cap.read(buffer, sizeof(buffer));
+            if (ret > 0)
+            {
+                ring.putFrame(buffer, ret);
+                copies += ret; // 栈缓冲到共享缓冲
+            }
+        }
+        else
+        {
+            ret = cap.readFrame(&ring);
+        }
+
+        if (ret <= 0)
+        {
+            fails++;
+            continue;
+        }
+        bytes += ret;
+        copies += ret; // 驱动缓冲到用户缓冲：readi在alsa-lib/内核中，mmap在PcmCapture中
+        got++;
+    }
+    double cpu = thread_cpu_ns() - cpu0, wall = pcm_now_ns() - wall0;
+
+    if (got == 0)
+    {
+        printf("case=%s device=%s no data\n", case_name[id], device);
+        return;
+    }
+    printf("case=%s device=%s access=%s periods=%d bytes_per_period=%llu copy_bytes_per_period=%llu cpu_us_per_period=%.2f wall_us_per_period=%.1f\n",
+        case_name[id], device, pcm_capture_mode_name(cap.mode()), got, bytes / got, copies / got,
+        cpu / 1000 / got, wall / 1000 / got);
+}
+
+/* 事件循环中的一个句柄，poll到数据后读到自己的环形缓冲 */
+class LoopCapture : public PcmLoopHandler
+{
+public:
+    LoopCapture() {got = 0; ring.create(RING_SLOTS, SLOT_BYTES); cap.setNonblock(true);}
+
+    int getPollFds(struct pollfd *pfds, int space) {return cap.pollDescriptors(pfds, space);}
+    bool handleEvents(struct pollfd *pfds, int count)
+    {
+        if (!(cap.pollRevents(pfds, count) & (POLLIN | POLLERR)))
+            return false;
+        while (cap.readFrame(&ring) > 0)
+            __atomic_add_fetch(&got, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    PcmCapture cap;
+    PcmFrameRing_t ring;
+    int got;
+};
+
+static void run_loop(const char *device, int handles, int periods)
+{
+    PcmEventLoop loop;
+    LoopCapture *caps = new LoopCapture[handles];
+    int opened = 0;
+
+    for (int i = 0; i < handles; i++)
+    {
+        if (caps[i].cap.open(device, RATE, CHANNELS, PCM_FMT_S16, PTIME, PCM_CAPTURE_READI))
+        {
+            loop.addHandler(&caps[i]);
+            opened++;
+        }
+    }
+    if (opened == 0)
+    {
+        printf("case=loop device=%s open failed\n", device);
+        delete []caps;
+        return;
+    }
+
+    /* 循环线程的CPU时间用进程CPU时间减去主线程(只在sleep)近似 */
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    double cpu0 = ts.tv_sec * 1e9 + ts.tv_nsec;
+    double wall0 = pcm_now_ns();
+    loop.start();
+    while (true)
+    {
+        int done = 0;
+        for (int i = 0; i < handles; i++)
+            done += (!caps[i].cap.isOpen() || __atomic_load_n(&caps[i].got, __ATOMIC_RELAXED) >= periods);
+        if (done == handles || pcm_now_ns() - wall0 > (periods * PTIME + 5000) * 1e6)
+            break;
+        usleep(PTIME * 1000);
+    }
+
+    double t0 = pcm_now_ns();
+    loop.stop();
+    double stop_us = (pcm_now_ns() - t0) / 1000;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    double cpu = ts.tv_sec * 1e9 + ts.tv_nsec - cpu0;
+
+    int total = 0;
+    for (int i = 0; i < handles; i++)
+        total += caps[i].got;
+    printf("case=loop device=%s handles=%d threads=1 periods=%d cpu_us_per_period=%.2f stop_us=%.0f\n",
+        device, opened, total, total ? cpu / 1000 / total : 0.0, stop_us);
+
+    for (int i = 0; i < handles; i++)
+        loop.removeHandler(&caps[i]);
+    delete []caps;
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = argc > 1 ? argv[1] : "null";
+    int periods = argc > 2 ? atoi(argv[2]) : 500;
+    int handles = argc > 3 ? atoi(argv[3]) : 4;
+
+    for (int id = 0; id < CASE_COUNT; id++)
+        run_case(device, id, periods);
+    run_loop(device, handles, periods);
+    return 0;
+}
+
@@ -0,0 +1,228 @@
+/*
+ * 编码输出基准：
+ * 1. 编码器：消费者常见的逐段查找G.711实现与查表实现的每样本耗时(并校验所有16bit输入结果一致)，ADPCM的耗时和信噪比
+ * 2. 端到端：外部写入16kHz单声道，N个消费者读8kHz单声道，对比各自读16bit后自己编码与读共享编码通道，
+ *    每个周期的总CPU时间(写入、转换、读取、编码)和每个消费者每帧读取的字节数
+ * 3. 与捕获同采样率、带处理链的编码通道(16kHz单声道，去直流+高通)，对比消费者读处理后的16bit自己编码
+ * 每项输出一行key=value
+ * 用法：bench_codec [编码ulaw/alaw/adpcm，默认ulaw] [消费者数，默认4] [周期数，默认5000]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "audio.h"
+
+#define ENCODE_LOOPS 2000
+
+static double cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* 消费者常见的G.711实现：逐段查找 */
+static int search(int value, const int *ends)
+{
+    int seg = 0;
+    while (seg < 8 && value > ends[seg])
+        seg++;
+    return seg;
+}
+
+static unsigned char ref_ulaw(int pcm)
+{
+    static const int ends[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+    int mask = 0xFF;
+    pcm >>= 2;
+    if (pcm < 0)
+    {
+        pcm = -pcm;
+        mask = 0x7F;
+    }
+    if (pcm > 8159)
+        pcm = 8159;
+    pcm += 0x21;
+    int seg = search(pcm, ends);
+    return seg >= 8 ? 0x7F ^ mask : ((seg << 4) | ((pcm >> (seg + 1)) & 0xF)) ^ mask;
+}
+
+static unsigned char ref_alaw(int pcm)
+{
+    static const int ends[8] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+    int mask = 0xD5;
+    pcm >>= 3;
+    if (pcm < 0)
+    {
+        mask = 0x55;
+        pcm = -pcm - 1;
+    }
+    int seg = search(pcm, ends);
+    if (seg >= 8)
+        return 0x7F ^ mask;
+    return ((seg << 4) | ((pcm >> (seg < 2 ? 1 : seg)) & 0xF)) ^ mask;
+}
+
+static void ref_encode(int codec, const short *in, unsigned char *out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = codec == PCM_CODEC_ALAW ? ref_alaw(in[i]) : ref_ulaw(in[i]);
+}
+
+static void make_speech(short *buf, int n, int offset, unsigned int rate)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double t = (double)(offset + i) / rate;
+        buf[i] = (short)(8000 * sin(2 * M_PI * 300 * t) * (0.6 + 0.4 * sin(2 * M_PI * 3 * t)) + 1500 * sin(2 * M_PI * 1700 * t));
+    }
+}
+
+static void bench_encoder(int codec)
+{
+    int n = 160;
+    short in[160];
+    unsigned char out[256];
+    make_speech(in, n, 0, 8000);
+
+    double ref = 0, table = 0;
+    int mismatch = 0;
+    if (codec != PCM_CODEC_ADPCM)
+    {
+        for (int x = -32768; x < 32768; x++)
+        {
+            short s = (short)x;
+            unsigned char a, b;
+            ref_encode(codec, &s, &a, 1);
+            if (codec == PCM_CODEC_ULAW)
+                pcm_ulaw_encode(&s, &b, 1);
+            else
+                pcm_alaw_encode(&s, &b, 1);
+            mismatch += (a != b);
+        }
+        double t0 = pcm_now_ns();
+        for (int i = 0; i < ENCODE_LOOPS; i++)
+        {
+            ref_encode(codec, in, out, n);
+            __asm__ __volatile__("" : : "r"(out) : "memory");
+        }
+        ref = (pcm_now_ns() - t0) / ENCODE_LOOPS / n;
+    }
+
+    PcmEncoder encoder;
+    encoder.configure(codec, 1);
+    int bytes = 0;
+    double t0 = pcm_now_ns();
+    for (int i = 0; i < ENCODE_LOOPS; i++)
+    {
+        bytes = encoder.encode(in, n, out);
+        __asm__ __volatile__("" : : "r"(out) : "memory");
+    }
+    table = (pcm_now_ns() - t0) / ENCODE_LOOPS / n;
+
+    /* 解码回16bit的信噪比 */
+    short dec[320];
+    int frames = n;
+    if (codec == PCM_CODEC_ULAW)
+        pcm_ulaw_decode(out, dec, n);
+    else if (codec == PCM_CODEC_ALAW)
+        pcm_alaw_decode(out, dec, n);
+    else
+        frames = pcm_adpcm_decode(out, bytes, 1, dec);
+    double sig = 0, err = 0;
+    for (int i = 0; i < frames && i < n; i++)
+    {
+        sig += (double)in[i] * in[i];
+        err += (double)(in[i] - dec[i]) * (in[i] - dec[i]);
+    }
+
+    if (codec == PCM_CODEC_ADPCM)
+        printf("codec=%s encode_ns_per_sample=%.2f bytes_per_20ms=%d ratio=%.2f snr_db=%.1f\n",
+            pcm_codec_name(codec), table, bytes, n * 2.0 / bytes, 10 * log10(sig / (err + 1e-9)));
+    else
+        printf("codec=%s scalar_ns_per_sample=%.2f table_ns_per_sample=%.2f speedup=%.2f mismatches=%d bytes_per_20ms=%d ratio=%.2f snr_db=%.1f\n",
+            pcm_codec_name(codec), ref, table, ref / table, mismatch, bytes, n * 2.0 / bytes, 10 * log10(sig / (err + 1e-9)));
+}
+
+/*
+ * coded：消费者读编码通道，否则读16bit后自己编码(ADPCM用库的编码器，每个消费者一份状态)
+ * rate：通道采样率；dsp：通道的处理链，NULL表示不处理
+ */
+static double run(int codec, bool coded, int consumers, int periods, unsigned int rate, const PcmDspConfig_t *dsp,
+    double *bytes_per_frame)
+{
+    PcmEventLoop loop;
+    PcmRecord *dev = new PcmRecord(&loop, "bench");
+    dev->startExternal(16000, 1, PCM_FMT_S16, 20);
+    void *chn[64];
+    PcmEncoder encoders[64];
+    for (int i = 0; i < consumers; i++)
+    {
+        chn[i] = dev->createChannel(rate, 1, PCM_FMT_S16, RESAMPLE_ENGINE_SRC, 0, 0, NULL, dsp, coded ? codec : PCM_CODEC_NONE);
+        encoders[i].configure(codec, 1);
+    }
+
+    short in[320];
+    char buf[4096];
+    unsigned char enc[4096];
+    unsigned long long bytes = 0, frames = 0;
+    double t0 = cpu_ns();
+    for (int p = 0; p < periods; p++)
+    {
+        make_speech(in, 320, p * 320, 16000);
+        dev->pushFrame((const char *)in, sizeof(in));
+        for (int i = 0; i < consumers; i++)
+        {
+            int size;
+            while ((size = dev->readChannel(chn[i], buf, sizeof(buf), 0)) > 0)
+            {
+                bytes += size;
+                frames++;
+                if (coded)
+                    continue;
+                if (codec == PCM_CODEC_ADPCM)
+                    encoders[i].encode((const short *)buf, size / 2, enc);
+                else
+                    ref_encode(codec, (const short *)buf, enc, size / 2);
+                __asm__ __volatile__("" : : "r"(enc) : "memory");
+            }
+        }
+    }
+    double cost = (cpu_ns() - t0) / periods;
+    *bytes_per_frame = frames ? (double)bytes / frames : 0;
+    for (int i = 0; i < consumers; i++)
+        dev->destroyChannel(chn[i]);
+    delete dev;
+    return cost;
+}
+
+int main(int argc, char *argv[])
+{
+    int codec = pcm_codec_parse(argc > 1 ? argv[1] : "ulaw");
+    int consumers = argc > 2 ? atoi(argv[2]) : 4;
+    int periods = argc > 3 ? atoi(argv[3]) : 5000;
+    if (codec <= PCM_CODEC_NONE || consumers < 1 || consumers > 64)
+        return 1;
+
+    bench_encoder(codec);
+
+    double own_bytes, shared_bytes;
+    double own = run(codec, false, consumers, periods, 8000, NULL, &own_bytes);
+    double shared = run(codec, true, consumers, periods, 8000, NULL, &shared_bytes);
+    printf("codec=%s capture=16000/1 output=8000/1 consumers=%d periods=%d consumer_encode_ns_per_period=%.0f "
+        "shared_codec_ns_per_period=%.0f speedup=%.2f pcm_bytes_per_frame=%.0f coded_bytes_per_frame=%.0f\n",
+        pcm_codec_name(codec), consumers, periods, own, shared, own / shared, own_bytes, shared_bytes);
+
+    /* 同采样率的处理链+编码：节点不重采样，先转为float处理再编码 */
+    PcmDspConfig_t dsp;
+    pcm_dsp_parse(&dsp, "dc,hpf=100");
+    own = run(codec, false, consumers, periods, 16000, &dsp, &own_bytes);
+    shared = run(codec, true, consumers, periods, 16000, &dsp, &shared_bytes);
+    printf("codec=%s capture=16000/1 output=16000/1 dsp=dc,hpf=100 consumers=%d periods=%d consumer_encode_ns_per_period=%.0f "
+        "shared_codec_ns_per_period=%.0f speedup=%.2f pcm_bytes_per_frame=%.0f coded_bytes_per_frame=%.0f\n",
+        pcm_codec_name(codec), consumers, periods, own, shared, own / shared, own_bytes, shared_bytes);
+    return 0;
+}
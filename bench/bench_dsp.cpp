@@ -0,0 +1,129 @@
+/*
+ * 处理链基准：去直流+高通+增益+AGC，对比消费者常见的做法(转为float后每级各走一遍，再转回int16)
+ * 与一遍完成的处理链，以及处理链并入16bit重采样输出转换后比单独重采样多出的耗时。
+ * 每项输出一行key=value，单位为每帧(每声道样本)的ns
+ * 用法：bench_dsp [采样率，默认16000] [声道数，默认1]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pcmdsp.h"
+#include "pcmkernel.h"
+#include "pcmring.h"
+#include "resampler.h"
+
+#define LOOPS 20000
+
+/* 分级实现：每级一遍，状态与PcmDsp相同 */
+typedef struct Stages_t
+{
+    float dc_x[PCM_CHANNEL_MAX], dc_y[PCM_CHANNEL_MAX], z1[PCM_CHANNEL_MAX], z2[PCM_CHANNEL_MAX];
+    float pole, b0, b1, b2, a1, a2, gain, agc;
+}Stages_t;
+
+static void stages_init(Stages_t *s, unsigned int rate, float hpf, float gain_db)
+{
+    memset(s, 0, sizeof(*s));
+    s->pole = 1.0f - 2.0f * (float)M_PI * PCM_DSP_DC_HZ / rate;
+    double w0 = 2.0 * M_PI * hpf / rate, alpha = sin(w0) / (2.0 * M_SQRT1_2), cosw = cos(w0), a0 = 1.0 + alpha;
+    s->b0 = s->b2 = (float)((1.0 + cosw) / 2.0 / a0);
+    s->b1 = (float)(-(1.0 + cosw) / a0);
+    s->a1 = (float)(-2.0 * cosw / a0);
+    s->a2 = (float)((1.0 - alpha) / a0);
+    s->gain = powf(10.0f, gain_db / 20.0f);
+    s->agc = 1.0f;
+}
+
+static void stages_run(Stages_t *s, const short *in, short *out, float *tmp, int frames, unsigned int channels)
+{
+    int n = frames * channels;
+    pcm_kernels()->s16_to_float(in, tmp, n);
+    for (int i = 0; i < n; i++) // 去直流
+    {
+        unsigned int c = i % channels;
+        float y = tmp[i] - s->dc_x[c] + s->pole * s->dc_y[c];
+        s->dc_x[c] = tmp[i];
+        s->dc_y[c] = y;
+        tmp[i] = y;
+    }
+    for (int i = 0; i < n; i++) // 高通
+    {
+        unsigned int c = i % channels;
+        float y = s->b0 * tmp[i] + s->z1[c];
+        s->z1[c] = s->b1 * tmp[i] - s->a1 * y + s->z2[c];
+        s->z2[c] = s->b2 * tmp[i] - s->a2 * y;
+        tmp[i] = y;
+    }
+    for (int i = 0; i < n; i++) // 固定增益
+        tmp[i] *= s->gain;
+    float sumsq = 0;
+    for (int i = 0; i < n; i++) // AGC计量
+        sumsq += tmp[i] * tmp[i];
+    float level = 10.0f * log10f(sumsq / n + 1e-20f);
+    s->agc = powf(10.0f, (-20.0f - level) / 20.0f);
+    for (int i = 0; i < n; i++) // AGC增益
+        tmp[i] *= s->agc;
+    pcm_kernels()->float_to_s16(tmp, out, n);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int rate = argc > 1 ? atoi(argv[1]) : 16000;
+    unsigned int channels = argc > 2 ? atoi(argv[2]) : 1;
+    if (channels < 1 || channels > PCM_CHANNEL_MAX)
+        return 1;
+    int frames = rate / 50; // 20ms
+    int n = frames * channels;
+
+    short *in = new short[n];
+    short *out = new short[n * 2];
+    float *tmp = new float[n];
+    for (int i = 0; i < n; i++)
+        in[i] = (short)(2000 + 3000 * sin(i * 0.07) + (rand() % 200 - 100));
+
+    PcmDspConfig_t cfg;
+    pcm_dsp_parse(&cfg, "dc,hpf=100,gain=6,agc=-20");
+
+    Stages_t stages;
+    stages_init(&stages, rate, 100, 6);
+    double t0 = pcm_now_ns();
+    for (int i = 0; i < LOOPS; i++)
+        stages_run(&stages, in, out, tmp, frames, channels);
+    double separate = (pcm_now_ns() - t0) / LOOPS / frames;
+
+    PcmDsp dsp;
+    dsp.configure(&cfg, rate);
+    t0 = pcm_now_ns();
+    for (int i = 0; i < LOOPS; i++)
+        dsp.runS16(in, out, frames, channels);
+    double fused = (pcm_now_ns() - t0) / LOOPS / frames;
+
+    printf("rate=%u ch=%u chain=dc+hpf+gain+agc separate_ns_per_frame=%.2f fused_ns_per_frame=%.2f speedup=%.2f\n",
+        rate, channels, separate, fused, separate / fused);
+
+    /* 处理链并入重采样输出的float到int16转换 */
+    unsigned int out_rate = rate / 2;
+    CResampleEx plain, folded;
+    plain.resample_create(true, false, channels, rate, out_rate, n);
+    folded.resample_create(true, false, channels, rate, out_rate, n);
+    dsp.configure(&cfg, out_rate);
+    folded.resample_set_dsp(&dsp);
+
+    t0 = pcm_now_ns();
+    for (int i = 0; i < LOOPS; i++)
+        plain.resample_run(in, out);
+    double base = (pcm_now_ns() - t0) / LOOPS / frames;
+    t0 = pcm_now_ns();
+    for (int i = 0; i < LOOPS; i++)
+        folded.resample_run(in, out);
+    double with = (pcm_now_ns() - t0) / LOOPS / frames;
+    printf("resample=%u->%u ch=%u resample_ns_per_frame=%.2f resample_dsp_ns_per_frame=%.2f dsp_extra_ns_per_frame=%.2f\n",
+        rate, out_rate, channels, base, with, with - base);
+
+    delete []in;
+    delete []out;
+    delete []tmp;
+    return 0;
+}
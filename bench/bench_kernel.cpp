@@ -0,0 +1,138 @@
+/*
+ * 样本转换内核基准：各指令集实现对比标量实现，
+ * int16/float互转另外对比libsamplerate自带的转换函数，
+ * 单声道转双声道另外对比原来先申请临时缓冲再拷贝的做法，
+ * 最后检查各指令集的电平计量结果与标量一致
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pcmkernel.h"
+#include "pcmring.h"
+#include "samplerate.h"
+
+#define FRAMES 960 // 48000Hz 20ms
+#define LOOPS 20000
+
+static short g_s16[FRAMES * 2];
+static short g_s16_out[FRAMES * 2];
+static float g_flt[FRAMES * 2];
+static float g_flt_out[FRAMES * 2];
+
+/* 原operateMonoStereo中的单声道转双声道 */
+static void legacy_mono_to_stereo(const short *in, short *out, int frames)
+{
+    char *tmp = new char[frames * 4];
+    short *ptr1 = (short *)tmp;
+    for (int i = 0; i < frames; i++)
+        ptr1[2*i] = ptr1[2*i+1] = in[i];
+    memcpy(out, tmp, frames * 4);
+    delete []tmp;
+}
+
+static void libsrc_s16_to_float(const short *in, float *out, int n) {src_short_to_float_array(in, out, n);}
+static void libsrc_float_to_s16(const float *in, short *out, int n) {src_float_to_short_array(in, out, n);}
+
+enum
+{
+    K_S16_TO_FLOAT = 0,
+    K_FLOAT_TO_S16,
+    K_MONO_TO_STEREO,
+    K_STEREO_TO_MONO,
+    K_STEREO_TO_FLOAT_MONO,
+    K_FLOAT_MONO_TO_STEREO,
+    K_DOT,
+    K_LEVEL,
+    K_COUNT
+};
+static const char *kernel_name[K_COUNT] = {
+    "s16_to_float", "float_to_s16", "mono_to_stereo",
+    "stereo_to_mono", "stereo_to_float_mono", "float_mono_to_stereo", "dot_s16", "level_s16"
+};
+static volatile int g_dot;
+static volatile unsigned long long g_sumsq;
+
+static double run_kernel(const PcmKernels_t *k, int id)
+{
+    double t0 = pcm_now_ns();
+    for (int n = 0; n < LOOPS; n++)
+    {
+        switch (id)
+        {
+        case K_S16_TO_FLOAT: k->s16_to_float(g_s16, g_flt_out, FRAMES); break;
+        case K_FLOAT_TO_S16: k->float_to_s16(g_flt, g_s16_out, FRAMES); break;
+        case K_MONO_TO_STEREO: k->mono_to_stereo(g_s16, g_s16_out, FRAMES); break;
+        case K_STEREO_TO_MONO: k->stereo_to_mono(g_s16, g_s16_out, FRAMES); break;
+        case K_STEREO_TO_FLOAT_MONO: k->stereo_to_float_mono(g_s16, g_flt_out, FRAMES); break;
+        case K_FLOAT_MONO_TO_STEREO: k->float_mono_to_stereo(g_flt, g_s16_out, FRAMES); break;
+        case K_DOT: g_dot = k->dot_s16(g_s16, g_s16 + FRAMES, FRAMES); break;
+        case K_LEVEL:
+        {
+            int peak;
+            unsigned long long sumsq;
+            k->level_s16(g_s16, FRAMES, &peak, &sumsq);
+            g_dot = peak;
+            g_sumsq = sumsq;
+            break;
+        }
+        }
+        __asm__ __volatile__("" ::: "memory");
+    }
+    return (pcm_now_ns() - t0) / LOOPS / FRAMES;
+}
+
+int main(void)
+{
+    const char *isas[] = {"scalar", "sse2", "avx2", "neon"};
+
+    for (int i = 0; i < FRAMES * 2; i++)
+    {
+        g_s16[i] = (short)(rand() & 0xffff);
+        g_flt[i] = (rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+    }
+
+    /* 参照：libsamplerate转换函数与原单声道转双声道 */
+    PcmKernels_t baseline = *pcm_kernels_by_name("scalar");
+    baseline.isa = "baseline";
+    baseline.s16_to_float = libsrc_s16_to_float;
+    baseline.float_to_s16 = libsrc_float_to_s16;
+    baseline.mono_to_stereo = legacy_mono_to_stereo;
+
+    double scalar_ns[K_COUNT];
+    for (int id = 0; id < K_COUNT; id++)
+    {
+        if (id <= K_MONO_TO_STEREO)
+            printf("kernel=%s isa=baseline ns_per_frame=%.3f\n", kernel_name[id], run_kernel(&baseline, id));
+    }
+    for (unsigned int i = 0; i < sizeof(isas)/sizeof(isas[0]); i++)
+    {
+        const PcmKernels_t *k = pcm_kernels_by_name(isas[i]);
+        if (!k)
+            continue;
+        for (int id = 0; id < K_COUNT; id++)
+        {
+            double ns = run_kernel(k, id);
+            if (i == 0)
+                scalar_ns[id] = ns;
+            printf("kernel=%s isa=%s ns_per_frame=%.3f speedup=%.2f\n",
+                kernel_name[id], k->isa, ns, scalar_ns[id] / ns);
+        }
+    }
+    int ref_peak;
+    unsigned long long ref_sumsq;
+    pcm_kernels_by_name("scalar")->level_s16(g_s16, FRAMES * 2 - 3, &ref_peak, &ref_sumsq);
+    for (unsigned int i = 1; i < sizeof(isas)/sizeof(isas[0]); i++)
+    {
+        const PcmKernels_t *k = pcm_kernels_by_name(isas[i]);
+        if (!k)
+            continue;
+        int peak;
+        unsigned long long sumsq;
+        k->level_s16(g_s16, FRAMES * 2 - 3, &peak, &sumsq);
+        printf("kernel=level_s16 isa=%s match=%d\n", k->isa, peak == ref_peak && sumsq == ref_sumsq);
+    }
+    printf("selected=%s\n", pcm_kernels()->isa);
+    return 0;
+}
+
@@ -0,0 +1,72 @@
+/*
+ * 延迟配置基准：每种配置打开一次设备，一个消费者线程用AI_GetFrameEx阻塞读取，
+ * 统计每帧第一个采样的捕获时间(驱动时间戳)到读取返回的延迟，输出一行key=value：
+ * 周期、队列深度、延迟p50/p99/max、溢出次数、丢帧数、捕获线程调度策略
+ * 用法：bench_latency [设备名，默认tone:440] [每种配置的秒数，默认3] [通道采样率，默认16000]
+ * 设备名为ALSA PCM时测的是实际声卡；默认的信号发生器按实时节奏产生周期，没有声卡也能运行。
+ * 配合PCM_CAPTURE_SCHED=fifo:80等环境变量可对比实时调度的效果
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "audio.h"
+
+static void run_profile(const char *device, int profile, int seconds, unsigned int rate)
+{
+    const PcmCaptureProfile_t *config = pcm_capture_profile(profile);
+    void *dev = AI_OpenDeviceProfile(device, 0, 0, PCM_FMT_S16, profile);
+    if (!dev)
+    {
+        printf("profile=%s device=%s open failed\n", config->name, device);
+        return;
+    }
+    void *chn = AI_EnableDevChn(dev, rate, 1, PCM_FMT_S16, RESAMPLE_ENGINE_SRC);
+    if (!chn)
+    {
+        printf("profile=%s device=%s channel failed\n", config->name, device);
+        AI_CloseDevice(dev);
+        return;
+    }
+
+    std::vector<long long> latency;
+    char buffer[PCM_PERIOD_MAX_BYTES];
+    PcmFrameInfo_t info;
+    long long end = pcm_now_ns() + seconds * 1000000000LL;
+    while (pcm_now_ns() < end)
+    {
+        int ret = AI_GetFrameEx(chn, buffer, sizeof(buffer), 200, &info);
+        if (ret > 0 && info.tstamp)
+            latency.push_back(pcm_now_ns() - info.tstamp);
+    }
+
+    PcmDeviceStat_t dstat;
+    PcmChannelStat_t cstat;
+    AI_GetDevStats(dev, &dstat);
+    AI_GetChnStats(chn, &cstat);
+    AI_DisableChn(chn);
+    AI_CloseDevice(dev);
+
+    std::sort(latency.begin(), latency.end());
+    size_t n = latency.size();
+    double p50 = n ? latency[n / 2] / 1000.0 : 0;
+    double p99 = n ? latency[(n * 99) / 100] / 1000.0 : 0;
+    double max = n ? latency[n - 1] / 1000.0 : 0;
+    printf("profile=%s device=%s capture=%u/%u ptime_ms=%u queue_depth=%d frames=%zu latency_p50_us=%.1f latency_p99_us=%.1f "
+        "latency_max_us=%.1f xruns=%llu dropped=%llu sched=%s:%d\n",
+        config->name, device, dstat.samplerate, dstat.channel, config->ptime ? config->ptime : 20, cstat.queue_depth, n,
+        p50, p99, max, dstat.xruns, cstat.dropped, pcm_sched_policy_name(dstat.sched_policy), dstat.sched_priority);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *device = argc > 1 ? argv[1] : "tone:440";
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    unsigned int rate = argc > 3 ? atoi(argv[3]) : 16000;
+
+    for (int profile = 0; profile < PCM_PROFILE_COUNT; profile++)
+        run_profile(device, profile, seconds, rate);
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * 整条捕获管线基准，不需要声卡：合成的48000Hz双声道信号经PcmRecord::pushFrame()写入，
+ * 每个通道一个消费者线程读取，经过与实际捕获相同的共享缓冲、转换节点和重采样。
+ * 生产者不按实时节奏写入，只在最慢的通道积压达到队列深度时等待，测得的是管线的最大吞吐。
+ * 扫描通道数、输出采样率组合、队列深度和重采样引擎，每种组合输出一行key=value：
+ * 每秒处理的周期数、相对实时的倍数、每通道每周期CPU时间、每周期堆分配次数、
+ * 写入到通道读出的延迟p50/p99
+ * 用法：bench_pipeline [每种组合的周期数，默认500]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <vector>
+#include <algorithm>
+
+#include "audio.h"
+#include "benchalloc.h"
+
+#define RATE 48000
+#define CHANNELS 2
+#define PTIME 20
+#define PERIOD_FRAMES (RATE * PTIME / 1000)
+#define SOURCE_PERIODS 50 // 合成信号循环使用的周期数
+
+static short s_source[SOURCE_PERIODS * PERIOD_FRAMES * CHANNELS];
+
+typedef struct
+{
+    unsigned int samplerate;
+    unsigned int channel;
+}OutFormat_t;
+
+/* 输出格式组合，通道按顺序循环取用 */
+static const OutFormat_t s_direct[] = {{48000, 2}};
+static const OutFormat_t s_same[] = {{16000, 1}};
+static const OutFormat_t s_mixed[] = {{8000, 1}, {16000, 1}, {22050, 2}, {44100, 1}, {48000, 2}};
+
+typedef struct
+{
+    const char *name;
+    const OutFormat_t *formats;
+    int count;
+    bool resample; // 是否经过重采样，不重采样时不区分引擎
+}Mix_t;
+
+static const Mix_t s_mixes[] =
+{
+    {"direct", s_direct, 1, false},
+    {"same16k", s_same, 1, true},
+    {"mixed", s_mixed, 5, true},
+};
+
+typedef struct
+{
+    PcmRecord *dev;
+    PcmChannel_t *ch;
+    int periods; // 应读取的周期数
+    bool *stop;
+    std::vector<long long> latency; // 单位ns
+}Consumer_t;
+
+static double process_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *consumer_thread(void *param)
+{
+    Consumer_t *c = (Consumer_t *)param;
+    char buf[PCM_PERIOD_MAX_BYTES];
+    PcmFrameInfo_t info;
+
+    while (!__atomic_load_n(c->stop, __ATOMIC_ACQUIRE))
+    {
+        int ret = c->dev->readChannel(c->ch, buf, sizeof(buf), 50, &info);
+        if (ret > 0 && c->latency.size() < c->latency.capacity()) // 预留的空间内记录，不在测量期间分配
+            c->latency.push_back(pcm_now_ns() - info.tstamp);
+    }
+    return NULL;
+}
+
+static const char *engine_name(int engine)
+{
+    return engine == RESAMPLE_ENGINE_FIXED ? "fixed" : "src";
+}
+
+static void run_case(const Mix_t *mix, int nchan, int depth, int engine, int periods, const short *source)
+{
+    PcmEventLoop loop; // 不启动，外部写入不需要捕获线程
+    PcmRecord *dev = new PcmRecord(&loop, "bench");
+    dev->startExternal(RATE, CHANNELS, PCM_FMT_S16, PTIME);
+
+    std::vector<Consumer_t> consumers(nchan);
+    std::vector<pthread_t> threads(nchan);
+    bool stop = false;
+    for (int i = 0; i < nchan; i++)
+    {
+        const OutFormat_t *fmt = &mix->formats[i % mix->count];
+        consumers[i].dev = dev;
+        consumers[i].ch = (PcmChannel_t *)dev->createChannel(fmt->samplerate, fmt->channel, PCM_FMT_S16, engine);
+        consumers[i].ch->setQueueDepth(depth);
+        consumers[i].periods = periods;
+        consumers[i].stop = &stop;
+        consumers[i].latency.reserve(periods);
+    }
+    int qdepth = consumers[0].ch->depth;
+    for (int i = 0; i < nchan; i++)
+        pthread_create(&threads[i], NULL, consumer_thread, &consumers[i]);
+
+    /* 预热：建立重采样器内部状态后再计量 */
+    for (int i = 0; i < 4; i++)
+        dev->pushFrame((const char *)(source + (i % SOURCE_PERIODS) * PERIOD_FRAMES * CHANNELS), PERIOD_FRAMES * CHANNELS * 2);
+    usleep(50000);
+    for (int i = 0; i < nchan; i++)
+        consumers[i].latency.clear();
+
+    unsigned long long served0 = 0;
+    for (int i = 0; i < nchan; i++)
+        served0 += __atomic_load_n(&consumers[i].ch->reader.served, __ATOMIC_RELAXED);
+    unsigned long allocs0 = bench_allocs();
+    double cpu0 = process_cpu_ns();
+    long long wall0 = pcm_now_ns();
+
+    for (int p = 0; p < periods; p++)
+    {
+        /* 最慢的通道积压到队列深度时等待，避免测量丢帧的开销 */
+        unsigned long long pushed = 4 + p;
+        for (int i = 0; i < nchan; i++)
+        {
+            PcmChannel_t *ch = consumers[i].ch;
+            while (pushed - __atomic_load_n(&ch->reader.served, __ATOMIC_RELAXED) -
+                __atomic_load_n(&ch->reader.dropped, __ATOMIC_RELAXED) >= (unsigned long long)qdepth)
+                sched_yield();
+        }
+        dev->pushFrame((const char *)(source + (p % SOURCE_PERIODS) * PERIOD_FRAMES * CHANNELS), PERIOD_FRAMES * CHANNELS * 2);
+    }
+
+    /* 等所有通道读完 */
+    unsigned long long target = (unsigned long long)(4 + periods);
+    long long give_up = pcm_now_ns() + 2000000000LL;
+    for (int i = 0; i < nchan; i++)
+    {
+        PcmChannel_t *ch = consumers[i].ch;
+        while (__atomic_load_n(&ch->reader.served, __ATOMIC_RELAXED) + __atomic_load_n(&ch->reader.dropped, __ATOMIC_RELAXED) < target &&
+            pcm_now_ns() < give_up)
+            sched_yield();
+    }
+    long long wall = pcm_now_ns() - wall0;
+    double cpu = process_cpu_ns() - cpu0;
+    unsigned long allocs = bench_allocs() - allocs0;
+
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < nchan; i++)
+        pthread_join(threads[i], NULL);
+
+    unsigned long long served = 0, dropped = 0;
+    std::vector<long long> all;
+    for (int i = 0; i < nchan; i++)
+    {
+        served += __atomic_load_n(&consumers[i].ch->reader.served, __ATOMIC_RELAXED);
+        dropped += consumers[i].ch->reader.dropped;
+        all.insert(all.end(), consumers[i].latency.begin(), consumers[i].latency.end());
+        dev->destroyChannel(consumers[i].ch);
+    }
+    served -= served0;
+    std::sort(all.begin(), all.end());
+    double p50 = all.empty() ? 0 : all[all.size() / 2] / 1000.0;
+    double p99 = all.empty() ? 0 : all[(all.size() * 99) / 100] / 1000.0;
+
+    printf("mix=%s channels=%d depth=%d engine=%s periods=%d frames_per_sec=%.0f realtime_x=%.1f "
+        "cpu_us_per_channel_period=%.2f allocs_per_period=%.2f latency_p50_us=%.1f latency_p99_us=%.1f served=%llu dropped=%llu\n",
+        mix->name, nchan, qdepth, mix->resample ? engine_name(engine) : "none", periods,
+        periods * 1e9 / wall, periods * PTIME * 1e6 / wall,
+        cpu / 1000.0 / served, (double)allocs / periods, p50, p99, served, dropped);
+    fflush(stdout);
+    delete dev;
+}
+
+int main(int argc, char **argv)
+{
+    int periods = argc > 1 ? atoi(argv[1]) : 500;
+    static const int chans[] = {1, 4, 16};
+    static const int depths[] = {4, 15};
+    static const int engines[] = {RESAMPLE_ENGINE_SRC, RESAMPLE_ENGINE_FIXED};
+
+    /* 440Hz/1000Hz双声道正弦加少量噪声 */
+    srand(1);
+    for (int i = 0; i < SOURCE_PERIODS * PERIOD_FRAMES; i++)
+    {
+        s_source[i * 2] = (short)(8000 * sin(2 * M_PI * 440 * i / RATE) + rand() % 64 - 32);
+        s_source[i * 2 + 1] = (short)(8000 * sin(2 * M_PI * 1000 * i / RATE) + rand() % 64 - 32);
+    }
+
+    for (size_t m = 0; m < sizeof(s_mixes) / sizeof(s_mixes[0]); m++)
+        for (size_t c = 0; c < sizeof(chans) / sizeof(chans[0]); c++)
+            for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+                for (size_t e = 0; e < (s_mixes[m].resample ? 2 : 1); e++)
+                    run_case(&s_mixes[m], chans[c], depths[d], engines[e], periods, s_source);
+
+    return 0;
+}
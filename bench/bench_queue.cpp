@@ -0,0 +1,214 @@
+/*
+ * 帧队列微基准：原PcmFrameQueueOps_t(std::queue+互斥锁)、每通道一个PcmFrameRing_t、
+ * 所有通道共享一个PcmFrameRing_t三种方式对比
+ * 一个生产者线程模拟捕获线程向N个通道投递帧，每个通道一个消费者线程取帧
+ * 输出：每种队列、每种通道数下捕获线程每帧耗时、消费者取帧数、丢帧数、堆分配次数
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <queue>
+
+#include "mutex.h"
+#include "pcmring.h"
+#include "benchalloc.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// 原实现，仅作对比
+typedef struct PcmFrame_t
+{
+    PcmFrame_t() {size = 0; data = NULL;}
+    bool setFrame(const char *pdata, int sz)
+    {
+        data = new char[sz];
+        size = sz;
+        memcpy(data, pdata, sz);
+        return true;
+    }
+    void releaseFrame() {if (data) delete []data; data = NULL; size = 0;}
+    int size;
+    char *data;
+}PcmFrame_t;
+
+typedef struct PcmFrameQueueOps_t
+{
+    Mutex lock;
+    Condition cond;
+    std::queue<PcmFrame_t> frameQueue;
+    int queueDepth;
+
+    PcmFrameQueueOps_t() {queueDepth = 4;}
+    bool getFrame(PcmFrame_t &frame, int timeout_ms)
+    {
+        MutexLockGuard mutexlockGuard(&lock);
+        if (frameQueue.size() == 0)
+        {
+            if (cond.timedWait(&lock, timeout_ms) && frameQueue.size())
+            {
+                frame = frameQueue.front();
+                frameQueue.pop();
+                return true;
+            }
+            return false;
+        }
+        frame = frameQueue.front();
+        frameQueue.pop();
+        return true;
+    }
+    void putFrame(const char *pData, int dwSize)
+    {
+        MutexLockGuard mutexlockGuard(&lock);
+        PcmFrame_t stFrame;
+        if (stFrame.setFrame(pData, dwSize))
+            frameQueue.push(stFrame);
+        if ((int)frameQueue.size() > queueDepth)
+        {
+            frameQueue.front().releaseFrame();
+            frameQueue.pop();
+        }
+        cond.signal();
+    }
+}PcmFrameQueueOps_t;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+#define FRAME_BYTES 640 // 16000Hz 1chn 16bit 20ms
+#define FRAMES 20000
+#define MAX_CHN 256
+
+enum
+{
+    QUEUE_LEGACY = 0,
+    QUEUE_RING, // 每通道一个环形缓冲
+    QUEUE_SHARED, // 共享环形缓冲
+};
+static const char *queue_name[] = {"legacy", "ring", "shared"};
+
+typedef struct BenchChn_t
+{
+    PcmFrameQueueOps_t legacy;
+    PcmFrameRing_t ring;
+    PcmFrameRing_t *source; // 读取的环形缓冲
+    PcmRingReader_t reader;
+    bool use_ring;
+    volatile bool running;
+    unsigned long received;
+}BenchChn_t;
+
+/* 生产者线程自身的CPU时间，不受消费者线程抢占影响 */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *consumer(void *param)
+{
+    BenchChn_t *ch = (BenchChn_t *)param;
+    char buf[FRAME_BYTES];
+
+    while (__atomic_load_n(&ch->running, __ATOMIC_ACQUIRE))
+    {
+        if (ch->use_ring)
+        {
+            if (ch->reader.getFrame(ch->source, buf, sizeof(buf), 10) > 0)
+                ch->received++;
+        }
+        else
+        {
+            PcmFrame_t frame;
+            if (ch->legacy.getFrame(frame, 10))
+            {
+                memcpy(buf, frame.data, frame.size);
+                frame.releaseFrame();
+                ch->received++;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void run(int mode, int nchn)
+{
+    BenchChn_t *chns = new BenchChn_t[nchn];
+    PcmFrameRing_t shared;
+    pthread_t tids[MAX_CHN];
+    char frame[FRAME_BYTES];
+    memset(frame, 0x5a, sizeof(frame));
+    shared.create(64, FRAME_BYTES);
+
+    for (int i = 0; i < nchn; i++)
+    {
+        chns[i].use_ring = (mode != QUEUE_LEGACY);
+        chns[i].running = true;
+        chns[i].received = 0;
+        if (mode == QUEUE_SHARED)
+        {
+            chns[i].source = &shared;
+        }
+        else
+        {
+            chns[i].ring.create(8, FRAME_BYTES);
+            chns[i].source = &chns[i].ring;
+        }
+        chns[i].reader.attach(chns[i].source);
+        pthread_create(&tids[i], NULL, consumer, &chns[i]);
+    }
+
+    unsigned long allocs = bench_allocs();
+    double t0 = now_sec();
+    for (int n = 0; n < FRAMES; n++)
+    {
+        if (mode == QUEUE_SHARED)
+        {
+            shared.putFrame(frame, sizeof(frame));
+            continue;
+        }
+        for (int i = 0; i < nchn; i++)
+        {
+            if (mode == QUEUE_RING)
+                chns[i].ring.putFrame(frame, sizeof(frame));
+            else
+                chns[i].legacy.putFrame(frame, sizeof(frame));
+        }
+    }
+    double t1 = now_sec();
+    allocs = bench_allocs() - allocs;
+
+    unsigned long received = 0;
+    for (int i = 0; i < nchn; i++)
+    {
+        __atomic_store_n(&chns[i].running, false, __ATOMIC_RELEASE);
+        pthread_join(tids[i], NULL);
+        received += chns[i].received;
+    }
+    unsigned long total = (unsigned long)FRAMES * nchn;
+    printf("queue=%s channels=%d frame_cpu_ns=%.1f received=%lu dropped=%lu allocs_per_frame=%.2f\n",
+        queue_name[mode], nchn, (t1 - t0) * 1e9 / FRAMES,
+        received, total - received, (double)allocs / FRAMES);
+
+    for (int i = 0; i < nchn; i++)
+    {
+        while (chns[i].legacy.frameQueue.size())
+        {
+            chns[i].legacy.frameQueue.front().releaseFrame();
+            chns[i].legacy.frameQueue.pop();
+        }
+    }
+    delete []chns;
+}
+
+int main(void)
+{
+    int counts[] = {1, 8, 64, MAX_CHN};
+    for (unsigned int i = 0; i < sizeof(counts)/sizeof(counts[0]); i++)
+    {
+        run(QUEUE_LEGACY, counts[i]);
+        run(QUEUE_RING, counts[i]);
+        run(QUEUE_SHARED, counts[i]);
+    }
+    return 0;
+}
+
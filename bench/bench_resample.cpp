@@ -0,0 +1,265 @@
+/*
+ * 重采样引擎基准：libsamplerate SRC_SINC_MEDIUM_QUALITY对比内置定点多相FIR
+ * CPU：10秒音频按20ms一帧转换的线程CPU时间
+ * 质量：通带内单音输出的信噪比(最小二乘拟合正弦后残差为噪声，包含混叠/镜像和量化误差)，
+ * 降采样时另测输出奈奎斯特频率以上单音的混叠抑制
+ * 批量一致性：同一输入逐个周期resample_run()与按不同批量大小resample_run_batch()的输出逐点比较，
+ * 16bit输出应完全相同，浮点输出只有舍入级的差
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "resampler.h"
+
+#define PTIME 20
+#define SECONDS 10
+#define AMPLITUDE 16384.0 // -6dBFS
+#define CHECK_PERIODS 200
+#define CHECK_BATCH 8
+
+typedef struct
+{
+    unsigned int rate_in;
+    unsigned int rate_out;
+}RateCase_t;
+
+static const RateCase_t s_cases[] =
+{
+    {16000, 8000},
+    {8000, 16000},
+    {48000, 16000},
+    {16000, 44100},
+    {16000, 22050},
+    {48000, 8000},
+};
+
+static const char *engine_name(int engine)
+{
+    return engine == RESAMPLE_ENGINE_FIXED ? "fixed" : "src_medium";
+}
+
+static double thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * 以单音freq转换SECONDS秒，输出写入out(调用者分配)，返回输出点数，cpu_ns返回CPU时间
+ */
+static int run_tone(int engine, const RateCase_t *c, double freq, short *out, double *cpu_ns)
+{
+    CResampleEx rs;
+    unsigned int in_frames = c->rate_in * PTIME / 1000;
+    if (rs.resample_create(true, false, 1, c->rate_in, c->rate_out, in_frames, engine) != 0)
+        return -1;
+    if (rs.resample_get_engine() != engine)
+        return -1;
+
+    unsigned int out_frames = rs.resample_get_output_size();
+    short *in = new short[in_frames];
+    int frames = SECONDS * 1000 / PTIME;
+    int total = 0;
+    double t = 0;
+
+    for (int f = 0; f < frames; f++)
+    {
+        for (unsigned int i = 0; i < in_frames; i++)
+            in[i] = (short)lrint(AMPLITUDE * sin(2 * M_PI * freq * ((double)f * in_frames + i) / c->rate_in));
+        double t0 = thread_cpu_ns();
+        rs.resample_run(in, out + total);
+        t += thread_cpu_ns() - t0;
+        total += out_frames;
+    }
+    delete []in;
+    if (cpu_ns)
+        *cpu_ns = t;
+    return total;
+}
+
+/*
+ * 逐个周期与批量处理同一段输入(单音加噪声)，批量大小按1~CHECK_BATCH变化，
+ * 返回16bit输出不同的点数，max_diff/float_diff返回16bit和浮点输出的最大差
+ */
+static int batch_check(const RateCase_t *c, unsigned int chan, int *max_diff, double *float_diff)
+{
+    CResampleEx one, many, one_f, many_f;
+    unsigned int in_frames = c->rate_in * PTIME / 1000;
+    unsigned int in_samples = in_frames * chan;
+    one.resample_create(true, false, chan, c->rate_in, c->rate_out, in_samples);
+    many.resample_create(true, false, chan, c->rate_in, c->rate_out, in_samples);
+    one_f.resample_create(true, false, chan, c->rate_in, c->rate_out, in_samples);
+    many_f.resample_create(true, false, chan, c->rate_in, c->rate_out, in_samples);
+    unsigned int batch = many.resample_set_batch(CHECK_BATCH);
+    many_f.resample_set_batch(CHECK_BATCH);
+
+    unsigned int out_samples = one.resample_get_output_size();
+    short *in = new short[in_samples * CHECK_PERIODS];
+    float *in_f = new float[in_samples * CHECK_PERIODS];
+    short *a = new short[out_samples * CHECK_PERIODS], *b = new short[out_samples * CHECK_PERIODS];
+    float *a_f = new float[out_samples * CHECK_PERIODS], *b_f = new float[out_samples * CHECK_PERIODS];
+    unsigned int seed = 1;
+    for (unsigned int i = 0; i < in_samples * CHECK_PERIODS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        double v = 0.5 * sin(2 * M_PI * 440.0 * (i / chan) / c->rate_in) + ((seed >> 16) & 0x7FFF) / 32768.0 * 0.1;
+        in[i] = (short)lrint(v * AMPLITUDE);
+        in_f[i] = (float)(v * 0.5);
+    }
+
+    for (int p = 0; p < CHECK_PERIODS; p++)
+    {
+        one.resample_run(in + p * in_samples, a + p * out_samples);
+        one_f.resample_run_float(in_f + p * in_samples, a_f + p * out_samples);
+    }
+    for (int p = 0, n = 0; p < CHECK_PERIODS; p += n)
+    {
+        n = (int)(p % batch) + 1; // 1,2,3...batch循环，各周期落在批内不同的位置
+        if (n > CHECK_PERIODS - p)
+            n = CHECK_PERIODS - p;
+        for (int i = 0; i < n; i++)
+        {
+            many.resample_load(i, in + (p + i) * in_samples);
+            memcpy(many_f.resample_batch_input(i), in_f + (p + i) * in_samples, in_samples * sizeof(float));
+        }
+        many.resample_run_batch(n);
+        many_f.resample_run_batch(n);
+        for (int i = 0; i < n; i++)
+        {
+            many.resample_fetch(i, b + (p + i) * out_samples);
+            memcpy(b_f + (p + i) * out_samples, many_f.resample_batch_output(i), out_samples * sizeof(float));
+        }
+    }
+
+    int mismatched = 0;
+    *max_diff = 0;
+    *float_diff = 0;
+    for (unsigned int i = 0; i < out_samples * CHECK_PERIODS; i++)
+    {
+        int d = abs(a[i] - b[i]);
+        mismatched += (d != 0);
+        if (d > *max_diff)
+            *max_diff = d;
+        if (fabs(a_f[i] - b_f[i]) > *float_diff)
+            *float_diff = fabs(a_f[i] - b_f[i]);
+    }
+    delete []in;
+    delete []in_f;
+    delete []a;
+    delete []b;
+    delete []a_f;
+    delete []b_f;
+    return mismatched;
+}
+
+/* 对y拟合a*sin+b*cos+c，返回拟合正弦的功率与残差功率 */
+static void fit_tone(const short *y, int n, double freq, unsigned int rate, double *signal, double *noise)
+{
+    double m[3][4] = {{0}};
+    for (int i = 0; i < n; i++)
+    {
+        double w = 2 * M_PI * freq * i / rate;
+        double v[3] = {sin(w), cos(w), 1.0};
+        for (int r = 0; r < 3; r++)
+        {
+            for (int k = 0; k < 3; k++)
+                m[r][k] += v[r] * v[k];
+            m[r][3] += v[r] * y[i];
+        }
+    }
+    for (int r = 0; r < 3; r++) // 高斯消元
+    {
+        for (int k = r + 1; k < 3; k++)
+        {
+            double f = m[k][r] / m[r][r];
+            for (int j = r; j < 4; j++)
+                m[k][j] -= f * m[r][j];
+        }
+    }
+    double x[3];
+    for (int r = 2; r >= 0; r--)
+    {
+        x[r] = m[r][3];
+        for (int k = r + 1; k < 3; k++)
+            x[r] -= m[r][k] * x[k];
+        x[r] /= m[r][r];
+    }
+
+    double ps = 0, pn = 0;
+    for (int i = 0; i < n; i++)
+    {
+        double w = 2 * M_PI * freq * i / rate;
+        double s = x[0] * sin(w) + x[1] * cos(w);
+        double e = y[i] - s - x[2];
+        ps += s * s;
+        pn += e * e;
+    }
+    *signal = ps / n;
+    *noise = pn / n;
+}
+
+int main(void)
+{
+    const int engines[] = {RESAMPLE_ENGINE_SRC, RESAMPLE_ENGINE_FIXED};
+    short *out = new short[48000 * SECONDS + 4096];
+
+    for (unsigned int i = 0; i < sizeof(s_cases)/sizeof(s_cases[0]); i++)
+    {
+        const RateCase_t *c = &s_cases[i];
+        double nyq = (c->rate_in < c->rate_out ? c->rate_in : c->rate_out) / 2.0;
+        const double tones[] = {0.1 * nyq, 0.4 * nyq, 0.7 * nyq};
+
+        for (unsigned int e = 0; e < sizeof(engines)/sizeof(engines[0]); e++)
+        {
+            char line[512];
+            int len = 0;
+            double cpu_ns = 0;
+            if (run_tone(engines[e], c, tones[0], out, &cpu_ns) < 0)
+            {
+                printf("%u->%u engine=%s unsupported\n", c->rate_in, c->rate_out, engine_name(engines[e]));
+                continue;
+            }
+            len += snprintf(line + len, sizeof(line) - len, "%u->%u engine=%s cpu=%.1f us/frame (%.3f%% of realtime)",
+                c->rate_in, c->rate_out, engine_name(engines[e]),
+                cpu_ns / 1000 / (SECONDS * 1000 / PTIME), cpu_ns / (SECONDS * 1e9) * 100);
+
+            for (unsigned int t = 0; t < sizeof(tones)/sizeof(tones[0]); t++)
+            {
+                int total = run_tone(engines[e], c, tones[t], out, NULL);
+                int skip = c->rate_out / 5; // 跳过开头200ms的滤波器建立过程
+                double ps, pn;
+                fit_tone(out + skip, total - skip, tones[t], c->rate_out, &ps, &pn);
+                len += snprintf(line + len, sizeof(line) - len, " snr@%.0fHz=%.1fdB", tones[t], 10 * log10(ps / (pn > 0 ? pn : 1e-9)));
+            }
+
+            if (c->rate_out < c->rate_in) // 混叠：输出奈奎斯特以上的单音应被滤除
+            {
+                double alias = c->rate_out / 2.0 * 1.3;
+                int total = run_tone(engines[e], c, alias, out, NULL);
+                int skip = c->rate_out / 5;
+                double p = 0;
+                for (int k = skip; k < total; k++)
+                    p += (double)out[k] * out[k];
+                p /= (total - skip);
+                len += snprintf(line + len, sizeof(line) - len, " alias@%.0fHz=%.1fdB", alias, 10 * log10((p > 0 ? p : 1e-9) / (AMPLITUDE * AMPLITUDE / 2)));
+            }
+            printf("%s\n", line);
+        }
+
+        for (unsigned int chan = 1; chan <= 2; chan++)
+        {
+            int max_diff;
+            double float_diff;
+            int mismatched = batch_check(c, chan, &max_diff, &float_diff);
+            printf("%u->%u engine=src_medium batch_check ch=%u periods=%d mismatched=%d max_diff=%d float_max_diff=%g\n",
+                c->rate_in, c->rate_out, chan, CHECK_PERIODS, mismatched, max_diff, float_diff);
+        }
+    }
+    delete []out;
+    return 0;
+}
+
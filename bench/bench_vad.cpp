@@ -0,0 +1,82 @@
+/*
+ * 语音检测基准：外部写入交替的语音(带噪声的正弦)和静音，对比普通通道和只读语音的通道
+ * 读到的帧数，输出一行key=value：静音比例、两种通道的帧数、下游工作量的减少比例、
+ * 每个周期检测的耗时(开启与不开启语音检测的写入耗时之差)
+ * 用法：bench_vad [静音比例%，默认70] [周期数，默认5000] [采样率，默认16000] [声道数，默认1]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio.h"
+
+/* 每3秒一个段落，前silence%为静音，其余为语音；语音段后的拖尾仍会送给只读语音的通道 */
+static void make_period(short *buf, int frames, unsigned int channel, unsigned int rate, int period, int silence,
+    unsigned int *seed)
+{
+    int cycle = 150;
+    bool speech = (period % cycle) >= cycle * silence / 100;
+    for (int i = 0; i < frames; i++)
+    {
+        *seed = *seed * 1103515245 + 12345;
+        int noise = (int)((*seed >> 16) & 63) - 32;
+        double t = (double)(period * frames + i) / rate;
+        short v = speech ? (short)(6000 * sin(2 * M_PI * 300 * t) * (0.6 + 0.4 * sin(2 * M_PI * 3 * t))) : 0;
+        for (unsigned int c = 0; c < channel; c++)
+            buf[i * channel + c] = v + noise;
+    }
+}
+
+static double run(bool vad, int silence, int periods, unsigned int rate, unsigned int channel,
+    unsigned long long *all_frames, unsigned long long *speech_frames)
+{
+    PcmEventLoop loop;
+    PcmRecord *dev = new PcmRecord(&loop, "bench");
+    dev->startExternal(rate, channel, PCM_FMT_S16, 20);
+    void *all = dev->createChannel(rate, channel, PCM_FMT_S16);
+    void *speech = dev->createChannel(rate, channel, PCM_FMT_S16);
+    dev->setChannelSpeechOnly(speech, true);
+    dev->setVad(vad, NULL);
+
+    int frames = rate / 50;
+    short *buf = new short[frames * channel];
+    char *out = new char[PCM_PERIOD_MAX_BYTES];
+    unsigned int seed = 1;
+    double cost = 0;
+    *all_frames = *speech_frames = 0;
+    for (int p = 0; p < periods; p++)
+    {
+        make_period(buf, frames, channel, rate, p, silence, &seed);
+        double t0 = pcm_now_ns();
+        dev->pushFrame((const char *)buf, frames * channel * 2);
+        cost += pcm_now_ns() - t0;
+        while (dev->readChannel(all, out, PCM_PERIOD_MAX_BYTES, 0) > 0)
+            (*all_frames)++;
+        while (dev->readChannel(speech, out, PCM_PERIOD_MAX_BYTES, 0) > 0)
+            (*speech_frames)++;
+    }
+    delete []buf;
+    delete []out;
+    dev->destroyChannel(all);
+    dev->destroyChannel(speech);
+    delete dev;
+    return cost / periods;
+}
+
+int main(int argc, char *argv[])
+{
+    int silence = argc > 1 ? atoi(argv[1]) : 70;
+    int periods = argc > 2 ? atoi(argv[2]) : 5000;
+    unsigned int rate = argc > 3 ? atoi(argv[3]) : 16000;
+    unsigned int channel = argc > 4 ? atoi(argv[4]) : 1;
+
+    unsigned long long all = 0, speech = 0, base_all = 0, base_speech = 0;
+    double base = run(false, silence, periods, rate, channel, &base_all, &base_speech);
+    double with = run(true, silence, periods, rate, channel, &all, &speech);
+    printf("capture=%u/%u silence_pct=%d periods=%d frames_all=%llu frames_speech_only=%llu downstream_reduction_pct=%.1f "
+        "push_ns=%.0f push_vad_ns=%.0f vad_ns_per_period=%.0f isa=%s\n",
+        rate, channel, silence, periods, all, speech, all ? 100.0 * (all - speech) / all : 0.0,
+        base, with, with - base, pcm_kernels()->isa);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * 基准测试的堆分配计数：malloc/calloc/realloc经链接选项--wrap包装后计数，operator new/delete改为调用malloc/free，
+ * 同样计入。--wrap只作用于参与链接的目标文件(基准测试和库的源文件)，libsamplerate等动态库内部的分配不经过包装，
+ * src_new()包装后按一次分配计
+ * 每个可执行文件只能由一个源文件包含，链接选项见Makefile的BENCH_WRAP
+ */
+#ifndef __FREE_BENCH_ALLOC_H__
+#define __FREE_BENCH_ALLOC_H__
+#include <stdlib.h>
+#include <new>
+
+#include "samplerate.h"
+
+static unsigned long g_allocs = 0;
+
+extern "C"
+{
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+SRC_STATE *__real_src_new(int converter_type, int channels, int *error);
+
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+SRC_STATE *__wrap_src_new(int converter_type, int channels, int *error)
+{
+    __atomic_add_fetch(&g_allocs, 1, __ATOMIC_RELAXED);
+    return __real_src_new(converter_type, channels, error);
+}
+}
+
+/* libstdc++自带的operator new在动态库内调用malloc，不经过--wrap，这里改为调用包装后的malloc */
+void *operator new(size_t sz)
+{
+    void *p = malloc(sz ? sz : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t sz) {return operator new(sz);}
+void operator delete(void *p) throw() {free(p);}
+void operator delete[](void *p) throw() {free(p);}
+void operator delete(void *p, size_t) throw() {free(p);}
+void operator delete[](void *p, size_t) throw() {free(p);}
+
+/* 到目前为止的分配次数，两次读取之差为区间内的分配次数 */
+static inline unsigned long bench_allocs(void)
+{
+    return __atomic_load_n(&g_allocs, __ATOMIC_RELAXED);
+}
+
+#endif
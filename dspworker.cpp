@@ -0,0 +1,223 @@
+/*
+ * DSP工作线程池：每个线程一个任务队列，空闲时从其他线程的队列窃取任务
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "dspworker.h"
+#include "pcmring.h"
+
+DspWorkerPool::DspWorkerPool()
+{
+    m_threads = 0;
+    m_running = false;
+    m_next = 0;
+    m_signal = 0;
+    m_idle = 0;
+    pcm_sched_init(&m_sched);
+    m_tasks = m_steals = m_maxWait = 0;
+}
+
+DspWorkerPool::~DspWorkerPool()
+{
+    stop();
+}
+
+bool DspWorkerPool::start(int threads)
+{
+    if (m_running)
+        return true;
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+
+    m_running = true;
+    m_threads = threads;
+    for (int i = 0; i < threads; i++)
+    {
+        DspWorker_t *worker = new DspWorker_t;
+        worker->pool = this;
+        worker->index = i;
+        worker->threadId = 0;
+        m_workers.push_back(worker);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&m_workers[i]->threadId, NULL, WorkerThreadStub, m_workers[i]) != 0)
+        {
+            printf("dsp worker %d create failed\n", i);
+            m_workers[i]->threadId = 0;
+        }
+    }
+    if (m_sched.policy != SCHED_OTHER || m_sched.cpu_count > 0)
+        setSched(&m_sched);
+    return true;
+}
+
+void DspWorkerPool::stop(void)
+{
+    if (!m_running)
+        return;
+
+    __atomic_store_n(&m_running, false, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&m_signal, 1, __ATOMIC_SEQ_CST);
+    pcm_futex_wake(&m_signal);
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        if (m_workers[i]->threadId)
+            pthread_join(m_workers[i]->threadId, NULL);
+    }
+
+    /* 线程退出后残留的任务就地执行，任务可能持有资源引用 */
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        DspWorker_t *worker = m_workers[i];
+        while (!worker->tasks.empty())
+        {
+            DspTask_t task = worker->tasks.front();
+            worker->tasks.pop_front();
+            runTask(task);
+        }
+        delete worker;
+    }
+    m_workers.clear();
+}
+
+void DspWorkerPool::submit(DspTaskFunc func, void *obj, void *arg)
+{
+    DspTask_t task;
+    task.func = func;
+    task.obj = obj;
+    task.arg = arg;
+    task.submit_ns = pcm_now_ns();
+
+    unsigned int next = __atomic_fetch_add(&m_next, 1, __ATOMIC_RELAXED);
+    DspWorker_t *worker = m_workers[next % m_workers.size()];
+    {
+        MutexLockGuard mutexlockGuard(&worker->lock);
+        worker->tasks.push_back(task);
+    }
+
+    __atomic_add_fetch(&m_signal, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_idle, __ATOMIC_SEQ_CST) > 0)
+        pcm_futex_wake(&m_signal);
+}
+
+void DspWorkerPool::getStats(DspPoolStat_t *stat)
+{
+    stat->threads = m_threads;
+    stat->tasks = __atomic_load_n(&m_tasks, __ATOMIC_RELAXED);
+    stat->steals = __atomic_load_n(&m_steals, __ATOMIC_RELAXED);
+    stat->max_wait_ns = __atomic_load_n(&m_maxWait, __ATOMIC_RELAXED);
+}
+
+bool DspWorkerPool::setSched(const PcmThreadSched_t *sched)
+{
+    bool ok = true;
+    m_sched = *sched;
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        char who[32];
+        if (!m_workers[i]->threadId)
+            continue;
+        snprintf(who, sizeof(who), "dsp worker %d", (int)i);
+        if (!pcm_sched_apply(m_workers[i]->threadId, &m_sched, who))
+            ok = false;
+    }
+    return ok;
+}
+
+void *DspWorkerPool::WorkerThreadStub(void *param)
+{
+    DspWorker_t *worker = (DspWorker_t *)param;
+    worker->pool->WorkerThread(worker);
+    return NULL;
+}
+
+/*
+ * 先取自己队列尾部的任务，没有再从其他队列头部窃取
+ */
+bool DspWorkerPool::takeTask(DspWorker_t *self, DspTask_t *task, bool *stolen)
+{
+    {
+        MutexLockGuard mutexlockGuard(&self->lock);
+        if (!self->tasks.empty())
+        {
+            *task = self->tasks.back();
+            self->tasks.pop_back();
+            *stolen = false;
+            return true;
+        }
+    }
+
+    int count = (int)m_workers.size();
+    for (int i = 1; i < count; i++)
+    {
+        DspWorker_t *victim = m_workers[(self->index + i) % count];
+        if (!victim->lock.trylock())
+            continue; // 对方正忙，换下一个
+        if (!victim->tasks.empty())
+        {
+            *task = victim->tasks.front();
+            victim->tasks.pop_front();
+            victim->lock.unlock();
+            *stolen = true;
+            return true;
+        }
+        victim->lock.unlock();
+    }
+    return false;
+}
+
+void DspWorkerPool::runTask(const DspTask_t &task)
+{
+    unsigned long long wait = pcm_now_ns() - task.submit_ns;
+    unsigned long long max = __atomic_load_n(&m_maxWait, __ATOMIC_RELAXED);
+    while (wait > max && !__atomic_compare_exchange_n(&m_maxWait, &max, wait, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    task.func(task.obj, task.arg);
+    __atomic_add_fetch(&m_tasks, 1, __ATOMIC_RELAXED);
+}
+
+void DspWorkerPool::WorkerThread(DspWorker_t *self)
+{
+    DspTask_t task;
+    bool stolen = false;
+
+    if (pcm_memory_locked())
+        pcm_prefault_stack();
+    while (true)
+    {
+        if (takeTask(self, &task, &stolen))
+        {
+            runTask(task);
+            if (stolen)
+                __atomic_add_fetch(&m_steals, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        __atomic_add_fetch(&m_idle, 1, __ATOMIC_SEQ_CST);
+        unsigned int signal = __atomic_load_n(&m_signal, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&m_running, __ATOMIC_SEQ_CST))
+        {
+            __atomic_sub_fetch(&m_idle, 1, __ATOMIC_SEQ_CST);
+            break; // 残留任务由stop()执行
+        }
+        if (takeTask(self, &task, &stolen)) // 登记空闲后再查一次，避免漏掉唤醒
+        {
+            __atomic_sub_fetch(&m_idle, 1, __ATOMIC_SEQ_CST);
+            runTask(task);
+            if (stolen)
+                __atomic_add_fetch(&m_steals, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        pcm_futex_wait(&m_signal, signal, 1000);
+        __atomic_sub_fetch(&m_idle, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
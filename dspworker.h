@@ -0,0 +1,83 @@
+/*
+ * DSP工作线程池：每个线程一个任务队列，空闲时从其他线程的队列窃取任务
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_DSP_WORKER_H__
+#define __FREE_DSP_WORKER_H__
+#include <pthread.h>
+#include <deque>
+#include <vector>
+
+#include "mutex.h"
+#include "pcmsched.h"
+
+typedef void (*DspTaskFunc)(void *obj, void *arg);
+
+typedef struct DspTask_t
+{
+    DspTaskFunc func;
+    void *obj;
+    void *arg;
+    long long submit_ns; // 提交时间，统计排队时延
+}DspTask_t;
+
+class DspWorkerPool;
+typedef struct DspWorker_t
+{
+    DspWorkerPool *pool;
+    int index;
+    pthread_t threadId;
+    Mutex lock; // 保护tasks，本线程从尾部取，其他线程从头部窃取
+    std::deque<DspTask_t> tasks;
+}DspWorker_t;
+
+/* 线程池统计 */
+typedef struct DspPoolStat_t
+{
+    int threads;
+    unsigned long long tasks; // 已执行任务数
+    unsigned long long steals; // 其中窃取执行的任务数
+    unsigned long long max_wait_ns; // 任务最长排队时间
+}DspPoolStat_t;
+
+class DspWorkerPool
+{
+public:
+    DspWorkerPool();
+    ~DspWorkerPool();
+
+    /* threads<=0时使用在线CPU核数 */
+    bool start(int threads);
+    /* 停止所有线程，尚未执行的任务在调用线程中执行完 */
+    void stop(void);
+    /* 提交任务，任意线程可调用，不阻塞 */
+    void submit(DspTaskFunc func, void *obj, void *arg);
+    void getStats(DspPoolStat_t *stat);
+    int threads(void) {return m_threads;}
+    /* 所有工作线程的调度策略和CPU亲和性，start()前设置则在创建线程后设置；return：同pcm_sched_apply() */
+    bool setSched(const PcmThreadSched_t *sched);
+
+private:
+    static void *WorkerThreadStub(void *param);
+    void WorkerThread(DspWorker_t *self);
+    bool takeTask(DspWorker_t *self, DspTask_t *task, bool *stolen);
+    void runTask(const DspTask_t &task);
+
+private:
+    std::vector<DspWorker_t *> m_workers;
+    int m_threads;
+    bool m_running;
+    unsigned int m_next; // 轮流投递的起始队列
+    unsigned int m_signal; // 有新任务时递增，空闲线程在其上futex等待
+    int m_idle; // 正在等待的线程数
+    PcmThreadSched_t m_sched;
+
+    unsigned long long m_tasks;
+    unsigned long long m_steals;
+    unsigned long long m_maxWait;
+};
+
+#endif
+
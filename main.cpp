@@ -207,6 +207,9 @@ static void *pfn5(void *param)
 
 int main(int argc, char **argv)
 {
+    if (argc > 1) // ./test <dsp线程数>，开启DSP线程池
+        AI_SetDspThreads(atoi(argv[1]));
+
     make_thread_detached(pfn1, 0);
     make_thread_detached(pfn2, 0);
     make_thread_detached(pfn3, 0);
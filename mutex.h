@@ -48,7 +48,7 @@ public:
 
         clock_gettime(CLOCK_REALTIME, &now);
 
-        unsigned long long absmsec = (now.tv_sec * 1000LL + now.tv_nsec / 1000) + ms;
+        unsigned long long absmsec = (now.tv_sec * 1000LL + now.tv_nsec / 1000000) + ms;
         abstime.tv_sec = absmsec / 1000;
         abstime.tv_nsec = (absmsec % 1000) * 1000000;
 
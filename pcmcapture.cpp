@@ -0,0 +1,419 @@
+/*
+ * ALSA捕获设备：readi或mmap方式按周期读取
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <string.h>
+
+#include "pcmcapture.h"
+#include "pcmlog.h"
+
+PcmCapture::PcmCapture()
+{
+    m_pcmHandle = NULL;
+    m_mode = PCM_CAPTURE_READI;
+    m_htstamp = false;
+    m_samplerate = 0;
+    m_captureFrames = 0;
+    m_captureSize = 0;
+}
+
+PcmCapture::~PcmCapture()
+{
+    close();
+}
+
+static snd_pcm_format_t pcm_capture_format(int format)
+{
+    switch (format)
+    {
+    case PCM_FMT_S16: return SND_PCM_FORMAT_S16_LE;
+    case PCM_FMT_S24_3LE: return SND_PCM_FORMAT_S24_3LE;
+    case PCM_FMT_S32: return SND_PCM_FORMAT_S32_LE;
+    case PCM_FMT_FLOAT: return SND_PCM_FORMAT_FLOAT_LE;
+    default: return SND_PCM_FORMAT_S16_LE;
+    }
+}
+
+bool PcmCapture::open(const char *device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int mode)
+{
+    snd_pcm_format_t pcm_format;
+    int ret = 0, dir = 0;
+    unsigned int sampleRate = samplerate;
+    unsigned int buffer_time, period_time;
+    snd_pcm_uframes_t buffer_size = 0;
+    snd_pcm_hw_params_t *pcm_params; // 配置硬件参数结构体
+    snd_pcm_sw_params_t *sw_params;
+
+    /* 打开一个PCM采集设备 */
+    ret = snd_pcm_open(&m_pcmHandle, device, SND_PCM_STREAM_CAPTURE, 0);
+    if (ret < 0)
+    {
+        LOG("unable to open pcm device %s: %s\n", device, snd_strerror(ret));
+        m_pcmHandle = NULL;
+        return false;
+    }
+
+    /* params申请内存--这是栈内存 */
+    snd_pcm_hw_params_alloca(&pcm_params);
+    /* 使用pcm设备初始化params */
+    ret = snd_pcm_hw_params_any(m_pcmHandle, pcm_params);
+    if (ret < 0)
+    {
+        LOG("config pcm device: %s\n", snd_strerror(ret));
+        goto exit_1;
+    }
+
+    /* 设置多路数据在buffer中的存储方式，左右声道的数据交叉存放
+    MMAP_INTERLEAVED直接访问驱动的DMA缓冲，设备不支持时退回RW_INTERLEAVED */
+    m_mode = PCM_CAPTURE_READI;
+    if (mode == PCM_CAPTURE_MMAP)
+    {
+        ret = snd_pcm_hw_params_set_access(m_pcmHandle, pcm_params, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        if (ret == 0)
+            m_mode = PCM_CAPTURE_MMAP;
+        else
+            LOG("mmap access not available: %s, fallback to readi\n", snd_strerror(ret));
+    }
+    if (m_mode == PCM_CAPTURE_READI)
+    {
+        ret = snd_pcm_hw_params_set_access(m_pcmHandle, pcm_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        if (ret < 0)
+        {
+            LOG("config set_access: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+    }
+
+    /* 设置采样格式 */
+    pcm_format = pcm_capture_format(format);
+    ret = snd_pcm_hw_params_set_format(m_pcmHandle, pcm_params, pcm_format);
+    if (ret < 0)
+    {
+        LOG("config set_format: %s\n", snd_strerror(ret));
+        goto exit_1;
+    }
+
+    /* 设置声道数 */
+    ret = snd_pcm_hw_params_set_channels(m_pcmHandle, pcm_params, channel_cnt);
+    if (ret < 0)
+    {
+        LOG("config set_channel: %s\n", snd_strerror(ret));
+        goto exit_1;
+    }
+
+    /* 设置采样率,如果采样率不支持，会用硬件支持最接近的采样率 */
+    ret = snd_pcm_hw_params_set_rate_near(m_pcmHandle, pcm_params, &sampleRate, &dir);
+    if (ret < 0)
+    {
+        LOG("config set_rate_near: %s\n", snd_strerror(ret));
+        goto exit_1;
+    }
+
+    if (m_profile->buffer_periods > 0)
+    {
+        /* 低延迟：先定周期，缓冲只留几个周期，溢出前捕获线程有这么多周期的时间被调度 */
+        unsigned int periods = m_profile->buffer_periods;
+        period_time = ptime*1000;
+        ret = snd_pcm_hw_params_set_period_time_near(m_pcmHandle, pcm_params, &period_time, 0);
+        if (ret < 0)
+        {
+            LOG("config set_period_time_near: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+        ret = snd_pcm_hw_params_set_periods_near(m_pcmHandle, pcm_params, &periods, 0);
+        if (ret < 0)
+        {
+            LOG("config set_periods_near: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+    }
+    else
+    {
+        /* 获取中最大缓冲时间，单位us */
+        snd_pcm_hw_params_get_buffer_time_max(pcm_params, &buffer_time, 0);
+        if (buffer_time > 1000000)
+            buffer_time = 1000000;
+        /* 设置缓冲时间 */
+        ret = snd_pcm_hw_params_set_buffer_time_near(m_pcmHandle, pcm_params, &buffer_time, 0);
+        if (ret < 0)
+        {
+            LOG("config set_buffer_time_near: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+
+        /* 设置周期 */
+        period_time = ptime*1000; // 20ms
+        ret = snd_pcm_hw_params_set_period_time_near(m_pcmHandle, pcm_params, &period_time, 0);
+        if (ret < 0)
+        {
+            LOG("config set_period_time_near: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+    }
+
+    /* 设置非阻塞--2024-6-6，由事件循环poll到数据后再读 */
+    if (m_nonblock)
+    {
+        ret = snd_pcm_nonblock(m_pcmHandle, 1); // 0 = block, 1 = nonblock mode, 2 = abort
+        if (ret < 0)
+        {
+            LOG("set pcm_nonblock: %s\n", snd_strerror(ret));
+            goto exit_1;
+        }
+    }
+
+    /* 让这些参数作用于PCM设备 */
+    ret = snd_pcm_hw_params(m_pcmHandle, pcm_params);
+    if (ret < 0)
+    {
+        LOG("unable toset hw params: %s\n", snd_strerror(ret));
+        goto exit_1;
+    }
+
+    /* 获取帧大小 */
+    m_samplerate = sampleRate;
+    snd_pcm_hw_params_get_period_size(pcm_params, &m_captureFrames, &dir);
+    snd_pcm_hw_params_get_buffer_size(pcm_params, &buffer_size);
+    m_captureSize = snd_pcm_frames_to_bytes(m_pcmHandle, m_captureFrames);
+
+    /*
+     * 开启驱动时间戳，snd_pcm_htimestamp()给出最近一次硬件指针更新的单调时钟时间；
+     * 按配置设置唤醒阈值avail_min和启动阈值，失败时保持ALSA默认值
+     */
+    m_htstamp = false;
+    snd_pcm_sw_params_alloca(&sw_params);
+    if (snd_pcm_sw_params_current(m_pcmHandle, sw_params) == 0 &&
+        snd_pcm_sw_params_set_tstamp_mode(m_pcmHandle, sw_params, SND_PCM_TSTAMP_ENABLE) == 0 &&
+        snd_pcm_sw_params_set_tstamp_type(m_pcmHandle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC) == 0)
+    {
+        if (m_profile->avail_min > 0)
+        {
+            snd_pcm_uframes_t avail = m_captureFrames * m_profile->avail_min;
+            if (avail > buffer_size / 2) // 至少留一半缓冲给唤醒后的调度延迟
+                avail = buffer_size / 2 > m_captureFrames ? buffer_size / 2 : m_captureFrames;
+            snd_pcm_sw_params_set_avail_min(m_pcmHandle, sw_params, avail);
+        }
+        if (m_profile->start_threshold > 0)
+            snd_pcm_sw_params_set_start_threshold(m_pcmHandle, sw_params, m_profile->start_threshold);
+        ret = snd_pcm_sw_params(m_pcmHandle, sw_params);
+        m_htstamp = (ret == 0);
+        if (ret < 0)
+            LOG("set sw params: %s\n", snd_strerror(ret));
+    }
+
+    LOG("snd_pcm_uframes_t: %lu frame, buffer: %lu frame, profile: %s, access: %s%s\n", m_captureFrames, buffer_size,
+        m_profile->name, pcm_capture_mode_name(m_mode), m_nonblock ? ", nonblock" : "");
+
+    /* 没有阻塞的读取来启动捕获，poll之前先启动 */
+    if (m_nonblock)
+        snd_pcm_start(m_pcmHandle);
+    return true;
+
+exit_1:
+    snd_pcm_close(m_pcmHandle);
+    m_pcmHandle = NULL;
+    return false;
+}
+
+/*
+ * 关闭plug层的重采样后逐个测试标准采样率，得到硬件原生支持的采样率
+ * return：设备打不开或没有可用的采样率返回false
+ */
+bool PcmCapture::probe(const char *device, int format, PcmCaptureCaps_t *caps)
+{
+    static const unsigned int std_rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000};
+    snd_pcm_t *handle = NULL;
+    snd_pcm_hw_params_t *params;
+
+    memset(caps, 0, sizeof(*caps));
+    int ret = snd_pcm_open(&handle, device, SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+    if (ret < 0)
+    {
+        LOG("probe %s: %s\n", device, snd_strerror(ret));
+        return false;
+    }
+
+    snd_pcm_hw_params_alloca(&params);
+    if (snd_pcm_hw_params_any(handle, params) >= 0)
+    {
+        snd_pcm_hw_params_set_rate_resample(handle, params, 0);
+        snd_pcm_hw_params_set_format(handle, params, pcm_capture_format(format));
+        for (unsigned int i = 0; i < sizeof(std_rates) / sizeof(std_rates[0]) && caps->rate_count < PCM_CAPTURE_MAX_RATES; i++)
+        {
+            if (snd_pcm_hw_params_test_rate(handle, params, std_rates[i], 0) == 0)
+                caps->rates[caps->rate_count++] = std_rates[i];
+        }
+        snd_pcm_hw_params_get_channels_min(params, &caps->min_channels);
+        snd_pcm_hw_params_get_channels_max(params, &caps->max_channels);
+    }
+    snd_pcm_close(handle);
+
+    LOG("probe %s: %d rates (%u~%u), channels %u~%u\n", device, caps->rate_count,
+        caps->rate_count ? caps->rates[0] : 0, caps->rate_count ? caps->rates[caps->rate_count - 1] : 0,
+        caps->min_channels, caps->max_channels);
+    return caps->rate_count > 0;
+}
+
+void PcmCapture::close(void)
+{
+    if (m_pcmHandle)
+    {
+        snd_pcm_drain(m_pcmHandle);
+        snd_pcm_close(m_pcmHandle);
+        m_pcmHandle = NULL;
+    }
+}
+
+/*
+ * -EPIPE为xrun，重新prepare后继续；其他错误交给调用者按读取失败处理
+ */
+void PcmCapture::recover(int err)
+{
+    if (err == -EPIPE) // -EPIPE for the xrun and -ESTRPIPE for the suspended status
+    {
+        LOG("overrun...\n");
+        pcm_stat_add(&m_xruns, 1);
+        snd_pcm_prepare(m_pcmHandle);
+        if (m_nonblock)
+            snd_pcm_start(m_pcmHandle);
+    }
+    else
+    {
+        LOG("error read: %d, %s\n", err, snd_strerror(err)); // -ENODEV
+    }
+}
+
+/*
+ * 从映射的DMA缓冲取frames帧到buffer，DMA缓冲回绕时分两段拷贝
+ * return：读取的帧数，失败返回负的错误码，超时返回0
+ */
+snd_pcm_sframes_t PcmCapture::readMmap(char *buffer, snd_pcm_uframes_t frames)
+{
+    snd_pcm_uframes_t got = 0;
+
+    while (got < frames)
+    {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcmHandle);
+        if (avail < 0)
+            return avail;
+
+        if ((snd_pcm_uframes_t)avail < frames - got)
+        {
+            if (m_nonblock && got == 0) // 还没有拷贝，等下一次poll
+                return -EAGAIN;
+            /* mmap方式没有readi自动启动，prepare之后要手动start */
+            if (snd_pcm_state(m_pcmHandle) == SND_PCM_STATE_PREPARED)
+            {
+                int ret = snd_pcm_start(m_pcmHandle);
+                if (ret < 0)
+                    return ret;
+            }
+            int ret = snd_pcm_wait(m_pcmHandle, PCM_CAPTURE_WAIT_MS);
+            if (ret < 0)
+                return ret;
+            if (ret == 0)
+                return 0;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas = NULL;
+        snd_pcm_uframes_t offset = 0, size = frames - got;
+        int ret = snd_pcm_mmap_begin(m_pcmHandle, &areas, &offset, &size);
+        if (ret < 0)
+            return ret;
+
+        /* 交错格式所有声道在同一块区域，areas[0]的步长就是一帧的位数 */
+        const char *src = (const char *)areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+        memcpy(buffer + snd_pcm_frames_to_bytes(m_pcmHandle, got), src, snd_pcm_frames_to_bytes(m_pcmHandle, size));
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcmHandle, offset, size);
+        if (committed < 0)
+            return committed;
+        if ((snd_pcm_uframes_t)committed != size)
+            return -EPIPE;
+        got += size;
+    }
+    return got;
+}
+
+/*
+ * 下一个待读采样的捕获时间，读取之前调用
+ * 时间戳时刻缓冲中有avail帧未读，最旧的一帧早avail/rate被采集
+ */
+long long PcmCapture::frameTimestamp(void)
+{
+    snd_pcm_uframes_t avail = 0;
+    snd_htimestamp_t ts;
+
+    if (!m_htstamp || snd_pcm_htimestamp(m_pcmHandle, &avail, &ts) < 0 || (ts.tv_sec == 0 && ts.tv_nsec == 0))
+    {
+        snd_pcm_sframes_t n = snd_pcm_avail_update(m_pcmHandle);
+        avail = n > 0 ? n : 0;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    }
+    long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    return m_samplerate ? now - (long long)avail * 1000000000LL / m_samplerate : now;
+}
+
+/*
+ * 读取一帧PCM数据
+ * buffer：保存读取的PCM数据
+ * buflen：buffer长度，单位字节
+ * return：返回实际读取的字节数，失败返回0，非阻塞模式下暂无数据返回PCM_CAPTURE_AGAIN
+ */
+int PcmCapture::read(char *buffer, int buflen, long long *tstamp)
+{
+    int ret = 0;
+
+    if (m_pcmHandle)
+    {
+        if (tstamp)
+            *tstamp = frameTimestamp();
+        snd_pcm_uframes_t frames = m_captureFrames;
+        snd_pcm_sframes_t max = snd_pcm_bytes_to_frames(m_pcmHandle, buflen);
+        if (max >= 0 && frames > (snd_pcm_uframes_t)max) // 周期大于缓冲时只读能放下的部分
+            frames = max;
+        if (m_mode == PCM_CAPTURE_MMAP)
+            ret = readMmap(buffer, frames);
+        else
+            ret = snd_pcm_readi(m_pcmHandle, buffer, frames); // 从PCM读取交错帧
+        if (ret == -EAGAIN)
+            return PCM_CAPTURE_AGAIN;
+        if (ret < 0)
+        {
+            recover(ret);
+            ret = 0;
+        }
+        else if (ret > 0 && (snd_pcm_uframes_t)ret != m_captureFrames)
+        {
+            LOG("less read: %d frames\n", ret);
+            pcm_stat_add(&m_shortReads, 1);
+        }
+        ret = snd_pcm_frames_to_bytes(m_pcmHandle, ret); // 帧数转字节数，含声道数和样本宽度
+    }
+    return ret;
+}
+
+int PcmCapture::pollDescriptors(struct pollfd *pfds, int space)
+{
+    if (!m_pcmHandle)
+        return 0;
+
+    int count = snd_pcm_poll_descriptors_count(m_pcmHandle);
+    if (count <= 0 || count > space)
+    {
+        LOG("unsupported poll descriptors count: %d\n", count);
+        return 0;
+    }
+    return snd_pcm_poll_descriptors(m_pcmHandle, pfds, count);
+}
+
+unsigned short PcmCapture::pollRevents(struct pollfd *pfds, int count)
+{
+    unsigned short revents = 0;
+    if (m_pcmHandle && snd_pcm_poll_descriptors_revents(m_pcmHandle, pfds, count, &revents) < 0)
+        revents = POLLERR;
+    return revents;
+}
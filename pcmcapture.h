@@ -0,0 +1,62 @@
+/*
+ * ALSA捕获设备：readi或mmap方式按周期读取
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_CAPTURE_H__
+#define __FREE_PCM_CAPTURE_H__
+#include <alsa/asoundlib.h>
+
+#include "pcmsource.h"
+
+#define PCM_CAPTURE_WAIT_MS 1000 // mmap方式等待数据的超时，超时按读取失败处理
+
+/*
+ * 一个捕获设备。两种方式都把一个周期直接写到调用者给的缓冲里，
+ * readFrame()给的是共享环形缓冲的槽，所以捕获到分发只有这一次拷贝：
+ * readi由alsa-lib/内核从DMA缓冲拷贝，mmap由这里从映射的DMA缓冲拷贝，省去系统调用。
+ * DMA缓冲在commit后就会被硬件覆盖，而读者是异步的，不能让通道直接引用它。
+ */
+class PcmCapture : public PcmSource
+{
+public:
+    PcmCapture();
+    ~PcmCapture();
+
+    /* mode：PCM_CAPTURE_MMAP不可用时退回PCM_CAPTURE_READI，实际方式由mode()返回 */
+    bool open(const char *device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int mode);
+    void close(void);
+    /* 查询设备的原生采样率和声道数范围，设备须未被本进程以独占方式打开 */
+    bool probe(const char *device, int format, PcmCaptureCaps_t *caps);
+    /* tstamp：返回这个周期第一个采样的捕获时间，CLOCK_MONOTONIC，单位ns，可为NULL */
+    int read(char *buffer, int buflen, long long *tstamp = NULL);
+    int pollDescriptors(struct pollfd *pfds, int space);
+    unsigned short pollRevents(struct pollfd *pfds, int count);
+
+    bool isOpen(void) {return m_pcmHandle != NULL;}
+    int mode(void) {return m_mode;}
+    unsigned int periodFrames(void) {return m_captureFrames;}
+    unsigned int periodBytes(void) {return m_captureSize;}
+
+private:
+    snd_pcm_sframes_t readMmap(char *buffer, snd_pcm_uframes_t frames);
+    void recover(int err);
+    long long frameTimestamp(void);
+
+private:
+	snd_pcm_t *m_pcmHandle; // PCM句柄
+    int m_mode; // 实际使用的捕获方式
+    bool m_htstamp; // 驱动时间戳是CLOCK_MONOTONIC，否则用读取时的时钟推算
+    unsigned int m_samplerate; // 实际采样率
+	snd_pcm_uframes_t m_captureFrames; // samples_per_frame
+	unsigned int m_captureSize; // in bytes
+};
+
+static inline const char *pcm_capture_mode_name(int mode)
+{
+    return mode == PCM_CAPTURE_MMAP ? "mmap" : "readi";
+}
+
+#endif
+
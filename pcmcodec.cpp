@@ -0,0 +1,328 @@
+/*
+ * 输出编码：G.711 μ-law/A-law(查表)和IMA-ADPCM，输入为16bit交错数据
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <string.h>
+
+#include "pcmcodec.h"
+
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 8159 // 14bit
+
+int pcm_codec_parse(const char *name)
+{
+    for (int i = 0; i < PCM_CODEC_COUNT; i++)
+    {
+        if (!strcmp(name, pcm_codec_name(i)))
+            return i;
+    }
+    return -1;
+}
+
+int pcm_codec_bytes(int codec, int frames, unsigned int channel)
+{
+    switch (codec)
+    {
+    case PCM_CODEC_NONE:
+        return frames * channel * 2;
+    case PCM_CODEC_ULAW:
+    case PCM_CODEC_ALAW:
+        return frames * channel;
+    case PCM_CODEC_ADPCM:
+        return PCM_ADPCM_HEADER_BYTES * channel + (frames * channel + 1) / 2;
+    default:
+        return 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/* G.711参考实现的逐段查找，只用于生成编码表 */
+static int segment(int value, const int *ends)
+{
+    int seg = 0;
+    while (seg < 8 && value > ends[seg])
+        seg++;
+    return seg;
+}
+
+/* value：14bit样本(16bit右移2位) */
+static unsigned char ulaw_from_linear(int value)
+{
+    static const int ends[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+    int mask = 0xFF;
+    if (value < 0)
+    {
+        value = -value;
+        mask = 0x7F;
+    }
+    if (value > ULAW_CLIP)
+        value = ULAW_CLIP;
+    value += ULAW_BIAS >> 2;
+    int seg = segment(value, ends);
+    if (seg >= 8)
+        return 0x7F ^ mask;
+    return ((seg << 4) | ((value >> (seg + 1)) & 0xF)) ^ mask;
+}
+
+/* value：13bit样本(16bit右移3位) */
+static unsigned char alaw_from_linear(int value)
+{
+    static const int ends[8] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+    int mask = 0xD5;
+    if (value < 0)
+    {
+        mask = 0x55;
+        value = -value - 1;
+    }
+    int seg = segment(value, ends);
+    if (seg >= 8)
+        return 0x7F ^ mask;
+    int aval = seg << 4;
+    aval |= (value >> (seg < 2 ? 1 : seg)) & 0xF;
+    return aval ^ mask;
+}
+
+static short ulaw_to_linear(unsigned char u)
+{
+    u = ~u;
+    int t = (((u & 0xF) << 3) + ULAW_BIAS) << ((u & 0x70) >> 4);
+    return (short)((u & 0x80) ? ULAW_BIAS - t : t - ULAW_BIAS);
+}
+
+static short alaw_to_linear(unsigned char a)
+{
+    a ^= 0x55;
+    int t = (a & 0xF) << 4;
+    int seg = (a & 0x70) >> 4;
+    if (seg == 0)
+        t += 8;
+    else
+        t = (t + 0x108) << (seg - 1);
+    return (short)((a & 0x80) ? t : -t);
+}
+
+/*
+ * μ-law只用16bit样本的高14位，A-law只用高13位，按右移后的值查表，编码表共24KB。
+ * 第一次使用时生成
+ */
+typedef struct G711Tables_t
+{
+    G711Tables_t()
+    {
+        for (int i = 0; i < 16384; i++)
+            ulaw[i] = ulaw_from_linear(i - 8192);
+        for (int i = 0; i < 8192; i++)
+            alaw[i] = alaw_from_linear(i - 4096);
+        for (int i = 0; i < 256; i++)
+        {
+            ulaw_pcm[i] = ulaw_to_linear((unsigned char)i);
+            alaw_pcm[i] = alaw_to_linear((unsigned char)i);
+        }
+    }
+
+    unsigned char ulaw[16384]; // 下标为(样本>>2)+8192
+    unsigned char alaw[8192]; // 下标为(样本>>3)+4096
+    short ulaw_pcm[256];
+    short alaw_pcm[256];
+}G711Tables_t;
+
+static const G711Tables_t *g711_tables(void)
+{
+    static const G711Tables_t tables;
+    return &tables;
+}
+
+void pcm_ulaw_encode(const short *in, unsigned char *out, int n)
+{
+    const unsigned char *table = g711_tables()->ulaw + 8192;
+    for (int i = 0; i < n; i++)
+        out[i] = table[in[i] >> 2];
+}
+
+void pcm_alaw_encode(const short *in, unsigned char *out, int n)
+{
+    const unsigned char *table = g711_tables()->alaw + 4096;
+    for (int i = 0; i < n; i++)
+        out[i] = table[in[i] >> 3];
+}
+
+void pcm_ulaw_decode(const unsigned char *in, short *out, int n)
+{
+    const short *table = g711_tables()->ulaw_pcm;
+    for (int i = 0; i < n; i++)
+        out[i] = table[in[i]];
+}
+
+void pcm_alaw_decode(const unsigned char *in, short *out, int n)
+{
+    const short *table = g711_tables()->alaw_pcm;
+    for (int i = 0; i < n; i++)
+        out[i] = table[in[i]];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static const int g_adpcm_steps[89] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int g_adpcm_index[8] = {-1, -1, -1, -1, 2, 4, 6, 8}; // 按码字的低3位调整步长下标
+
+static inline int adpcm_clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* 按IMA推荐算法量化一个样本，更新状态，return：4bit码字 */
+static inline int adpcm_encode_sample(PcmAdpcmState_t *s, int sample)
+{
+    int step = g_adpcm_steps[s->index];
+    int diff = sample - s->predictor;
+    int code = 0;
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    int delta = step >> 3;
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        delta += step;
+    }
+    s->predictor = adpcm_clamp(s->predictor + ((code & 8) ? -delta : delta), -32768, 32767);
+    s->index = adpcm_clamp(s->index + g_adpcm_index[code & 7], 0, 88);
+    return code;
+}
+
+static inline int adpcm_decode_sample(PcmAdpcmState_t *s, int code)
+{
+    int step = g_adpcm_steps[s->index];
+    int delta = step >> 3;
+    if (code & 4)
+        delta += step;
+    if (code & 2)
+        delta += step >> 1;
+    if (code & 1)
+        delta += step >> 2;
+    s->predictor = adpcm_clamp(s->predictor + ((code & 8) ? -delta : delta), -32768, 32767);
+    s->index = adpcm_clamp(s->index + g_adpcm_index[code & 7], 0, 88);
+    return s->predictor;
+}
+
+int pcm_adpcm_encode(PcmAdpcmState_t *state, const short *in, int frames, unsigned int channel, unsigned char *out)
+{
+    for (unsigned int c = 0; c < channel; c++)
+    {
+        unsigned short pred = (unsigned short)state[c].predictor;
+        out[0] = pred >> 8;
+        out[1] = pred & 0xFF;
+        out[2] = (unsigned char)state[c].index;
+        out[3] = 0;
+        out += PCM_ADPCM_HEADER_BYTES;
+    }
+
+    int n = frames * channel;
+    if (channel == 1)
+    {
+        for (int i = 0; i + 1 < n; i += 2)
+        {
+            int hi = adpcm_encode_sample(state, in[i]);
+            *out++ = (hi << 4) | adpcm_encode_sample(state, in[i + 1]);
+        }
+    }
+    else
+    {
+        for (int i = 0; i + 1 < n; i += 2)
+        {
+            int hi = adpcm_encode_sample(&state[i % channel], in[i]);
+            *out++ = (hi << 4) | adpcm_encode_sample(&state[(i + 1) % channel], in[i + 1]);
+        }
+    }
+    if (n & 1)
+        *out = adpcm_encode_sample(&state[(n - 1) % channel], in[n - 1]) << 4;
+    return pcm_codec_bytes(PCM_CODEC_ADPCM, frames, channel);
+}
+
+int pcm_adpcm_decode(const unsigned char *in, int size, unsigned int channel, short *out)
+{
+    if (channel < 1 || channel > PCM_CHANNEL_MAX || size < (int)(PCM_ADPCM_HEADER_BYTES * channel))
+        return -1;
+    PcmAdpcmState_t state[PCM_CHANNEL_MAX];
+    for (unsigned int c = 0; c < channel; c++, in += PCM_ADPCM_HEADER_BYTES)
+    {
+        state[c].predictor = (short)((in[0] << 8) | in[1]);
+        state[c].index = in[2] > 88 ? 88 : in[2];
+    }
+
+    /* 最后一个字节的低4位可能是补齐的0，按声道数取整到整帧 */
+    int n = (size - PCM_ADPCM_HEADER_BYTES * channel) * 2;
+    int frames = n / channel;
+    n = frames * channel;
+    for (int i = 0; i < n; i++)
+    {
+        int code = (i & 1) ? (in[i >> 1] & 0xF) : (in[i >> 1] >> 4);
+        out[i] = (short)adpcm_decode_sample(&state[i % channel], code);
+    }
+    return frames;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PcmEncoder::PcmEncoder()
+{
+    m_codec = PCM_CODEC_NONE;
+    m_channel = 1;
+    reset();
+}
+
+void PcmEncoder::configure(int codec, unsigned int channel)
+{
+    m_codec = codec;
+    m_channel = channel;
+    g711_tables(); // 在配置时生成编码表，不在第一次编码时
+    reset();
+}
+
+void PcmEncoder::reset(void)
+{
+    memset(m_adpcm, 0, sizeof(m_adpcm));
+}
+
+int PcmEncoder::encode(const short *in, int frames, unsigned char *out)
+{
+    int n = frames * m_channel;
+    switch (m_codec)
+    {
+    case PCM_CODEC_ULAW:
+        pcm_ulaw_encode(in, out, n);
+        return n;
+    case PCM_CODEC_ALAW:
+        pcm_alaw_encode(in, out, n);
+        return n;
+    case PCM_CODEC_ADPCM:
+        return pcm_adpcm_encode(m_adpcm, in, frames, m_channel, out);
+    default:
+        memcpy(out, in, n * sizeof(short));
+        return n * sizeof(short);
+    }
+}
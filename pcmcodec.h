@@ -0,0 +1,73 @@
+/*
+ * 输出编码：G.711 μ-law/A-law(查表)和IMA-ADPCM，输入为16bit交错数据
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_CODEC_H__
+#define __FREE_PCM_CODEC_H__
+#include "pcmformat.h"
+
+#define PCM_ADPCM_HEADER_BYTES 4 // ADPCM每个声道的块头
+
+typedef enum PcmCodec_t
+{
+    PCM_CODEC_NONE = 0, // 不编码，输出PCM
+    PCM_CODEC_ULAW, // G.711 μ-law，每个样本1字节
+    PCM_CODEC_ALAW, // G.711 A-law，每个样本1字节
+    PCM_CODEC_ADPCM, // IMA-ADPCM，每个样本4bit，每帧一个块，见pcm_adpcm_encode()
+    PCM_CODEC_COUNT
+}PcmCodec_t;
+
+static inline const char *pcm_codec_name(int codec)
+{
+    static const char *names[PCM_CODEC_COUNT] = {"pcm", "ulaw", "alaw", "adpcm"};
+    return (codec >= 0 && codec < PCM_CODEC_COUNT) ? names[codec] : "unknown";
+}
+
+/* 按名称查找编码，如"ulaw"，不支持时返回-1 */
+int pcm_codec_parse(const char *name);
+/* frames帧(每声道样本数)编码后的字节数 */
+int pcm_codec_bytes(int codec, int frames, unsigned int channel);
+
+/* G.711，n为样本数，与ITU-T G.711参考实现逐样本一致 */
+void pcm_ulaw_encode(const short *in, unsigned char *out, int n);
+void pcm_alaw_encode(const short *in, unsigned char *out, int n);
+void pcm_ulaw_decode(const unsigned char *in, short *out, int n);
+void pcm_alaw_decode(const unsigned char *in, short *out, int n);
+
+/* IMA-ADPCM每个声道的编码状态 */
+typedef struct PcmAdpcmState_t
+{
+    int predictor; // 上一个样本的预测值
+    int index; // 量化步长表的下标0~88
+}PcmAdpcmState_t;
+
+/*
+ * 编码一个块：每个声道一个4字节的块头(预测值，16bit网络字节序；步长下标；保留0)，按声道顺序，
+ * 之后是按帧交错的4bit样本，每字节先高4位后低4位，总数为奇数时最后补0。
+ * 单声道时与RFC 3551的DVI4相同。块头是编码这一块之前的状态，每个块可以单独解码
+ * return：写入out的字节数
+ */
+int pcm_adpcm_encode(PcmAdpcmState_t *state, const short *in, int frames, unsigned int channel, unsigned char *out);
+/* 解码一个块，return：帧数，块头不完整返回-1；样本总数为奇数的单声道块会多出最后一个补齐的样本 */
+int pcm_adpcm_decode(const unsigned char *in, int size, unsigned int channel, short *out);
+
+/* 编码状态，由同一线程连续调用，声道数不变 */
+class PcmEncoder
+{
+public:
+    PcmEncoder();
+
+    void configure(int codec, unsigned int channel);
+    void reset(void);
+    /* 编码frames帧，return：写入out的字节数 */
+    int encode(const short *in, int frames, unsigned char *out);
+
+private:
+    int m_codec;
+    unsigned int m_channel;
+    PcmAdpcmState_t m_adpcm[PCM_CHANNEL_MAX];
+};
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * 采集后处理链：去直流、二阶高通、固定增益(饱和)、自动增益(AGC)，各级在同一遍循环中完成，
+ * 可与int16/float转换合并，数据只读写一次
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pcmdsp.h"
+
+#define DSP_DENORMAL 1e-20f // 静音时滤波器状态衰减到这个量级以下直接清零，避免非规格化数拖慢计算
+
+void pcm_dsp_default_config(PcmDspConfig_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->agc_target_db = -20.0f;
+    cfg->agc_max_gain_db = 24.0f;
+}
+
+bool pcm_dsp_active(const PcmDspConfig_t *cfg)
+{
+    return cfg->dc_remove || cfg->highpass_hz > 0 || cfg->gain_db != 0 || cfg->agc;
+}
+
+bool pcm_dsp_equal(const PcmDspConfig_t *a, const PcmDspConfig_t *b)
+{
+    if (a->dc_remove != b->dc_remove || a->highpass_hz != b->highpass_hz || a->gain_db != b->gain_db || a->agc != b->agc)
+        return false;
+    return !a->agc || (a->agc_target_db == b->agc_target_db && a->agc_max_gain_db == b->agc_max_gain_db);
+}
+
+bool pcm_dsp_parse(PcmDspConfig_t *cfg, const char *spec)
+{
+    pcm_dsp_default_config(cfg);
+    const char *p = spec;
+    while (*p)
+    {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        const char *eq = (const char *)memchr(p, '=', len);
+        size_t key = eq ? (size_t)(eq - p) : len;
+        float value = 0;
+        if (eq)
+        {
+            char *stop;
+            value = strtof(eq + 1, &stop);
+            if (stop == eq + 1 || stop != p + len)
+                return false;
+        }
+
+        if (key == 2 && !strncmp(p, "dc", 2) && !eq)
+            cfg->dc_remove = 1;
+        else if (key == 3 && !strncmp(p, "hpf", 3) && eq && value > 0)
+            cfg->highpass_hz = value;
+        else if (key == 4 && !strncmp(p, "gain", 4) && eq)
+            cfg->gain_db = value;
+        else if (key == 3 && !strncmp(p, "agc", 3))
+        {
+            cfg->agc = 1;
+            if (eq)
+                cfg->agc_target_db = value;
+        }
+        else if (key == 6 && !strncmp(p, "agcmax", 6) && eq && value >= 0)
+            cfg->agc_max_gain_db = value;
+        else
+            return false;
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static inline float db_to_lin(float db)
+{
+    return powf(10.0f, db / 20.0f);
+}
+
+static inline float dsp_load(short v) {return v * (1.0f / 32768.0f);}
+static inline float dsp_load(float v) {return v;}
+
+/* 饱和到满幅，与float_to_s16的取整方式相同 */
+static inline void dsp_store(float v, short *out)
+{
+    v *= 32768.0f;
+    v = v > 32767.0f ? 32767.0f : v;
+    v = v < -32768.0f ? -32768.0f : v;
+    *out = (short)lrintf(v);
+}
+static inline void dsp_store(float v, float *out)
+{
+    *out = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+}
+
+PcmDsp::PcmDsp()
+{
+    pcm_dsp_default_config(&m_cfg);
+    m_samplerate = 0;
+    m_dcPole = 0;
+    m_b0 = 1.0f;
+    m_b1 = m_b2 = m_a1 = m_a2 = 0;
+    m_gain = 1.0f;
+    m_clipped = 0;
+    reset();
+}
+
+void PcmDsp::configure(const PcmDspConfig_t *cfg, unsigned int samplerate)
+{
+    m_cfg = *cfg;
+    m_samplerate = samplerate;
+    m_dcPole = 1.0f - 2.0f * (float)M_PI * PCM_DSP_DC_HZ / samplerate;
+    m_gain = db_to_lin(cfg->gain_db);
+
+    /* RBJ高通，Q=0.707；截止频率超过奈奎斯特频率的九成时不用 */
+    float fc = cfg->highpass_hz;
+    if (fc > 0.45f * samplerate)
+        m_cfg.highpass_hz = fc = 0;
+    if (fc > 0)
+    {
+        double w0 = 2.0 * M_PI * fc / samplerate;
+        double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+        double cosw = cos(w0);
+        double a0 = 1.0 + alpha;
+        m_b0 = (float)((1.0 + cosw) / 2.0 / a0);
+        m_b1 = (float)(-(1.0 + cosw) / a0);
+        m_b2 = m_b0;
+        m_a1 = (float)(-2.0 * cosw / a0);
+        m_a2 = (float)((1.0 - alpha) / a0);
+    }
+    reset();
+}
+
+void PcmDsp::reset(void)
+{
+    memset(m_dcX, 0, sizeof(m_dcX));
+    memset(m_dcY, 0, sizeof(m_dcY));
+    memset(m_z1, 0, sizeof(m_z1));
+    memset(m_z2, 0, sizeof(m_z2));
+    m_agc = 1.0f;
+    m_agcDb = 0;
+    __atomic_store_n(&m_agcCdb, 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * 一帧内各声道依次经过去直流、高通，乘以固定增益和自动增益后饱和写出；
+ * 自动增益在块内从上一块结束时的值线性过渡到本块的目标值，同时累计AGC之前的能量。
+ * Ch为编译期的声道数(0表示运行时的channels)，单双声道时滤波器状态全部留在寄存器中
+ */
+template<typename In, typename Out, bool Dc, bool Hp, unsigned int Ch>
+void PcmDsp::process(const In *in, Out *out, int frames, unsigned int channels)
+{
+    if (Ch)
+        channels = Ch;
+    float dc_x[Ch ? Ch : PCM_CHANNEL_MAX], dc_y[Ch ? Ch : PCM_CHANNEL_MAX];
+    float z1[Ch ? Ch : PCM_CHANNEL_MAX], z2[Ch ? Ch : PCM_CHANNEL_MAX];
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        dc_x[c] = m_dcX[c];
+        dc_y[c] = m_dcY[c];
+        z1[c] = m_z1[c];
+        z2[c] = m_z2[c];
+    }
+    const float pole = m_dcPole, b0 = m_b0, b1 = m_b1, b2 = m_b2, a1 = m_a1, a2 = m_a2;
+
+    float agc_end = m_cfg.agc ? db_to_lin(m_agcDb) : 1.0f;
+    float g = m_gain * m_agc;
+    float step = (m_gain * agc_end - g) / frames;
+    float sumsq = 0;
+    unsigned long long clip = 0;
+
+    for (int f = 0; f < frames; f++, g += step)
+    {
+        for (unsigned int c = 0; c < channels; c++)
+        {
+            float x = dsp_load(in[f * channels + c]);
+            if (Dc)
+            {
+                float y = x - dc_x[c] + pole * dc_y[c];
+                dc_x[c] = x;
+                dc_y[c] = y;
+                x = y;
+            }
+            if (Hp)
+            {
+                float y = b0 * x + z1[c];
+                z1[c] = b1 * x - a1 * y + z2[c];
+                z2[c] = b2 * x - a2 * y;
+                x = y;
+            }
+            sumsq += x * x;
+            x *= g;
+            clip += fabsf(x) > 1.0f;
+            dsp_store(x, &out[f * channels + c]);
+        }
+    }
+
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        m_dcX[c] = dc_x[c];
+        m_dcY[c] = fabsf(dc_y[c]) < DSP_DENORMAL ? 0 : dc_y[c];
+        m_z1[c] = fabsf(z1[c]) < DSP_DENORMAL ? 0 : z1[c];
+        m_z2[c] = fabsf(z2[c]) < DSP_DENORMAL ? 0 : z2[c];
+    }
+    m_agc = agc_end;
+    if (clip)
+        __atomic_store_n(&m_clipped, m_clipped + clip, __ATOMIC_RELAXED);
+    if (m_cfg.agc)
+        updateAgc(sumsq * m_gain * m_gain, frames, channels);
+}
+
+template<typename In, typename Out, bool Dc, bool Hp>
+void PcmDsp::dispatchChannels(const In *in, Out *out, int frames, unsigned int channels)
+{
+    if (channels == 1)
+        process<In, Out, Dc, Hp, 1>(in, out, frames, channels);
+    else if (channels == 2)
+        process<In, Out, Dc, Hp, 2>(in, out, frames, channels);
+    else
+        process<In, Out, Dc, Hp, 0>(in, out, frames, channels);
+}
+
+/* 去直流和高通的开关在编译期展开，循环内没有分支 */
+template<typename In, typename Out>
+void PcmDsp::dispatch(const In *in, Out *out, int frames, unsigned int channels)
+{
+    if (frames <= 0 || channels < 1 || channels > PCM_CHANNEL_MAX)
+        return;
+    bool hp = m_cfg.highpass_hz > 0;
+    if (m_cfg.dc_remove && hp)
+        dispatchChannels<In, Out, true, true>(in, out, frames, channels);
+    else if (m_cfg.dc_remove)
+        dispatchChannels<In, Out, true, false>(in, out, frames, channels);
+    else if (hp)
+        dispatchChannels<In, Out, false, true>(in, out, frames, channels);
+    else
+        dispatchChannels<In, Out, false, false>(in, out, frames, channels);
+}
+
+/*
+ * 按本块(固定增益之后)的电平调整下一块的自动增益：超过目标时按PCM_DSP_AGC_ATTACK_MS较快下降，
+ * 低于目标时每秒最多上升PCM_DSP_AGC_RELEASE_DB，低于PCM_DSP_AGC_GATE_DB时保持不变
+ */
+void PcmDsp::updateAgc(float sumsq, int frames, unsigned int channels)
+{
+    float level = sumsq > 0 ? 10.0f * log10f(sumsq / (frames * channels)) : -200.0f;
+    if (level < PCM_DSP_AGC_GATE_DB)
+        return;
+    float block_ms = frames * 1000.0f / m_samplerate;
+    float want = m_cfg.agc_target_db - level;
+    if (want > m_cfg.agc_max_gain_db)
+        want = m_cfg.agc_max_gain_db;
+    if (want < -m_cfg.agc_max_gain_db)
+        want = -m_cfg.agc_max_gain_db;
+
+    if (want < m_agcDb)
+    {
+        float k = block_ms / PCM_DSP_AGC_ATTACK_MS;
+        m_agcDb += (want - m_agcDb) * (k < 1.0f ? k : 1.0f);
+    }
+    else
+    {
+        float rise = PCM_DSP_AGC_RELEASE_DB * block_ms / 1000.0f;
+        m_agcDb += (want - m_agcDb) < rise ? (want - m_agcDb) : rise;
+    }
+    __atomic_store_n(&m_agcCdb, (int)lrintf(m_agcDb * 100.0f), __ATOMIC_RELAXED);
+}
+
+void PcmDsp::run(const float *in, float *out, int frames, unsigned int channels)
+{
+    dispatch(in, out, frames, channels);
+}
+
+void PcmDsp::runToS16(const float *in, short *out, int frames, unsigned int channels)
+{
+    dispatch(in, out, frames, channels);
+}
+
+void PcmDsp::runS16(const short *in, short *out, int frames, unsigned int channels)
+{
+    dispatch(in, out, frames, channels);
+}
+
+float PcmDsp::agcGainDb(void)
+{
+    return __atomic_load_n(&m_agcCdb, __ATOMIC_RELAXED) / 100.0f;
+}
+
+unsigned long long PcmDsp::clipped(void)
+{
+    return __atomic_load_n(&m_clipped, __ATOMIC_RELAXED);
+}
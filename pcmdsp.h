@@ -0,0 +1,88 @@
+/*
+ * 采集后处理链：去直流、二阶高通、固定增益(饱和)、自动增益(AGC)，各级在同一遍循环中完成，
+ * 可与int16/float转换合并，数据只读写一次
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_DSP_H__
+#define __FREE_PCM_DSP_H__
+#include "pcmformat.h"
+
+#define PCM_DSP_DC_HZ 10.0f // 去直流的截止频率
+#define PCM_DSP_AGC_GATE_DB -60.0f // 低于这个电平(dBFS)的块不调整自动增益，避免放大底噪
+#define PCM_DSP_AGC_ATTACK_MS 20 // 电平超过目标时增益下降的时间常数
+#define PCM_DSP_AGC_RELEASE_DB 6.0f // 电平低于目标时增益每秒最多上升的dB数
+
+typedef struct PcmDspConfig_t
+{
+    int dc_remove; // 1：去直流
+    float highpass_hz; // 二阶高通(Butterworth)截止频率，0表示不用，如80~120Hz去除低频噪声
+    float gain_db; // 固定增益，超出满幅的样本饱和到满幅
+    int agc; // 1：自动增益，在固定增益之后
+    float agc_target_db; // 自动增益的目标均方根电平，dBFS
+    float agc_max_gain_db; // 自动增益的最大增益，最小增益为它的相反数
+}PcmDspConfig_t;
+
+/* 默认：各级都不用，AGC目标-20dBFS，最大增益24dB */
+void pcm_dsp_default_config(PcmDspConfig_t *cfg);
+/* 至少有一级处理 */
+bool pcm_dsp_active(const PcmDspConfig_t *cfg);
+bool pcm_dsp_equal(const PcmDspConfig_t *a, const PcmDspConfig_t *b);
+/*
+ * 解析"dc,hpf=100,gain=6,agc=-20,agcmax=18"形式的处理链，各项可选，顺序无关
+ * return：格式错误返回false
+ */
+bool pcm_dsp_parse(PcmDspConfig_t *cfg, const char *spec);
+
+/*
+ * 处理链状态：每个声道各自的滤波器状态，AGC按所有声道一起计量。
+ * 输入输出为交错数据，可以原地处理；由同一线程连续调用，声道数不变
+ */
+class PcmDsp
+{
+public:
+    PcmDsp();
+
+    /* samplerate：处理的采样率；重新开始处理 */
+    void configure(const PcmDspConfig_t *cfg, unsigned int samplerate);
+    void reset(void);
+
+    void run(const float *in, float *out, int frames, unsigned int channels);
+    /* 处理并转为16bit，替代float到int16的转换 */
+    void runToS16(const float *in, short *out, int frames, unsigned int channels);
+    /* 16bit输入输出，转为float处理后转回，在同一遍中完成 */
+    void runS16(const short *in, short *out, int frames, unsigned int channels);
+
+    float agcGainDb(void); // 当前的自动增益
+    unsigned long long clipped(void); // 饱和的样本数
+
+private:
+    template<typename In, typename Out, bool Dc, bool Hp, unsigned int Ch>
+    void process(const In *in, Out *out, int frames, unsigned int channels);
+    template<typename In, typename Out, bool Dc, bool Hp>
+    void dispatchChannels(const In *in, Out *out, int frames, unsigned int channels);
+    template<typename In, typename Out>
+    void dispatch(const In *in, Out *out, int frames, unsigned int channels);
+    void updateAgc(float sumsq, int frames, unsigned int channels);
+
+private:
+    PcmDspConfig_t m_cfg;
+    unsigned int m_samplerate;
+    float m_dcPole; // 去直流 y[n] = x[n] - x[n-1] + R*y[n-1]
+    float m_b0, m_b1, m_b2, m_a1, m_a2; // 高通系数，已按a0归一化
+    float m_gain; // 固定增益，线性
+    float m_agc; // 上一块结束时的自动增益，线性；下一块从它线性过渡到m_agcDb，避免增益跳变
+    float m_agcDb; // 按上一块电平算出的自动增益，dB
+
+    /* 每个声道的状态 */
+    float m_dcX[PCM_CHANNEL_MAX], m_dcY[PCM_CHANNEL_MAX];
+    float m_z1[PCM_CHANNEL_MAX], m_z2[PCM_CHANNEL_MAX];
+
+    /* 统计，只由处理线程写 */
+    int m_agcCdb; // 自动增益，百分之一dB
+    unsigned long long m_clipped;
+};
+
+#endif
+
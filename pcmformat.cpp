@@ -0,0 +1,500 @@
+/*
+ * PCM采样格式：S16、S24_3LE、S32、FLOAT_LE，以及格式/声道转换和多声道映射
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "pcmformat.h"
+#include "pcmkernel.h"
+
+//////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+/*
+ * 每种格式的读写：整数格式之间以左对齐的32位整数为中间值，
+ * 只要有一方是浮点就以float为中间值
+ */
+static inline int clamp_s32(long long v, long long lo, long long hi)
+{
+    return (int)(v < lo ? lo : (v > hi ? hi : v));
+}
+
+struct PcmS16
+{
+    enum {BYTES = 2, IS_FLOAT = 0};
+    static inline int load_s32(const unsigned char *p)
+    {
+        short v;
+        memcpy(&v, p, 2);
+        return (int)v << 16;
+    }
+    static inline void store_s32(unsigned char *p, int v)
+    {
+        short s = (short)clamp_s32(((long long)v + 0x8000) >> 16, -32768, 32767); // 四舍五入
+        memcpy(p, &s, 2);
+    }
+    static inline float load_float(const unsigned char *p)
+    {
+        short v;
+        memcpy(&v, p, 2);
+        return v * (1.0f / 32768.0f);
+    }
+    static inline void store_float(unsigned char *p, float v)
+    {
+        short s = (short)clamp_s32(lrintf(v * 32768.0f), -32768, 32767);
+        memcpy(p, &s, 2);
+    }
+};
+
+struct PcmS24_3LE
+{
+    enum {BYTES = 3, IS_FLOAT = 0};
+    static inline int load_s32(const unsigned char *p)
+    {
+        return (int)((unsigned int)p[0] << 8 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 24);
+    }
+    static inline void store_s32(unsigned char *p, int v)
+    {
+        int s = clamp_s32(((long long)v + 0x80) >> 8, -8388608, 8388607);
+        p[0] = (unsigned char)s;
+        p[1] = (unsigned char)(s >> 8);
+        p[2] = (unsigned char)(s >> 16);
+    }
+    static inline float load_float(const unsigned char *p)
+    {
+        return (load_s32(p) >> 8) * (1.0f / 8388608.0f);
+    }
+    static inline void store_float(unsigned char *p, float v)
+    {
+        int s = clamp_s32(lrintf(v * 8388608.0f), -8388608, 8388607);
+        p[0] = (unsigned char)s;
+        p[1] = (unsigned char)(s >> 8);
+        p[2] = (unsigned char)(s >> 16);
+    }
+};
+
+struct PcmS32
+{
+    enum {BYTES = 4, IS_FLOAT = 0};
+    static inline int load_s32(const unsigned char *p)
+    {
+        int v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    static inline void store_s32(unsigned char *p, int v)
+    {
+        memcpy(p, &v, 4);
+    }
+    static inline float load_float(const unsigned char *p)
+    {
+        return load_s32(p) * (1.0f / 2147483648.0f);
+    }
+    static inline void store_float(unsigned char *p, float v)
+    {
+        int s = clamp_s32(llrint((double)v * 2147483648.0), -2147483647LL - 1, 2147483647LL);
+        memcpy(p, &s, 4);
+    }
+};
+
+struct PcmFloat
+{
+    enum {BYTES = 4, IS_FLOAT = 1};
+    static inline float load_float(const unsigned char *p)
+    {
+        float v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    static inline void store_float(unsigned char *p, float v)
+    {
+        memcpy(p, &v, 4);
+    }
+    /* 整数中间值只在整数格式之间使用，这里仅为模板实例化 */
+    static inline int load_s32(const unsigned char *) {return 0;}
+    static inline void store_s32(unsigned char *, int) {}
+};
+
+/*
+ * 编译期按(输入格式,输出格式,输入声道,输出声道)特化，内层循环没有运行时分支
+ */
+template <class In, class Out, int InChan, int OutChan>
+static void convert_frames(const void *in, void *out, int frames)
+{
+    const unsigned char *src = (const unsigned char *)in;
+    unsigned char *dst = (unsigned char *)out;
+
+    for (int i = 0; i < frames; i++)
+    {
+        for (int c = 0; c < OutChan; c++)
+        {
+            const unsigned char *s = src + (InChan == 1 ? 0 : (OutChan == 1 ? 0 : c)) * In::BYTES;
+            if (In::IS_FLOAT || Out::IS_FLOAT)
+                Out::store_float(dst, In::load_float(s));
+            else
+                Out::store_s32(dst, In::load_s32(s));
+            dst += Out::BYTES;
+        }
+        src += InChan * In::BYTES;
+    }
+}
+
+template <class In, class Out>
+static PcmFormatConvFunc select_channels(unsigned int in_chan, unsigned int out_chan)
+{
+    if (in_chan == 1 && out_chan == 1)
+        return convert_frames<In, Out, 1, 1>;
+    if (in_chan == 1 && out_chan == 2)
+        return convert_frames<In, Out, 1, 2>;
+    if (in_chan == 2 && out_chan == 1)
+        return convert_frames<In, Out, 2, 1>;
+    if (in_chan == 2 && out_chan == 2)
+        return convert_frames<In, Out, 2, 2>;
+    return NULL;
+}
+
+template <class In>
+static PcmFormatConvFunc select_output(int out_format, unsigned int in_chan, unsigned int out_chan)
+{
+    switch (out_format)
+    {
+    case PCM_FMT_S16: return select_channels<In, PcmS16>(in_chan, out_chan);
+    case PCM_FMT_S24_3LE: return select_channels<In, PcmS24_3LE>(in_chan, out_chan);
+    case PCM_FMT_S32: return select_channels<In, PcmS32>(in_chan, out_chan);
+    case PCM_FMT_FLOAT: return select_channels<In, PcmFloat>(in_chan, out_chan);
+    default: return NULL;
+    }
+}
+
+PcmFormatConvFunc pcm_format_converter(int in_format, unsigned int in_chan, int out_format, unsigned int out_chan)
+{
+    switch (in_format)
+    {
+    case PCM_FMT_S16: return select_output<PcmS16>(out_format, in_chan, out_chan);
+    case PCM_FMT_S24_3LE: return select_output<PcmS24_3LE>(out_format, in_chan, out_chan);
+    case PCM_FMT_S32: return select_output<PcmS32>(out_format, in_chan, out_chan);
+    case PCM_FMT_FLOAT: return select_output<PcmFloat>(out_format, in_chan, out_chan);
+    default: return NULL;
+    }
+}
+
+//////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+/*
+ * 声道映射：每PCM_MIX_BLOCK帧转为float平面数据，每个输出声道是各输入声道的加权和。
+ * 块长固定，最后不足一块的部分按0补齐，混合循环的次数是编译期常量，编译器可以整块向量化；
+ * 整数格式以float为中间值，S32只保留24位精度
+ */
+#define PCM_MIX_BLOCK 64
+
+/* GCC 12之前-O2不做循环向量化，混合函数单独打开，不依赖编译器版本 */
+#if defined(__GNUC__) && !defined(__clang__)
+#define MIX_FN __attribute__((optimize("tree-vectorize")))
+#else
+#define MIX_FN
+#endif
+
+template <class In, class Out, int InChan, int OutChan>
+MIX_FN static void mix_frames(const void *in, void *out, int frames, const PcmChannelMap_t *map)
+{
+    const int ichan = InChan ? InChan : (int)map->in_chan;
+    const int ochan = OutChan ? OutChan : (int)map->out_chan;
+    const unsigned char *src = (const unsigned char *)in;
+    unsigned char *dst = (unsigned char *)out;
+    float x[PCM_CHANNEL_MAX][PCM_MIX_BLOCK];
+    float y[PCM_MIX_BLOCK];
+
+    for (int done = 0; done < frames; done += PCM_MIX_BLOCK)
+    {
+        int n = frames - done < PCM_MIX_BLOCK ? frames - done : PCM_MIX_BLOCK;
+        for (int i = 0; i < n; i++)
+        {
+            for (int c = 0; c < ichan; c++)
+            {
+                x[c][i] = In::load_float(src);
+                src += In::BYTES;
+            }
+        }
+        if (n < PCM_MIX_BLOCK)
+        {
+            for (int c = 0; c < ichan; c++)
+                memset(&x[c][n], 0, (PCM_MIX_BLOCK - n) * sizeof(float));
+        }
+
+        for (int o = 0; o < ochan; o++)
+        {
+            const float *g = map->gain[o];
+            for (int i = 0; i < PCM_MIX_BLOCK; i++)
+                y[i] = g[0] * x[0][i];
+            for (int c = 1; c < ichan; c++)
+            {
+                const float gc = g[c];
+                for (int i = 0; i < PCM_MIX_BLOCK; i++)
+                    y[i] += gc * x[c][i];
+            }
+
+            unsigned char *d = dst + o * Out::BYTES;
+            for (int i = 0; i < n; i++, d += ochan * Out::BYTES)
+                Out::store_float(d, y[i]);
+        }
+        dst += n * ochan * Out::BYTES;
+    }
+}
+
+/* 增益都是0或1且每个输出声道至多取一个输入声道时，route[o]为取的输入声道，<0为静音 */
+static bool chmap_route(const PcmChannelMap_t *map, int *route)
+{
+    for (unsigned int o = 0; o < map->out_chan; o++)
+    {
+        route[o] = -1;
+        for (unsigned int i = 0; i < map->in_chan; i++)
+        {
+            float g = map->gain[o][i];
+            if (g == 0.0f)
+                continue;
+            if (g != 1.0f || route[o] >= 0)
+                return false;
+            route[o] = (int)i;
+        }
+    }
+    return true;
+}
+
+template <class In, class Out>
+static void route_frames(const void *in, void *out, int frames, const PcmChannelMap_t *map)
+{
+    const unsigned char *src = (const unsigned char *)in;
+    unsigned char *dst = (unsigned char *)out;
+    int route[PCM_CHANNEL_MAX];
+    chmap_route(map, route);
+
+    for (int i = 0; i < frames; i++)
+    {
+        for (unsigned int o = 0; o < map->out_chan; o++)
+        {
+            if (route[o] < 0)
+                Out::store_float(dst, 0.0f);
+            else if (In::IS_FLOAT || Out::IS_FLOAT)
+                Out::store_float(dst, In::load_float(src + route[o] * In::BYTES));
+            else
+                Out::store_s32(dst, In::load_s32(src + route[o] * In::BYTES));
+            dst += Out::BYTES;
+        }
+        src += map->in_chan * In::BYTES;
+    }
+}
+
+/* 16bit单双声道互转用样本转换内核 */
+static void route_s16_mono_to_stereo(const void *in, void *out, int frames, const PcmChannelMap_t *)
+{
+    pcm_kernels()->mono_to_stereo((const short *)in, (short *)out, frames);
+}
+
+static void route_s16_stereo_to_mono(const void *in, void *out, int frames, const PcmChannelMap_t *)
+{
+    pcm_kernels()->stereo_to_mono((const short *)in, (short *)out, frames);
+}
+
+template <class In, class Out>
+static PcmMixConvFunc select_mix(const PcmChannelMap_t *map)
+{
+    int route[PCM_CHANNEL_MAX];
+    unsigned int in_chan = map->in_chan, out_chan = map->out_chan;
+    if (chmap_route(map, route))
+        return route_frames<In, Out>;
+    if (in_chan == 1 && out_chan == 2)
+        return mix_frames<In, Out, 1, 2>;
+    if (in_chan == 2 && out_chan == 1)
+        return mix_frames<In, Out, 2, 1>;
+    if (in_chan == 4 && out_chan == 1)
+        return mix_frames<In, Out, 4, 1>;
+    if (in_chan == 8 && out_chan == 1)
+        return mix_frames<In, Out, 8, 1>;
+    if (in_chan == 8 && out_chan == 2)
+        return mix_frames<In, Out, 8, 2>;
+    return mix_frames<In, Out, 0, 0>;
+}
+
+template <class In>
+static PcmMixConvFunc select_mix_output(int out_format, const PcmChannelMap_t *map)
+{
+    switch (out_format)
+    {
+    case PCM_FMT_S16: return select_mix<In, PcmS16>(map);
+    case PCM_FMT_S24_3LE: return select_mix<In, PcmS24_3LE>(map);
+    case PCM_FMT_S32: return select_mix<In, PcmS32>(map);
+    case PCM_FMT_FLOAT: return select_mix<In, PcmFloat>(map);
+    default: return NULL;
+    }
+}
+
+PcmMixConvFunc pcm_mix_converter(int in_format, int out_format, const PcmChannelMap_t *map)
+{
+    int route[PCM_CHANNEL_MAX];
+    if (map->in_chan < 1 || map->in_chan > PCM_CHANNEL_MAX || map->out_chan < 1 || map->out_chan > PCM_CHANNEL_MAX)
+        return NULL;
+
+    if (in_format == PCM_FMT_S16 && out_format == PCM_FMT_S16 && chmap_route(map, route))
+    {
+        if (map->in_chan == 1 && map->out_chan == 2 && route[0] == 0 && route[1] == 0)
+            return route_s16_mono_to_stereo;
+        if (map->in_chan == 2 && map->out_chan == 1 && route[0] == 0)
+            return route_s16_stereo_to_mono;
+    }
+
+    switch (in_format)
+    {
+    case PCM_FMT_S16: return select_mix_output<PcmS16>(out_format, map);
+    case PCM_FMT_S24_3LE: return select_mix_output<PcmS24_3LE>(out_format, map);
+    case PCM_FMT_S32: return select_mix_output<PcmS32>(out_format, map);
+    case PCM_FMT_FLOAT: return select_mix_output<PcmFloat>(out_format, map);
+    default: return NULL;
+    }
+}
+
+bool pcm_chmap_default(PcmChannelMap_t *map, unsigned int in_chan, unsigned int out_chan)
+{
+    memset(map, 0, sizeof(*map));
+    if (in_chan < 1 || in_chan > PCM_CHANNEL_MAX || out_chan < 1 || out_chan > PCM_CHANNEL_MAX)
+        return false;
+    map->in_chan = in_chan;
+    map->out_chan = out_chan;
+
+    if (in_chan == 2 && out_chan == 1)
+    {
+        map->gain[0][0] = 1.0f;
+        return true;
+    }
+    if (out_chan >= in_chan)
+    {
+        for (unsigned int o = 0; o < out_chan; o++)
+            map->gain[o][o % in_chan] = 1.0f;
+        return true;
+    }
+    for (unsigned int o = 0; o < out_chan; o++)
+    {
+        unsigned int count = (in_chan - o + out_chan - 1) / out_chan; // 输入声道o, o+out_chan, ...
+        for (unsigned int i = o; i < in_chan; i += out_chan)
+            map->gain[o][i] = 1.0f / count;
+    }
+    return true;
+}
+
+bool pcm_chmap_select(PcmChannelMap_t *map, unsigned int in_chan, const int *select, unsigned int out_chan)
+{
+    memset(map, 0, sizeof(*map));
+    if (in_chan < 1 || in_chan > PCM_CHANNEL_MAX || out_chan < 1 || out_chan > PCM_CHANNEL_MAX)
+        return false;
+    map->in_chan = in_chan;
+    map->out_chan = out_chan;
+    for (unsigned int o = 0; o < out_chan; o++)
+    {
+        if (select[o] >= (int)in_chan)
+            return false;
+        if (select[o] >= 0)
+            map->gain[o][select[o]] = 1.0f;
+    }
+    return true;
+}
+
+bool pcm_chmap_parse(PcmChannelMap_t *map, unsigned int in_chan, const char *spec)
+{
+    memset(map, 0, sizeof(*map));
+    if (!spec || in_chan < 1 || in_chan > PCM_CHANNEL_MAX)
+        return false;
+    map->in_chan = in_chan;
+
+    const char *p = spec;
+    unsigned int o = 0;
+    while (true)
+    {
+        if (o >= PCM_CHANNEL_MAX)
+            return false;
+        if (p[0] == '-' && (p[1] == ',' || p[1] == '\0')) // 静音
+        {
+            p++;
+        }
+        else
+        {
+            while (true)
+            {
+                char *end;
+                float gain = 1.0f;
+                if (!isdigit((unsigned char)*p) && *p != '.' && *p != '-') // strtod()还接受空白、'+'和inf/nan
+                    return false;
+                double value = strtod(p, &end);
+                if (end == p)
+                    return false;
+                if (*end == '*')
+                {
+                    gain = (float)value;
+                    p = end + 1;
+                    value = strtod(p, &end);
+                    if (end == p)
+                        return false;
+                }
+                long index = (long)value;
+                if (index != value || index < 0 || index >= (long)in_chan)
+                    return false;
+                map->gain[o][index] += gain;
+                p = end;
+                if (*p != '+')
+                    break;
+                p++;
+            }
+        }
+        o++;
+        if (*p == '\0')
+            break;
+        if (*p != ',')
+            return false;
+        p++;
+    }
+    map->out_chan = o;
+    return true;
+}
+
+bool pcm_chmap_equal(const PcmChannelMap_t *a, const PcmChannelMap_t *b)
+{
+    if (a->in_chan != b->in_chan || a->out_chan != b->out_chan)
+        return false;
+    for (unsigned int o = 0; o < a->out_chan; o++)
+    {
+        for (unsigned int i = 0; i < a->in_chan; i++)
+        {
+            if (a->gain[o][i] != b->gain[o][i])
+                return false;
+        }
+    }
+    return true;
+}
+
+bool pcm_chmap_identity(const PcmChannelMap_t *map)
+{
+    if (map->in_chan != map->out_chan)
+        return false;
+    for (unsigned int o = 0; o < map->out_chan; o++)
+    {
+        for (unsigned int i = 0; i < map->in_chan; i++)
+        {
+            if (map->gain[o][i] != (o == i ? 1.0f : 0.0f))
+                return false;
+        }
+    }
+    return true;
+}
+
+int pcm_format_parse(const char *name)
+{
+    for (int i = 0; i < PCM_FMT_COUNT; i++)
+    {
+        if (!strcasecmp(name, pcm_format_name(i)))
+            return i;
+    }
+    return -1;
+}
+
@@ -0,0 +1,82 @@
+/*
+ * PCM采样格式：S16、S24_3LE、S32、FLOAT_LE，以及格式/声道转换和多声道映射
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_FORMAT_H__
+#define __FREE_PCM_FORMAT_H__
+
+#define PCM_CHANNEL_MAX 8 // 声道映射支持的最多声道数
+
+/* 均为小端，与主机字节序相同 */
+typedef enum PcmFormat_t
+{
+    PCM_FMT_S16 = 0,
+    PCM_FMT_S24_3LE, // 每个样本3字节
+    PCM_FMT_S32,
+    PCM_FMT_FLOAT, // [-1.0, 1.0)
+    PCM_FMT_COUNT
+}PcmFormat_t;
+
+static inline int pcm_format_bytes(int format)
+{
+    static const int bytes[PCM_FMT_COUNT] = {2, 3, 4, 4};
+    return (format >= 0 && format < PCM_FMT_COUNT) ? bytes[format] : 0;
+}
+
+static inline const char *pcm_format_name(int format)
+{
+    static const char *names[PCM_FMT_COUNT] = {"s16", "s24_3le", "s32", "float"};
+    return (format >= 0 && format < PCM_FMT_COUNT) ? names[format] : "unknown";
+}
+
+/* 按名称查找格式，如"s24_3le"，不支持时返回-1 */
+int pcm_format_parse(const char *name);
+
+/*
+ * 格式与声道一起转换，in/out为交错数据，frames为帧数(每声道样本数)
+ * 声道只支持单双声道：单转双复制，双转单取左声道
+ */
+typedef void (*PcmFormatConvFunc)(const void *in, void *out, int frames);
+/* 每一对格式和声道数都在编译期特化，不支持时返回NULL */
+PcmFormatConvFunc pcm_format_converter(int in_format, unsigned int in_chan, int out_format, unsigned int out_chan);
+
+/*
+ * 声道映射：输出声道o = sum(gain[o][i] * 输入声道i)，可选取部分声道、调整顺序、按增益下混或上混
+ */
+typedef struct PcmChannelMap_t
+{
+    unsigned int in_chan; // 1~PCM_CHANNEL_MAX
+    unsigned int out_chan;
+    float gain[PCM_CHANNEL_MAX][PCM_CHANNEL_MAX]; // gain[输出声道][输入声道]，未用的元素为0
+}PcmChannelMap_t;
+
+/*
+ * 默认映射：声道数相同时不变；双声道转单声道取左声道(与pcm_format_converter()一致)；
+ * 其余下混时输入声道i平均到输出声道i%out_chan(多转单即所有声道取平均)，上混时输出声道o复制输入声道o%in_chan
+ * return：声道数超出范围返回false
+ */
+bool pcm_chmap_default(PcmChannelMap_t *map, unsigned int in_chan, unsigned int out_chan);
+/* 选取/重排：输出声道o取输入声道select[o]，<0为静音 */
+bool pcm_chmap_select(PcmChannelMap_t *map, unsigned int in_chan, const int *select, unsigned int out_chan);
+/*
+ * 按文本设置映射，输出声道之间用','分隔，每个输出声道是'+'连接的"[增益*]输入声道"，'-'为静音，
+ * 如"2,0"取第3、第1声道，"0.25*0+0.25*1+0.25*2+0.25*3"四声道下混为单声道
+ */
+bool pcm_chmap_parse(PcmChannelMap_t *map, unsigned int in_chan, const char *spec);
+bool pcm_chmap_equal(const PcmChannelMap_t *a, const PcmChannelMap_t *b);
+/* 声道数相同且每个声道原样输出 */
+bool pcm_chmap_identity(const PcmChannelMap_t *map);
+
+/*
+ * 按映射同时转换格式和声道，in/out为交错数据
+ * 1->2、2->1、4->1、8->1、8->2在编译期特化，其余声道数走通用实现；
+ * 只选取/重排声道(增益都是0或1)时直接搬运样本，整数格式之间没有精度损失
+ */
+typedef void (*PcmMixConvFunc)(const void *in, void *out, int frames, const PcmChannelMap_t *map);
+/* 格式不支持时返回NULL，返回的函数只适用于与map声道数相同的映射 */
+PcmMixConvFunc pcm_mix_converter(int in_format, int out_format, const PcmChannelMap_t *map);
+
+#endif
+
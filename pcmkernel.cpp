@@ -0,0 +1,622 @@
+/*
+ * PCM样本转换内核：int16/float互转、单双声道互转、定点FIR点积、电平计量
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pcmkernel.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_HAVE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PCM_HAVE_NEON 1
+#endif
+
+#define S16_SCALE (1.0f / 32768.0f)
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// 标量实现，也用于处理SIMD实现的尾部
+static inline short float_to_s16_one(float v)
+{
+    v *= 32768.0f;
+    if (v >= 32767.0f)
+        return 32767;
+    if (v <= -32768.0f)
+        return -32768;
+    return (short)lrintf(v);
+}
+
+static void scalar_s16_to_float(const short *in, float *out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = in[i] * S16_SCALE;
+}
+
+static void scalar_float_to_s16(const float *in, short *out, int n)
+{
+    for (int i = 0; i < n; i++)
+        out[i] = float_to_s16_one(in[i]);
+}
+
+static void scalar_mono_to_stereo(const short *in, short *out, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        out[2*i] = out[2*i+1] = in[i];
+}
+
+static void scalar_stereo_to_mono(const short *in, short *out, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        out[i] = in[2*i];
+}
+
+static void scalar_stereo_to_float_mono(const short *in, float *out, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        out[i] = in[2*i] * S16_SCALE;
+}
+
+static void scalar_float_mono_to_stereo(const float *in, short *out, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        out[2*i] = out[2*i+1] = float_to_s16_one(in[i]);
+}
+
+static int scalar_dot_s16(const short *a, const short *b, int n)
+{
+    int acc = 0;
+    for (int i = 0; i < n; i++)
+        acc += a[i] * b[i];
+    return acc;
+}
+
+static void scalar_level_s16(const short *in, int n, int *peak, unsigned long long *sumsq)
+{
+    int pk = 0;
+    unsigned long long sq = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int v = in[i] < 0 ? -in[i] : in[i];
+        if (v > pk)
+            pk = v;
+        sq += (unsigned int)(in[i] * in[i]);
+    }
+    *peak = pk;
+    *sumsq = sq;
+}
+
+/* SIMD部分的最大最小值和平方和与尾部的标量结果合并 */
+static inline void merge_level(int max, int min, unsigned long long sq, const short *tail, int n,
+    int *peak, unsigned long long *sumsq)
+{
+    int pk = 0;
+    scalar_level_s16(tail, n, &pk, sumsq);
+    if (max > pk)
+        pk = max;
+    if (-min > pk)
+        pk = -min;
+    *peak = pk;
+    *sumsq += sq;
+}
+
+static const PcmKernels_t g_scalar =
+{
+    "scalar",
+    scalar_s16_to_float,
+    scalar_float_to_s16,
+    scalar_mono_to_stereo,
+    scalar_stereo_to_mono,
+    scalar_stereo_to_float_mono,
+    scalar_float_mono_to_stereo,
+    scalar_dot_s16,
+    scalar_level_s16,
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE2，x86_64基线指令集
+#if defined(__SSE2__)
+static inline __m128i sse2_float_to_s32(__m128 v)
+{
+    v = _mm_mul_ps(v, _mm_set1_ps(32768.0f));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+    return _mm_cvtps_epi32(v); // 默认舍入模式为四舍五入
+}
+
+static void sse2_s16_to_float(const short *in, float *out, int n)
+{
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    scalar_s16_to_float(in + i, out + i, n - i);
+}
+
+static void sse2_float_to_s16(const float *in, short *out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i lo = sse2_float_to_s32(_mm_loadu_ps(in + i));
+        __m128i hi = sse2_float_to_s32(_mm_loadu_ps(in + i + 4));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+    }
+    scalar_float_to_s16(in + i, out + i, n - i);
+}
+
+static void sse2_mono_to_stereo(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + 2*i), _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128((__m128i *)(out + 2*i + 8), _mm_unpackhi_epi16(v, v));
+    }
+    scalar_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+/* 4帧立体声中取出左声道，符号扩展为int32 */
+static inline __m128i sse2_left_s32(const short *in)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+static void sse2_stereo_to_mono(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m128i l0 = sse2_left_s32(in + 2*i);
+        __m128i l1 = sse2_left_s32(in + 2*i + 8);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(l0, l1));
+    }
+    scalar_stereo_to_mono(in + 2*i, out + i, frames - i);
+}
+
+static void sse2_stereo_to_float_mono(const short *in, float *out, int frames)
+{
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 4 <= frames; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(sse2_left_s32(in + 2*i)), scale));
+    scalar_stereo_to_float_mono(in + 2*i, out + i, frames - i);
+}
+
+static void sse2_float_mono_to_stereo(const float *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m128i lo = sse2_float_to_s32(_mm_loadu_ps(in + i));
+        __m128i hi = sse2_float_to_s32(_mm_loadu_ps(in + i + 4));
+        __m128i v = _mm_packs_epi32(lo, hi);
+        _mm_storeu_si128((__m128i *)(out + 2*i), _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128((__m128i *)(out + 2*i + 8), _mm_unpackhi_epi16(v, v));
+    }
+    scalar_float_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+static int sse2_dot_s16(const short *a, const short *b, int n)
+{
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(va, vb));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+    return _mm_cvtsi128_si32(acc) + scalar_dot_s16(a + i, b + i, n - i);
+}
+
+/* madd得到相邻两个平方的和，最大2^31，按无符号扩展为64位累加 */
+static void sse2_level_s16(const short *in, int n, int *peak, unsigned long long *sumsq)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmax = _mm_setzero_si128(), vmin = _mm_setzero_si128(), acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i sq = _mm_madd_epi16(v, v);
+        vmax = _mm_max_epi16(vmax, v);
+        vmin = _mm_min_epi16(vmin, v);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+    }
+    short mx[8], mn[8];
+    unsigned long long s[2];
+    _mm_storeu_si128((__m128i *)mx, vmax);
+    _mm_storeu_si128((__m128i *)mn, vmin);
+    _mm_storeu_si128((__m128i *)s, acc);
+    int max = 0, min = 0;
+    for (int k = 0; k < 8; k++)
+    {
+        max = mx[k] > max ? mx[k] : max;
+        min = mn[k] < min ? mn[k] : min;
+    }
+    merge_level(max, min, s[0] + s[1], in + i, n - i, peak, sumsq);
+}
+
+static const PcmKernels_t g_sse2 =
+{
+    "sse2",
+    sse2_s16_to_float,
+    sse2_float_to_s16,
+    sse2_mono_to_stereo,
+    sse2_stereo_to_mono,
+    sse2_stereo_to_float_mono,
+    sse2_float_mono_to_stereo,
+    sse2_dot_s16,
+    sse2_level_s16,
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2，按函数编译，运行时检测CPU后才会调用
+#if defined(PCM_HAVE_AVX2) && defined(__SSE2__)
+#define AVX2_FN __attribute__((target("avx2")))
+/* 尾部交给非VEX编码的SSE2实现前必须清零ymm高半部分，否则每条SSE指令都有状态切换开销 */
+
+AVX2_FN static inline __m256i avx2_float_to_s32(__m256 v)
+{
+    v = _mm256_mul_ps(v, _mm256_set1_ps(32768.0f));
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+    return _mm256_cvtps_epi32(v);
+}
+
+AVX2_FN static void avx2_s16_to_float(const short *in, float *out, int n)
+{
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(in + i + 8)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    _mm256_zeroupper();
+    sse2_s16_to_float(in + i, out + i, n - i);
+}
+
+AVX2_FN static void avx2_float_to_s16(const float *in, short *out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i lo = avx2_float_to_s32(_mm256_loadu_ps(in + i));
+        __m256i hi = avx2_float_to_s32(_mm256_loadu_ps(in + i + 8));
+        __m256i v = _mm256_packs_epi32(lo, hi); // 按128位通道交错，需重排
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    _mm256_zeroupper();
+    sse2_float_to_s16(in + i, out + i, n - i);
+}
+
+AVX2_FN static void avx2_mono_to_stereo(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 16 <= frames; i += 16)
+    {
+        __m256i v = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(in + i)), 0xD8);
+        _mm256_storeu_si256((__m256i *)(out + 2*i), _mm256_unpacklo_epi16(v, v));
+        _mm256_storeu_si256((__m256i *)(out + 2*i + 16), _mm256_unpackhi_epi16(v, v));
+    }
+    _mm256_zeroupper();
+    sse2_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+AVX2_FN static void avx2_stereo_to_mono(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 16 <= frames; i += 16)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)(in + 2*i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(in + 2*i + 16));
+        __m256i l0 = _mm256_srai_epi32(_mm256_slli_epi32(v0, 16), 16);
+        __m256i l1 = _mm256_srai_epi32(_mm256_slli_epi32(v1, 16), 16);
+        __m256i v = _mm256_packs_epi32(l0, l1);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    _mm256_zeroupper();
+    sse2_stereo_to_mono(in + 2*i, out + i, frames - i);
+}
+
+AVX2_FN static void avx2_stereo_to_float_mono(const short *in, float *out, int frames)
+{
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + 2*i));
+        __m256i l = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(l), scale));
+    }
+    _mm256_zeroupper();
+    sse2_stereo_to_float_mono(in + 2*i, out + i, frames - i);
+}
+
+AVX2_FN static void avx2_float_mono_to_stereo(const float *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 16 <= frames; i += 16)
+    {
+        __m256i lo = avx2_float_to_s32(_mm256_loadu_ps(in + i));
+        __m256i hi = avx2_float_to_s32(_mm256_loadu_ps(in + i + 8));
+        __m256i v = _mm256_packs_epi32(lo, hi); // 通道交错的顺序正好是按通道展开所需的顺序
+        _mm256_storeu_si256((__m256i *)(out + 2*i), _mm256_unpacklo_epi16(v, v));
+        _mm256_storeu_si256((__m256i *)(out + 2*i + 16), _mm256_unpackhi_epi16(v, v));
+    }
+    _mm256_zeroupper();
+    sse2_float_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+AVX2_FN static int avx2_dot_s16(const short *a, const short *b, int n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    int acc32 = _mm_cvtsi128_si32(sum);
+    _mm256_zeroupper();
+    return acc32 + sse2_dot_s16(a + i, b + i, n - i);
+}
+
+AVX2_FN static void avx2_level_s16(const short *in, int n, int *peak, unsigned long long *sumsq)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256(), vmin = _mm256_setzero_si256(), acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i sq = _mm256_madd_epi16(v, v);
+        vmax = _mm256_max_epi16(vmax, v);
+        vmin = _mm256_min_epi16(vmin, v);
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(sq, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(sq, zero));
+    }
+    short mx[16], mn[16];
+    unsigned long long s[4];
+    _mm256_storeu_si256((__m256i *)mx, vmax);
+    _mm256_storeu_si256((__m256i *)mn, vmin);
+    _mm256_storeu_si256((__m256i *)s, acc);
+    _mm256_zeroupper();
+    int max = 0, min = 0;
+    for (int k = 0; k < 16; k++)
+    {
+        max = mx[k] > max ? mx[k] : max;
+        min = mn[k] < min ? mn[k] : min;
+    }
+    merge_level(max, min, s[0] + s[1] + s[2] + s[3], in + i, n - i, peak, sumsq);
+}
+
+static const PcmKernels_t g_avx2 =
+{
+    "avx2",
+    avx2_s16_to_float,
+    avx2_float_to_s16,
+    avx2_mono_to_stereo,
+    avx2_stereo_to_mono,
+    avx2_stereo_to_float_mono,
+    avx2_float_mono_to_stereo,
+    avx2_dot_s16,
+    avx2_level_s16,
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// NEON，aarch64必有；armv7需以-mfpu=neon编译
+#if defined(PCM_HAVE_NEON)
+static inline int32x4_t neon_float_to_s32(float32x4_t v)
+{
+    v = vmulq_n_f32(v, 32768.0f);
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    /* armv7只有向零取整，先加上带符号的0.5 */
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+
+static inline int16x8_t neon_float8_to_s16(const float *in)
+{
+    int32x4_t lo = neon_float_to_s32(vld1q_f32(in));
+    int32x4_t hi = neon_float_to_s32(vld1q_f32(in + 4));
+    return vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi));
+}
+
+static inline void neon_s16_to_float8(int16x8_t v, float *out)
+{
+    vst1q_f32(out, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), S16_SCALE));
+    vst1q_f32(out + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), S16_SCALE));
+}
+
+static void neon_s16_to_float(const short *in, float *out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        neon_s16_to_float8(vld1q_s16(in + i), out + i);
+    scalar_s16_to_float(in + i, out + i, n - i);
+}
+
+static void neon_float_to_s16(const float *in, short *out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        vst1q_s16(out + i, neon_float8_to_s16(in + i));
+    scalar_float_to_s16(in + i, out + i, n - i);
+}
+
+static void neon_mono_to_stereo(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        int16x8x2_t v;
+        v.val[0] = v.val[1] = vld1q_s16(in + i);
+        vst2q_s16(out + 2*i, v);
+    }
+    scalar_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+static void neon_stereo_to_mono(const short *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+        vst1q_s16(out + i, vld2q_s16(in + 2*i).val[0]);
+    scalar_stereo_to_mono(in + 2*i, out + i, frames - i);
+}
+
+static void neon_stereo_to_float_mono(const short *in, float *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+        neon_s16_to_float8(vld2q_s16(in + 2*i).val[0], out + i);
+    scalar_stereo_to_float_mono(in + 2*i, out + i, frames - i);
+}
+
+static void neon_float_mono_to_stereo(const float *in, short *out, int frames)
+{
+    int i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        int16x8x2_t v;
+        v.val[0] = v.val[1] = neon_float8_to_s16(in + i);
+        vst2q_s16(out + 2*i, v);
+    }
+    scalar_float_mono_to_stereo(in + i, out + 2*i, frames - i);
+}
+
+static int neon_dot_s16(const short *a, const short *b, int n)
+{
+    int32x4_t acc = vdupq_n_s32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        int16x8_t va = vld1q_s16(a + i);
+        int16x8_t vb = vld1q_s16(b + i);
+        acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+        acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+    }
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vpadd_s32(sum, sum);
+    return vget_lane_s32(sum, 0) + scalar_dot_s16(a + i, b + i, n - i);
+}
+
+static void neon_level_s16(const short *in, int n, int *peak, unsigned long long *sumsq)
+{
+    int16x8_t vmax = vdupq_n_s16(0), vmin = vdupq_n_s16(0);
+    uint64x2_t acc = vdupq_n_u64(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        int16x8_t v = vld1q_s16(in + i);
+        vmax = vmaxq_s16(vmax, v);
+        vmin = vminq_s16(vmin, v);
+        /* 每个平方最大2^30，两个相加不超过uint32 */
+        uint32x4_t sq = vreinterpretq_u32_s32(vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        sq = vaddq_u32(sq, vreinterpretq_u32_s32(vmull_s16(vget_high_s16(v), vget_high_s16(v))));
+        acc = vpadalq_u32(acc, sq);
+    }
+    short mx[8], mn[8];
+    vst1q_s16(mx, vmax);
+    vst1q_s16(mn, vmin);
+    int max = 0, min = 0;
+    for (int k = 0; k < 8; k++)
+    {
+        max = mx[k] > max ? mx[k] : max;
+        min = mn[k] < min ? mn[k] : min;
+    }
+    merge_level(max, min, vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1), in + i, n - i, peak, sumsq);
+}
+
+static const PcmKernels_t g_neon =
+{
+    "neon",
+    neon_s16_to_float,
+    neon_float_to_s16,
+    neon_mono_to_stereo,
+    neon_stereo_to_mono,
+    neon_stereo_to_float_mono,
+    neon_float_mono_to_stereo,
+    neon_dot_s16,
+    neon_level_s16,
+};
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+const PcmKernels_t *pcm_kernels_by_name(const char *isa)
+{
+    if (!strcmp(isa, "scalar"))
+        return &g_scalar;
+#if defined(__SSE2__)
+    if (!strcmp(isa, "sse2"))
+        return &g_sse2;
+#endif
+#if defined(PCM_HAVE_AVX2) && defined(__SSE2__)
+    if (!strcmp(isa, "avx2"))
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &g_avx2 : NULL;
+    }
+#endif
+#if defined(PCM_HAVE_NEON)
+    if (!strcmp(isa, "neon"))
+        return &g_neon;
+#endif
+    return NULL;
+}
+
+static const PcmKernels_t *pcm_select_kernels(void)
+{
+    const char *names[] = {"avx2", "neon", "sse2", "scalar"};
+    const PcmKernels_t *kernels = NULL;
+    const char *env = getenv("PCM_KERNEL");
+
+    if (env)
+        kernels = pcm_kernels_by_name(env);
+    for (unsigned int i = 0; !kernels && i < sizeof(names)/sizeof(names[0]); i++)
+        kernels = pcm_kernels_by_name(names[i]);
+
+    printf("pcm kernel: %s\n", kernels->isa);
+    return kernels;
+}
+
+const PcmKernels_t *pcm_kernels(void)
+{
+    static const PcmKernels_t *kernels = pcm_select_kernels();
+    return kernels;
+}
+
@@ -0,0 +1,48 @@
+/*
+ * PCM样本转换内核：int16/float互转、单双声道互转、定点FIR点积、电平计量
+ * 提供标量、SSE2、AVX2、NEON实现，运行时按CPU能力选择
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_KERNEL_H__
+#define __FREE_PCM_KERNEL_H__
+
+/* 所有长度均为样本数(n)或帧数(frames)，float范围[-1.0, 1.0)，与libsamplerate一致 */
+typedef struct PcmKernels_t
+{
+    const char *isa; // scalar/sse2/avx2/neon
+
+    void (*s16_to_float)(const short *in, float *out, int n);
+    void (*float_to_s16)(const float *in, short *out, int n); // 四舍五入并饱和
+
+    void (*mono_to_stereo)(const short *in, short *out, int frames); // 复制到左右声道
+    void (*stereo_to_mono)(const short *in, short *out, int frames); // 取左声道
+
+    /* 声道转换与格式转换合并为一次遍历 */
+    void (*stereo_to_float_mono)(const short *in, float *out, int frames);
+    void (*float_mono_to_stereo)(const float *in, short *out, int frames);
+
+    /* int16点积，32位累加，调用者保证不溢出(如定点FIR系数绝对值之和小于2^16) */
+    int (*dot_s16)(const short *a, const short *b, int n);
+
+    /* 电平计量：peak返回最大绝对值(0~32768)，sumsq返回平方和 */
+    void (*level_s16)(const short *in, int n, int *peak, unsigned long long *sumsq);
+}PcmKernels_t;
+
+/* 当前CPU可用的最快实现，环境变量PCM_KERNEL可强制指定(如PCM_KERNEL=scalar) */
+const PcmKernels_t *pcm_kernels(void);
+/* 按名称获取实现，CPU不支持或未编译时返回NULL */
+const PcmKernels_t *pcm_kernels_by_name(const char *isa);
+
+static inline void pcm_s16_to_float(const short *in, float *out, int n)
+{
+    pcm_kernels()->s16_to_float(in, out, n);
+}
+static inline void pcm_float_to_s16(const float *in, short *out, int n)
+{
+    pcm_kernels()->float_to_s16(in, out, n);
+}
+
+#endif
+
@@ -0,0 +1,34 @@
+/*
+ * 日志输出：带时间和函数名的printf
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_LOG_H__
+#define __FREE_PCM_LOG_H__
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+static inline char *log_time(void)
+{
+    static __thread char ctime_buf[128] = {0}; // 捕获线程和读取线程都会打印
+    struct tm t;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    localtime_r(&tv.tv_sec, &t);
+    snprintf(ctime_buf, sizeof(ctime_buf), "%04d-%02d-%02d %02d:%02d:%02d.%03d", 
+        t.tm_year+1900,
+        t.tm_mon+1,
+        t.tm_mday,
+        t.tm_hour,
+        t.tm_min,
+        t.tm_sec,
+        (int)tv.tv_usec/1000);
+    return ctime_buf;
+}
+#define LOG(fmt, ...) printf("[%s %s:%d] " fmt, log_time(), __FUNCTION__, __LINE__, ##__VA_ARGS__)
+
+#endif
+
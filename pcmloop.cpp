@@ -0,0 +1,279 @@
+/*
+ * 捕获事件循环：一个线程用epoll等待多个PCM句柄的poll描述符和定时，eventfd用于唤醒和退出
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "pcmloop.h"
+#include "pcmring.h"
+#include "pcmlog.h"
+
+#define PCM_LOOP_WAKEUP_ID 0 // eventfd在epoll_event.data中的id，处理者的id从1开始
+
+PcmEventLoop::PcmEventLoop()
+{
+    m_running = false;
+    m_threadId = 0;
+    m_nextId = PCM_LOOP_WAKEUP_ID + 1;
+    pcm_sched_init(&m_sched);
+
+    /* 在构造时创建，启动前就可以添加处理者 */
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_epollFd < 0 || m_eventFd < 0)
+    {
+        LOG("create epoll/eventfd failed: %d\n", errno);
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = PCM_LOOP_WAKEUP_ID;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_eventFd, &ev);
+}
+
+PcmEventLoop::~PcmEventLoop()
+{
+    stop();
+    for (size_t i = 0; i < m_entries.size(); i++)
+        delete m_entries[i];
+    m_entries.clear();
+    if (m_eventFd >= 0)
+        ::close(m_eventFd);
+    if (m_epollFd >= 0)
+        ::close(m_epollFd);
+}
+
+bool PcmEventLoop::start(void)
+{
+    if (m_threadId)
+        return true;
+
+    if (m_epollFd < 0 || m_eventFd < 0)
+        return false;
+
+    __atomic_store_n(&m_running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&m_threadId, NULL, LoopThreadStub, this) != 0)
+    {
+        m_running = false;
+        m_threadId = 0;
+        return false;
+    }
+    if (m_sched.policy != SCHED_OTHER || m_sched.cpu_count > 0)
+        pcm_sched_apply(m_threadId, &m_sched, "capture loop");
+    return true;
+}
+
+void PcmEventLoop::stop(void)
+{
+    if (!m_threadId)
+        return;
+
+    __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+    wakeup();
+    pthread_join(m_threadId, NULL);
+    m_threadId = 0;
+}
+
+void PcmEventLoop::wakeup(void)
+{
+    uint64_t one = 1;
+    if (m_eventFd >= 0)
+    {
+        ssize_t ret = write(m_eventFd, &one, sizeof(one));
+        (void)ret; // 计数溢出时返回EAGAIN，此时已经处于可读状态
+    }
+}
+
+bool PcmEventLoop::addHandler(PcmLoopHandler *handler)
+{
+    {
+        MutexLockGuard guard(&m_lock);
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            if (m_entries[i]->handler == handler)
+                return false;
+        }
+
+        PcmLoopEntry_t *entry = new PcmLoopEntry_t;
+        entry->handler = handler;
+        entry->id = m_nextId++;
+        entry->count = 0;
+        attachFds(entry);
+        m_entries.push_back(entry);
+    }
+    wakeup(); // 重新计算定时
+    return true;
+}
+
+void PcmEventLoop::removeHandler(PcmLoopHandler *handler)
+{
+    MutexLockGuard guard(&m_lock);
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        PcmLoopEntry_t *entry = m_entries[i];
+        if (entry->handler == handler)
+        {
+            detachFds(entry);
+            m_entries.erase(m_entries.begin() + i);
+            delete entry;
+            break;
+        }
+    }
+}
+
+bool PcmEventLoop::setSched(const PcmThreadSched_t *sched)
+{
+    m_sched = *sched;
+    if (!m_threadId)
+        return true;
+    return pcm_sched_apply(m_threadId, &m_sched, "capture loop");
+}
+
+void PcmEventLoop::getSched(int *policy, int *priority)
+{
+    *policy = SCHED_OTHER;
+    *priority = 0;
+    if (m_threadId)
+        pcm_sched_get(m_threadId, policy, priority);
+}
+
+int PcmEventLoop::handlers(void)
+{
+    MutexLockGuard guard(&m_lock);
+    return (int)m_entries.size();
+}
+
+/*
+ * 以下函数调用者持有m_lock
+ */
+void PcmEventLoop::attachFds(PcmLoopEntry_t *entry)
+{
+    entry->count = entry->handler->getPollFds(entry->pfds, PCM_LOOP_MAX_FDS);
+    if (entry->count < 0)
+        entry->count = 0;
+
+    for (int i = 0; i < entry->count; i++)
+    {
+        struct epoll_event ev;
+        ev.events = entry->pfds[i].events & (EPOLLIN | EPOLLOUT | EPOLLPRI | EPOLLERR | EPOLLHUP);
+        ev.data.u64 = ((uint64_t)entry->id << 8) | (uint64_t)i;
+        entry->pfds[i].revents = 0;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, entry->pfds[i].fd, &ev) < 0)
+            LOG("epoll add fd %d failed: %d\n", entry->pfds[i].fd, errno);
+    }
+}
+
+void PcmEventLoop::detachFds(PcmLoopEntry_t *entry)
+{
+    for (int i = 0; i < entry->count; i++)
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, entry->pfds[i].fd, NULL); // 描述符已关闭时内核已自动移除
+    entry->count = 0;
+}
+
+PcmLoopEntry_t *PcmEventLoop::findEntry(unsigned int id)
+{
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i]->id == id)
+            return m_entries[i];
+    }
+    return NULL;
+}
+
+void *PcmEventLoop::LoopThreadStub(void *param)
+{
+    PcmEventLoop *inst = (PcmEventLoop *)param;
+    inst->LoopThread();
+    return NULL;
+}
+
+void PcmEventLoop::LoopThread(void)
+{
+    struct epoll_event events[PCM_LOOP_MAX_EVENTS];
+
+    LOG("start capture loop\n");
+    if (pcm_memory_locked())
+        pcm_prefault_stack();
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE))
+    {
+        int timeout = -1;
+        {
+            MutexLockGuard guard(&m_lock);
+            long long now = pcm_now_ms();
+            for (size_t i = 0; i < m_entries.size(); i++)
+            {
+                long long deadline = m_entries[i]->handler->getDeadline();
+                if (deadline < 0)
+                    continue;
+                int remain = deadline > now ? (int)(deadline - now) : 0;
+                if (timeout < 0 || remain < timeout)
+                    timeout = remain;
+            }
+        }
+
+        int n = epoll_wait(m_epollFd, events, PCM_LOOP_MAX_EVENTS, timeout);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG("epoll_wait: %d\n", errno);
+            break;
+        }
+
+        MutexLockGuard guard(&m_lock);
+        if (!__atomic_load_n(&m_running, __ATOMIC_ACQUIRE))
+            break;
+
+        for (int i = 0; i < n; i++)
+        {
+            unsigned int id = (unsigned int)(events[i].data.u64 >> 8);
+            int index = (int)(events[i].data.u64 & 0xff);
+            if (id == PCM_LOOP_WAKEUP_ID)
+            {
+                uint64_t value;
+                ssize_t ret = read(m_eventFd, &value, sizeof(value));
+                (void)ret;
+                continue;
+            }
+
+            PcmLoopEntry_t *entry = findEntry(id);
+            if (entry && index < entry->count) // 等待期间被移除或重新获取过的描述符忽略
+                entry->pfds[index].revents = (short)events[i].events;
+        }
+
+        long long now = pcm_now_ms();
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            PcmLoopEntry_t *entry = m_entries[i];
+            bool ready = false, changed = false;
+            for (int k = 0; k < entry->count; k++)
+                ready = ready || entry->pfds[k].revents != 0;
+
+            if (ready)
+            {
+                changed = entry->handler->handleEvents(entry->pfds, entry->count);
+                for (int k = 0; k < entry->count; k++)
+                    entry->pfds[k].revents = 0;
+            }
+
+            long long deadline = entry->handler->getDeadline();
+            if (deadline >= 0 && deadline <= now)
+                changed = entry->handler->handleTimeout() || changed;
+
+            if (changed)
+            {
+                detachFds(entry);
+                attachFds(entry);
+            }
+        }
+    }
+    LOG("exit capture loop\n");
+}
+
@@ -0,0 +1,85 @@
+/*
+ * 捕获事件循环：一个线程用epoll等待多个PCM句柄的poll描述符和定时，eventfd用于唤醒和退出
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_LOOP_H__
+#define __FREE_PCM_LOOP_H__
+#include <poll.h>
+#include <pthread.h>
+#include <vector>
+
+#include "mutex.h"
+#include "pcmsched.h"
+
+#define PCM_LOOP_MAX_FDS 8 // 每个句柄的poll描述符个数上限
+#define PCM_LOOP_MAX_EVENTS 32
+
+/*
+ * 事件循环中的一个处理者，如一个捕获设备。回调都在循环线程中、持有循环的锁时执行，
+ * 回调里不能调用addHandler()/removeHandler()
+ */
+class PcmLoopHandler
+{
+public:
+    virtual ~PcmLoopHandler() {}
+
+    /* 取得当前要等待的poll描述符，未打开时返回0 */
+    virtual int getPollFds(struct pollfd *pfds, int space) = 0;
+    /* pfds[i].revents已填好；return：true表示描述符有变化(如关闭或重新打开)，需重新获取 */
+    virtual bool handleEvents(struct pollfd *pfds, int count) = 0;
+    /* 下一次需要调用handleTimeout()的时间，pcm_now_ms()计时，<0表示不需要 */
+    virtual long long getDeadline(void) {return -1;}
+    /* return：同handleEvents() */
+    virtual bool handleTimeout(void) {return false;}
+};
+
+typedef struct PcmLoopEntry_t
+{
+    PcmLoopHandler *handler;
+    unsigned int id; // 与描述符下标一起放在epoll_event.data中，移除后残留的事件按id丢弃
+    int count;
+    struct pollfd pfds[PCM_LOOP_MAX_FDS];
+}PcmLoopEntry_t;
+
+class PcmEventLoop
+{
+public:
+    PcmEventLoop();
+    ~PcmEventLoop();
+
+    bool start(void);
+    /* 通过eventfd唤醒循环线程，不需要等待阻塞的读取返回 */
+    void stop(void);
+    /* 任意线程可调用，removeHandler()返回后该处理者的回调不会再执行 */
+    bool addHandler(PcmLoopHandler *handler);
+    void removeHandler(PcmLoopHandler *handler);
+    /* 唤醒循环线程重新计算定时 */
+    void wakeup(void);
+    int handlers(void);
+    /* 捕获线程的调度策略和CPU亲和性，运行中设置立即生效，未启动时在启动后设置；return：同pcm_sched_apply() */
+    bool setSched(const PcmThreadSched_t *sched);
+    /* 捕获线程实际的调度策略和优先级，未启动时为SCHED_OTHER */
+    void getSched(int *policy, int *priority);
+
+private:
+    static void *LoopThreadStub(void *param);
+    void LoopThread(void);
+    void attachFds(PcmLoopEntry_t *entry);
+    void detachFds(PcmLoopEntry_t *entry);
+    PcmLoopEntry_t *findEntry(unsigned int id);
+
+private:
+    bool m_running;
+    pthread_t m_threadId;
+    int m_epollFd;
+    int m_eventFd; // 唤醒/退出
+    unsigned int m_nextId;
+    PcmThreadSched_t m_sched;
+    MutexLock m_lock; // 保护m_entries，回调期间持有
+    std::vector<PcmLoopEntry_t *> m_entries;
+};
+
+#endif
+
@@ -0,0 +1,636 @@
+/*
+ * 预分配无锁PCM帧环形缓冲
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_RING_H__
+#define __FREE_PCM_RING_H__
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define PCM_CACHE_LINE 64
+#define PCM_CACHE_ALIGNED __attribute__((aligned(PCM_CACHE_LINE)))
+#define PCM_RING_SEQ_BUSY 0xFFFFFFFFFFFFFFFFULL // 槽正在被写入
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// futex等待/唤醒，超时单位ms，<0表示一直等待
+static inline void pcm_futex_wait(unsigned int *addr, unsigned int val, int timeout_ms)
+{
+    struct timespec ts;
+    struct timespec *pts = NULL;
+
+    if (timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        pts = &ts;
+    }
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, pts, NULL, 0);
+}
+
+static inline void pcm_futex_wake(unsigned int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * 单写者统计计数：只有一个线程写，其他线程用__atomic_load_n(RELAXED)读，
+ * 不需要带lock前缀的原子加
+ */
+static inline void pcm_stat_add(unsigned long long *counter, unsigned long long n)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void pcm_stat_max(unsigned long long *counter, unsigned long long value)
+{
+    if (value > __atomic_load_n(counter, __ATOMIC_RELAXED))
+        __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline long long pcm_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline long long pcm_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/* 捕获周期的语音检测结果PcmFrameInfo_t::vad，按位组合 */
+#define PCM_VAD_OFF 0 // 设备未开启语音检测
+#define PCM_VAD_SILENCE 1 // 静音(含语音段结束后的拖尾之外的周期)
+#define PCM_VAD_SPEECH 2 // 语音，含语音结束后hangover时间内的拖尾
+#define PCM_VAD_START 4 // 语音段的第一个周期
+#define PCM_VAD_END 8 // 语音段结束后的第一个静音周期
+
+// 帧附带的捕获信息，经各级转换原样传到通道
+typedef struct PcmFrameInfo_t
+{
+    unsigned long long seq; // 捕获周期序号，设备内单调递增，读到的序号不连续说明中间有丢帧
+    long long tstamp; // 周期第一个采样的捕获时间，CLOCK_MONOTONIC，单位ns，0表示未知
+    float peak; // 周期内所有声道的峰值，满幅为1.0，未开启语音检测时为0
+    float rms; // 周期内所有声道的均方根电平，满幅为1.0
+    int vad; // PCM_VAD_*
+    unsigned int gap; // 只读语音的通道在这一帧之前跳过的静音周期数，其他通道为0
+}PcmFrameInfo_t;
+
+// 环形缓冲中的一个槽
+typedef struct PcmRingSlot_t
+{
+    unsigned long long seq; // 槽内帧的序号，写入过程中为PCM_RING_SEQ_BUSY
+    int size; // 有效数据长度，单位字节
+    PcmFrameInfo_t info;
+    char *data;
+}PcmRingSlot_t;
+
+/*
+ * 固定容量的帧环形缓冲：单生产者写入，任意多个读者各自持有读游标(PcmRingReader_t)，
+ * 所有读者共享同一份数据。
+ * 创建后不再申请内存；写入从不阻塞，满了直接覆盖最旧的槽，
+ * 读者通过槽序号校验(seqlock)发现被覆盖的帧并跳过。
+ */
+typedef struct PcmFrameRing_t
+{
+    PcmFrameRing_t()
+    {
+        m_slots = NULL;
+        m_buffer = NULL;
+        m_count = m_slotBytes = 0;
+        m_head = 0;
+        m_notify = 0;
+        m_waiters = 0;
+    }
+    ~PcmFrameRing_t()
+    {
+        destroy();
+    }
+
+    /* slot_count：槽个数；slot_bytes：每个槽的最大字节数 */
+    bool create(int slot_count, int slot_bytes)
+    {
+        destroy();
+        if (slot_count < 2 || slot_bytes <= 0)
+            return false;
+
+        int stride = (slot_bytes + PCM_CACHE_LINE - 1) & ~(PCM_CACHE_LINE - 1);
+        if (posix_memalign((void **)&m_buffer, PCM_CACHE_LINE, (size_t)stride * slot_count) != 0)
+        {
+            m_buffer = NULL;
+            return false;
+        }
+        memset(m_buffer, 0, (size_t)stride * slot_count);
+
+        m_slots = new PcmRingSlot_t[slot_count];
+        for (int i = 0; i < slot_count; i++)
+        {
+            m_slots[i].seq = PCM_RING_SEQ_BUSY;
+            m_slots[i].size = 0;
+            memset(&m_slots[i].info, 0, sizeof(PcmFrameInfo_t));
+            m_slots[i].data = m_buffer + (size_t)stride * i;
+        }
+        m_count = slot_count;
+        m_slotBytes = slot_bytes;
+        return true;
+    }
+    void destroy(void)
+    {
+        if (m_slots)
+            delete []m_slots;
+        m_slots = NULL;
+        if (m_buffer)
+            free(m_buffer);
+        m_buffer = NULL;
+        m_count = m_slotBytes = 0;
+    }
+
+    int slotCount(void) {return m_count;}
+    int slotBytes(void) {return m_slotBytes;}
+    /* 下一个将要写入的帧序号 */
+    unsigned long long head(void) {return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);}
+
+    /*
+     * 生产者就地写入：beginFrame()取得下一个槽的缓冲(slotBytes()字节)，
+     * 写好后调用commitFrame()发布，省去一次拷贝
+     */
+    char *beginFrame(void)
+    {
+        PcmRingSlot_t *slot = &m_slots[m_head % m_count];
+
+        __atomic_store_n(&slot->seq, PCM_RING_SEQ_BUSY, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        return slot->data;
+    }
+    void commitFrame(int size, const PcmFrameInfo_t *info = NULL)
+    {
+        unsigned long long seq = m_head;
+        PcmRingSlot_t *slot = &m_slots[seq % m_count];
+
+        if (size > m_slotBytes)
+            size = m_slotBytes;
+        if (info)
+            slot->info = *info;
+        else
+            memset(&slot->info, 0, sizeof(PcmFrameInfo_t));
+        __atomic_store_n(&slot->size, size, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+
+        __atomic_store_n(&m_head, seq + 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&m_notify, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_waiters, __ATOMIC_SEQ_CST) > 0)
+            pcm_futex_wake(&m_notify);
+    }
+
+    /* 生产者写入一帧，超过槽大小的部分被截断 */
+    void putFrame(const char *pdata, int size)
+    {
+        char *data = beginFrame();
+
+        if (size > m_slotBytes)
+            size = m_slotBytes;
+        memcpy(data, pdata, size);
+        commitFrame(size);
+    }
+
+    /*
+     * 直接访问序号为seq的帧，不拷贝
+     * return：帧已被覆盖返回NULL；使用完后须调用checkFrame()确认期间未被覆盖
+     */
+    const char *peekFrame(unsigned long long seq, int *size)
+    {
+        PcmRingSlot_t *slot = &m_slots[seq % m_count];
+
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+            return NULL;
+
+        *size = __atomic_load_n(&slot->size, __ATOMIC_RELAXED);
+        if (*size > m_slotBytes)
+            return NULL;
+        return slot->data;
+    }
+    /* 取序号为seq的帧的捕获信息，同peekFrame()须用checkFrame()确认 */
+    void frameInfo(unsigned long long seq, PcmFrameInfo_t *info)
+    {
+        *info = m_slots[seq % m_count].info;
+    }
+    bool checkFrame(unsigned long long seq)
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&m_slots[seq % m_count].seq, __ATOMIC_RELAXED) == seq;
+    }
+
+    /*
+     * 拷贝序号为seq的帧到buf
+     * return：成功返回字节数，帧已被覆盖返回0，缓冲区不够返回-1
+     */
+    int readFrame(unsigned long long seq, char *buf, int len)
+    {
+        int size = 0;
+        const char *pdata = peekFrame(seq, &size);
+
+        if (!pdata)
+            return 0;
+        if (size > len)
+            return -1;
+
+        memcpy(buf, pdata, size);
+        if (!checkFrame(seq))
+            return 0; // 拷贝期间被生产者覆盖
+        return size;
+    }
+
+    /* 等待序号为seq的帧写入，超时返回false */
+    bool waitFrame(unsigned long long seq, int timeout_ms)
+    {
+        if (timeout_ms <= 0)
+            return head() != seq;
+
+        long long deadline = pcm_now_ms() + timeout_ms;
+        bool ready = false;
+
+        __atomic_add_fetch(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        while (true)
+        {
+            unsigned int notify = __atomic_load_n(&m_notify, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&m_head, __ATOMIC_SEQ_CST) != seq)
+            {
+                ready = true;
+                break;
+            }
+            long long remain = deadline - pcm_now_ms();
+            if (remain <= 0)
+                break;
+            pcm_futex_wait(&m_notify, notify, (int)remain);
+        }
+        __atomic_sub_fetch(&m_waiters, 1, __ATOMIC_SEQ_CST);
+        return ready;
+    }
+
+    PcmRingSlot_t *m_slots;
+    char *m_buffer;
+    int m_count;
+    int m_slotBytes;
+
+    unsigned long long m_head PCM_CACHE_ALIGNED; // 生产者独占写
+    unsigned int m_notify;
+    int m_waiters PCM_CACHE_ALIGNED; // 读者写
+}PcmFrameRing_t;
+
+/*
+ * 读游标：由读者独占，生产者不感知
+ * 未读帧超过depth时丢弃最旧的，与原队列溢出策略一致
+ */
+typedef struct PcmRingReader_t
+{
+    PcmRingReader_t()
+    {
+        seq = 0;
+        offset = 0;
+        end = PCM_RING_SEQ_BUSY;
+        depth = 4;
+        dropped = 0;
+        served = 0;
+        high_water = 0;
+        speech_only = false;
+        skipped = 0;
+        gap = 0;
+    }
+    void attach(PcmFrameRing_t *ring)
+    {
+        seq = ring->head(); // 只读挂接之后的新帧
+        offset = 0;
+    }
+    void setQueueDepth(PcmFrameRing_t *ring, int qdepth)
+    {
+        if (qdepth > ring->slotCount() - 1)
+            qdepth = ring->slotCount() - 1;
+        if (qdepth > 0)
+            depth = qdepth;
+    }
+    void clearFrame(PcmFrameRing_t *ring)
+    {
+        seq = ring->head();
+        offset = 0;
+    }
+
+    /* 只读语音帧时跳过seq处的静音帧：开启了语音检测且既不是语音也不是语音段结束的帧 */
+    bool silentFrame(PcmFrameRing_t *ring)
+    {
+        PcmFrameInfo_t info;
+        ring->frameInfo(seq, &info);
+        if (!ring->checkFrame(seq)) // 读取信息期间被覆盖，按覆盖处理
+            return false;
+        return info.vad != PCM_VAD_OFF && !(info.vad & (PCM_VAD_SPEECH | PCM_VAD_END));
+    }
+
+    /*
+     * 取得下一帧的只读指针，不拷贝；speech_only时跳过静音帧，跳过的帧数累计到gap
+     * size：返回帧长度，单位字节
+     * return：超时返回NULL；使用完后须调用doneFrame()
+     */
+    const char *nextFrame(PcmFrameRing_t *ring, int *size, int timeout_ms)
+    {
+        bool waited = false;
+        long long deadline = 0;
+        while (true)
+        {
+            unsigned long long head = ring->head();
+            unsigned long long stop = __atomic_load_n(&end, __ATOMIC_ACQUIRE);
+            if (seq >= stop) // 之后的帧不属于这个读者
+                return NULL;
+            if (head == seq)
+            {
+                /* 等到的帧被跳过时在剩余时间内继续等待 */
+                int remain = timeout_ms;
+                if (waited)
+                {
+                    remain = timeout_ms > 0 ? (int)(deadline - pcm_now_ms()) : 0;
+                    if (remain <= 0)
+                        return NULL;
+                }
+                else if (timeout_ms > 0)
+                {
+                    deadline = pcm_now_ms() + timeout_ms;
+                }
+                if (!ring->waitFrame(seq, remain))
+                    return NULL;
+                waited = true;
+                continue;
+            }
+            pcm_stat_max(&high_water, head - seq);
+            if (head - seq > (unsigned long long)depth) // 读得太慢，跳过最旧的帧
+            {
+                pcm_stat_add(&dropped, head - seq - depth);
+                seq = head - depth;
+                if (seq >= stop)
+                    return NULL;
+            }
+
+            const char *pdata = ring->peekFrame(seq, size);
+            if (pdata && speech_only && silentFrame(ring))
+            {
+                pcm_stat_add(&skipped, 1);
+                gap++;
+                seq++;
+                continue;
+            }
+            if (pdata)
+                return pdata;
+            pcm_stat_add(&dropped, 1); // 刚被覆盖，追赶到最新位置
+            seq++;
+        }
+    }
+
+    /* 取seq处帧的捕获信息，附上之前跳过的静音周期数 */
+    void frameInfo(PcmFrameRing_t *ring, PcmFrameInfo_t *info)
+    {
+        ring->frameInfo(seq, info);
+        info->gap = gap;
+    }
+
+    /* 确认nextFrame()取得的帧在使用期间未被覆盖，返回false表示数据无效 */
+    bool doneFrame(PcmFrameRing_t *ring)
+    {
+        bool valid = ring->checkFrame(seq);
+        pcm_stat_add(valid ? &served : &dropped, 1);
+        if (valid)
+            gap = 0;
+        seq++;
+        return valid;
+    }
+
+    /*
+     * 获取一帧数据拷贝到buf
+     * info：返回帧的捕获信息，可为NULL
+     * return：成功返回字节数，超时返回0，缓冲区不够返回-1
+     */
+    int getFrame(PcmFrameRing_t *ring, char *buf, int len, int timeout_ms, PcmFrameInfo_t *info = NULL)
+    {
+        int size = 0;
+        while (true)
+        {
+            const char *pdata = nextFrame(ring, &size, timeout_ms);
+            if (!pdata)
+                return 0;
+            if (size > len)
+            {
+                seq++;
+                return -1;
+            }
+            memcpy(buf, pdata, size);
+            if (info)
+                frameInfo(ring, info);
+            if (doneFrame(ring))
+                return size;
+        }
+    }
+
+    /*
+     * 取出所有已到的帧，依次拷贝到buf形成一块连续数据，只有第一帧最多等待timeout_ms；
+     * 只读语音时遇到跳过的静音就停止，保证一次取出的数据是连续的
+     * max_frames：最多取的帧数，<=0不限制；count：返回取得的帧数，可为NULL
+     * info：返回第一帧的捕获信息，可为NULL
+     * return：总字节数，超时返回0，第一帧就放不下返回-1(该帧丢弃，同getFrame())
+     */
+    int getFrames(PcmFrameRing_t *ring, char *buf, int len, int max_frames, int timeout_ms, int *count,
+        PcmFrameInfo_t *info = NULL)
+    {
+        int total = 0, n = 0, size = 0;
+        while (max_frames <= 0 || n < max_frames)
+        {
+            const char *pdata = nextFrame(ring, &size, n ? 0 : timeout_ms);
+            if (!pdata || (n > 0 && gap > 0))
+                break;
+            if (size > len - total)
+            {
+                if (n == 0)
+                {
+                    seq++;
+                    total = -1;
+                }
+                break; // 放不下的帧留到下次
+            }
+            memcpy(buf + total, pdata, size);
+            if (n == 0 && info)
+                frameInfo(ring, info);
+            if (doneFrame(ring))
+            {
+                total += size;
+                n++;
+            }
+        }
+        if (count)
+            *count = n;
+        return total;
+    }
+
+    /*
+     * 按窗口读取：与槽的边界无关，从(seq, offset)起取window字节，读完后前进hop字节，
+     * hop小于window时相邻窗口重叠。窗口在一个槽内时直接返回槽内的指针，
+     * 跨槽时拼接到scratch(window字节)，数据只拷贝这一次
+     * info：返回窗口起点所在槽的捕获信息；start：返回窗口起点在该槽内的字节偏移
+     * return：数据不够一个窗口返回NULL；使用完后须调用doneWindow()
+     */
+    const char *nextWindow(PcmFrameRing_t *ring, int window, int hop, char *scratch, PcmFrameInfo_t *info, int *start)
+    {
+        while (true)
+        {
+            unsigned long long head = ring->head();
+            unsigned long long stop = __atomic_load_n(&end, __ATOMIC_ACQUIRE);
+            if (seq >= stop || head == seq)
+                return NULL;
+            pcm_stat_max(&high_water, head - seq);
+            if (head - seq > (unsigned long long)depth) // 读得太慢，按最新槽的长度估算丢弃的窗口数
+            {
+                int last = 0;
+                ring->peekFrame(head - 1, &last);
+                unsigned long long lost = (head - depth - seq) * (unsigned long long)last;
+                lost = lost > (unsigned long long)offset ? lost - offset : 0;
+                pcm_stat_add(&dropped, lost / hop > 0 ? lost / hop : 1);
+                seq = head - depth;
+                offset = 0;
+                if (seq >= stop)
+                    return NULL;
+            }
+
+            int size = 0;
+            const char *first = ring->peekFrame(seq, &size);
+            if (!first || offset >= size)
+            {
+                if (!first)
+                    pcm_stat_add(&dropped, 1);
+                seq++;
+                offset = 0;
+                continue;
+            }
+            if (info)
+                ring->frameInfo(seq, info);
+            *start = offset;
+            if (size - offset >= window)
+                return first + offset;
+
+            int got = size - offset;
+            memcpy(scratch, first + offset, got);
+            unsigned long long next = seq + 1;
+            while (got < window && next < head && next < stop)
+            {
+                int n = 0;
+                const char *pdata = ring->peekFrame(next, &n);
+                if (!pdata)
+                    break; // 比第一个槽新的槽被覆盖，第一个槽必然也已被覆盖
+                if (n > window - got)
+                    n = window - got;
+                memcpy(scratch + got, pdata, n);
+                got += n;
+                next++;
+            }
+            if (!ring->checkFrame(seq)) // 拼接期间被覆盖
+            {
+                pcm_stat_add(&dropped, 1);
+                seq++;
+                offset = 0;
+                continue;
+            }
+            if (got < window)
+            {
+                if (next >= stop) // 切换前剩余的数据不够一个窗口
+                {
+                    pcm_stat_add(&dropped, 1);
+                    seq = stop;
+                    offset = 0;
+                }
+                return NULL;
+            }
+            return scratch;
+        }
+    }
+
+    /* 结束nextWindow()取得的窗口并前进hop字节；valid：窗口数据在使用期间未被覆盖 */
+    void doneWindow(PcmFrameRing_t *ring, int hop, bool valid)
+    {
+        pcm_stat_add(valid ? &served : &dropped, 1);
+        while (hop > 0)
+        {
+            int size = 0;
+            if (seq >= ring->head() || !ring->peekFrame(seq, &size)) // 已被覆盖，下次读取时追赶
+            {
+                seq++;
+                offset = 0;
+                return;
+            }
+            if (offset + hop < size)
+            {
+                offset += hop;
+                return;
+            }
+            hop -= size - offset;
+            seq++;
+            offset = 0;
+        }
+    }
+
+    /*
+     * 依次取出已到的窗口拷贝到buf，每个window字节，同getFrames()
+     * start：返回第一个窗口起点在所在槽内的字节偏移
+     */
+    int getWindows(PcmFrameRing_t *ring, char *buf, int len, int max_frames, int window, int hop, int *count,
+        PcmFrameInfo_t *info, int *start)
+    {
+        int total = 0, n = 0, offs = 0;
+        if (len < window)
+        {
+            if (count)
+                *count = 0;
+            return -1;
+        }
+        while ((max_frames <= 0 || n < max_frames) && len - total >= window)
+        {
+            char *dst = buf + total;
+            const char *pdata = nextWindow(ring, window, hop, dst, n ? NULL : info, n ? &offs : start);
+            if (!pdata)
+                break;
+            bool valid = true;
+            if (pdata != dst)
+            {
+                memcpy(dst, pdata, window);
+                valid = ring->checkFrame(seq);
+            }
+            doneWindow(ring, hop, valid);
+            if (valid)
+            {
+                total += window;
+                n++;
+            }
+        }
+        if (count)
+            *count = n;
+        return total;
+    }
+
+    unsigned long long seq; // 下一个待读帧序号
+    int offset; // 按窗口读取时下一个窗口在seq槽内的起始字节
+    unsigned long long end; // 只读到这个序号之前，由其他线程设置，默认不限制
+    int depth;
+    /* 统计，只由读者线程写 */
+    unsigned long long dropped; // 因溢出丢弃的帧数
+    unsigned long long served; // 已读取的帧数
+    unsigned long long high_water; // 读取时观察到的最大积压帧数
+    bool speech_only; // 只读语音帧，静音帧跳过
+    unsigned long long skipped; // 因静音跳过的帧数
+    unsigned int gap; // 上一帧之后跳过的静音帧数，读出下一帧时清零
+}PcmRingReader_t;
+
+#endif
+
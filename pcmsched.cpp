@@ -0,0 +1,190 @@
+/*
+ * 线程实时调度、CPU亲和性和内存锁定：没有权限时保持默认调度，只输出日志
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "pcmsched.h"
+#include "pcmlog.h"
+
+static bool s_locked = false;
+
+void pcm_sched_init(PcmThreadSched_t *sched)
+{
+    sched->policy = SCHED_OTHER;
+    sched->priority = 0;
+    sched->cpu_count = 0;
+    CPU_ZERO(&sched->cpus);
+}
+
+const char *pcm_sched_policy_name(int policy)
+{
+    switch (policy)
+    {
+    case SCHED_FIFO: return "fifo";
+    case SCHED_RR: return "rr";
+    case SCHED_OTHER: return "other";
+    default: return "unknown";
+    }
+}
+
+bool pcm_sched_parse_policy(const char *spec, PcmThreadSched_t *sched)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+
+    if (len == 4 && !strncmp(spec, "fifo", len))
+        sched->policy = SCHED_FIFO;
+    else if (len == 2 && !strncmp(spec, "rr", len))
+        sched->policy = SCHED_RR;
+    else if (len == 5 && !strncmp(spec, "other", len))
+        sched->policy = SCHED_OTHER;
+    else
+        return false;
+
+    sched->priority = 0;
+    if (sched->policy != SCHED_OTHER)
+    {
+        sched->priority = colon ? atoi(colon + 1) : 50;
+        if (sched->priority < 1 || sched->priority > 99)
+            return false;
+    }
+    return true;
+}
+
+bool pcm_sched_parse_cpus(const char *list, PcmThreadSched_t *sched)
+{
+    CPU_ZERO(&sched->cpus);
+    sched->cpu_count = 0;
+    if (!list)
+        return true;
+
+    const char *p = list;
+    while (*p)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0)
+            return false;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        if (last >= CPU_SETSIZE)
+            return false;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, &sched->cpus);
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return false;
+    }
+    sched->cpu_count = CPU_COUNT(&sched->cpus);
+    return true;
+}
+
+bool pcm_sched_apply(pthread_t tid, const PcmThreadSched_t *sched, const char *who)
+{
+    bool ok = true;
+    int err;
+
+    if (sched->cpu_count > 0)
+    {
+        err = pthread_setaffinity_np(tid, sizeof(cpu_set_t), &sched->cpus);
+        if (err != 0)
+        {
+            LOG("%s: set cpu affinity failed: %s, keep running on all cpus\n", who, strerror(err));
+            ok = false;
+        }
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (sched->policy != SCHED_OTHER)
+    {
+        int lo = sched_get_priority_min(sched->policy);
+        int hi = sched_get_priority_max(sched->policy);
+        param.sched_priority = sched->priority < lo ? lo : (sched->priority > hi ? hi : sched->priority);
+    }
+    err = pthread_setschedparam(tid, sched->policy, &param);
+    if (err != 0)
+    {
+        /* EPERM：没有CAP_SYS_NICE且RLIMIT_RTPRIO不够 */
+        LOG("%s: set %s:%d failed: %s, keep default scheduling\n", who, pcm_sched_policy_name(sched->policy),
+            param.sched_priority, strerror(err));
+        ok = false;
+    }
+    else if (sched->policy != SCHED_OTHER)
+    {
+        LOG("%s: scheduling %s:%d\n", who, pcm_sched_policy_name(sched->policy), param.sched_priority);
+    }
+    return ok;
+}
+
+void pcm_sched_get(pthread_t tid, int *policy, int *priority)
+{
+    struct sched_param param;
+    if (pthread_getschedparam(tid, policy, &param) != 0)
+    {
+        *policy = SCHED_OTHER;
+        param.sched_priority = 0;
+    }
+    *priority = param.sched_priority;
+}
+
+bool pcm_memory_lock(void)
+{
+    if (__atomic_load_n(&s_locked, __ATOMIC_ACQUIRE))
+        return true;
+
+    /*
+     * MCL_FUTURE下新建线程的栈(默认8MB)也要计入RLIMIT_MEMLOCK，限额有限时锁定成功后
+     * 反而会使创建线程和分配内存失败，此时不锁定
+     */
+    struct rlimit limit;
+    if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    {
+        LOG("RLIMIT_MEMLOCK %llu KB is limited, memory not locked\n", (unsigned long long)limit.rlim_cur / 1024);
+        return false;
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        /* EPERM/ENOMEM：没有CAP_IPC_LOCK且RLIMIT_MEMLOCK不够 */
+        LOG("mlockall failed: %s, memory not locked\n", strerror(errno));
+        return false;
+    }
+
+    /* 释放的内存留在堆中，下次分配不再重新映射和缺页 */
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    pcm_prefault_stack();
+    __atomic_store_n(&s_locked, true, __ATOMIC_RELEASE);
+    LOG("memory locked\n");
+    return true;
+}
+
+bool pcm_memory_locked(void)
+{
+    return __atomic_load_n(&s_locked, __ATOMIC_ACQUIRE);
+}
+
+void pcm_prefault_stack(void)
+{
+    volatile unsigned char stack[PCM_PREFAULT_STACK_BYTES];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
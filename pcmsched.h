@@ -0,0 +1,60 @@
+/*
+ * 线程实时调度、CPU亲和性和内存锁定：没有权限时保持默认调度，只输出日志
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_SCHED_H__
+#define __FREE_PCM_SCHED_H__
+#include <sched.h>
+#include <pthread.h>
+
+#define PCM_PREFAULT_STACK_BYTES (256 * 1024) // 锁定内存时线程启动后预先访问的栈大小
+
+/* 可配置的线程 */
+enum
+{
+    PCM_THREAD_CAPTURE = 0, // 捕获线程(事件循环)
+    PCM_THREAD_DSP, // DSP线程池的所有线程
+    PCM_THREAD_COUNT
+};
+
+typedef struct PcmThreadSched_t
+{
+    int policy; // SCHED_OTHER/SCHED_FIFO/SCHED_RR
+    int priority; // SCHED_FIFO/SCHED_RR的优先级1~99，SCHED_OTHER忽略
+    int cpu_count; // cpus中的CPU数，0表示不绑定
+    cpu_set_t cpus;
+}PcmThreadSched_t;
+
+/* 默认调度，不绑定CPU */
+void pcm_sched_init(PcmThreadSched_t *sched);
+
+/* 解析"fifo:80"、"rr:50"、"other"形式的调度策略；return：格式错误返回false */
+bool pcm_sched_parse_policy(const char *spec, PcmThreadSched_t *sched);
+/* 解析"2"、"0,2"、"4-7"形式的CPU列表，NULL或""表示不绑定；return：格式错误返回false */
+bool pcm_sched_parse_cpus(const char *list, PcmThreadSched_t *sched);
+
+/*
+ * 设置线程的CPU亲和性和调度策略，可在线程运行中调用
+ * 没有权限(需要CAP_SYS_NICE或RLIMIT_RTPRIO)或CPU不存在时输出日志，线程按原来的方式继续运行
+ * who：日志中的线程名；return：全部设置成功返回true
+ */
+bool pcm_sched_apply(pthread_t tid, const PcmThreadSched_t *sched, const char *who);
+/* 线程当前实际的调度策略和优先级 */
+void pcm_sched_get(pthread_t tid, int *policy, int *priority);
+const char *pcm_sched_policy_name(int policy);
+
+/*
+ * mlockall(MCL_CURRENT|MCL_FUTURE)锁定进程内存，并关闭malloc向系统归还内存，
+ * 之后分配的缓冲不会因换出或重新映射产生缺页；需要root或RLIMIT_MEMLOCK为unlimited，
+ * 限额有限时线程栈会超出限额，不锁定
+ * return：失败时输出日志返回false，进程不受影响
+ */
+bool pcm_memory_lock(void);
+bool pcm_memory_locked(void);
+/* 在调用线程中访问PCM_PREFAULT_STACK_BYTES的栈，使后续函数调用不再因栈增长缺页 */
+void pcm_prefault_stack(void);
+
+#endif
+
@@ -0,0 +1,564 @@
+/*
+ * 捕获源：ALSA设备、录音文件回放、信号发生器，按周期把数据写入共享缓冲
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+
+#include "pcmsource.h"
+#include "pcmcapture.h"
+#include "pcmlog.h"
+
+/* frames帧的时长，单位ns，分成整秒和余数计算，长时间回放不溢出 */
+static long long frames_to_ns(unsigned long long frames, unsigned int rate)
+{
+    return (long long)(frames / rate) * 1000000000LL + (long long)((frames % rate) * 1000000000ULL / rate);
+}
+
+/* 设备名的类型部分是否为name，后面须是结尾、':'或',' */
+static bool source_type_is(const char *device, const char *name)
+{
+    size_t len = strlen(name);
+    return !strncmp(device, name, len) && (device[len] == '\0' || device[len] == ':' || device[len] == ',');
+}
+
+static const PcmCaptureProfile_t s_profiles[PCM_PROFILE_COUNT] =
+{
+    /* name, ptime, buffer_periods, avail_min, start_threshold, queue_depth */
+    {"default", 0, 0, 0, 0, 4},
+    {"ultra_low", 4, 4, 1, 1, 2},
+    {"balanced", 10, 8, 1, 1, 3},
+    {"power_save", 40, 25, 4, 0, 8},
+};
+
+const PcmCaptureProfile_t *pcm_capture_profile(int profile)
+{
+    return (profile >= 0 && profile < PCM_PROFILE_COUNT) ? &s_profiles[profile] : NULL;
+}
+
+int pcm_capture_profile_parse(const char *name)
+{
+    for (int i = 0; i < PCM_PROFILE_COUNT; i++)
+    {
+        if (!strcmp(name, s_profiles[i].name))
+            return i;
+    }
+    return -1;
+}
+
+PcmSource *pcm_source_create(const char *device)
+{
+    if (source_type_is(device, "replay"))
+        return new PcmReplaySource();
+    if (source_type_is(device, "tone"))
+        return new PcmToneSource(false);
+    if (source_type_is(device, "noise"))
+        return new PcmToneSource(true);
+    return new PcmCapture();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PcmSource::PcmSource()
+{
+    m_nonblock = false;
+    m_profile = pcm_capture_profile(PCM_PROFILE_DEFAULT);
+    m_xruns = m_shortReads = 0;
+}
+
+/*
+ * 读取一帧直接写入ring的下一个槽并发布
+ * return：同read()，失败时不发布，该槽原来的帧最旧，已超出所有读者的队列深度
+ */
+int PcmSource::readFrame(PcmFrameRing_t *ring, unsigned long long frame_seq, PcmVad *vad)
+{
+    PcmFrameInfo_t info;
+    memset(&info, 0, sizeof(info));
+    info.seq = frame_seq;
+    char *data = ring->beginFrame();
+    int ret = read(data, ring->slotBytes(), &info.tstamp);
+    if (ret > 0 && vad)
+        vad->process(data, ret, &info);
+    if (ret > 0)
+        ring->commitFrame(ret, &info);
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PcmTimedSource::PcmTimedSource()
+{
+    m_open = false;
+    m_timerFd = -1;
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_fast = false;
+    m_samplerate = m_channel = 0;
+    m_format = PCM_FMT_S16;
+    m_periodFrames = 0;
+    m_startNs = 0;
+    m_produced = 0;
+}
+
+PcmTimedSource::~PcmTimedSource()
+{
+    /* 子类的析构函数已经close()，这里不能再调用子类的closeStream() */
+    if (m_wakeFd >= 0)
+        ::close(m_wakeFd);
+}
+
+const char *PcmTimedSource::spec(const char *device)
+{
+    const char *p = device;
+    while (*p && *p != ':' && *p != ',')
+        p++;
+    return *p == ':' ? p + 1 : p;
+}
+
+bool PcmTimedSource::option(const char *spec, const char *key, char *value, int len)
+{
+    size_t klen = strlen(key);
+    const char *p = strchr(spec, ',');
+
+    while (p)
+    {
+        p++;
+        const char *end = strchr(p, ',');
+        size_t flen = end ? (size_t)(end - p) : strlen(p);
+        if (flen >= klen && !strncmp(p, key, klen) && (flen == klen || p[klen] == '='))
+        {
+            if (value && len > 0)
+            {
+                size_t vlen = flen > klen ? flen - klen - 1 : 0;
+                if (vlen >= (size_t)len)
+                    vlen = len - 1;
+                memcpy(value, p + klen + 1, vlen);
+                value[vlen] = '\0';
+            }
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
+
+bool PcmTimedSource::open(const char *device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int mode)
+{
+    (void)mode;
+    close();
+    if (samplerate == 0 || channel_cnt == 0 || pcm_format_bytes(format) == 0)
+        return false;
+
+    const char *args = spec(device);
+    m_samplerate = samplerate;
+    m_channel = channel_cnt;
+    m_format = format;
+    if (!openStream(args))
+        return false;
+
+    __atomic_store_n(&m_fast, option(args, "fast", NULL, 0), __ATOMIC_RELAXED);
+    m_periodFrames = samplerate * ptime / 1000;
+    if (m_periodFrames == 0)
+        m_periodFrames = 1;
+    m_produced = 0;
+    m_startNs = pcm_now_ns();
+
+    if (!m_fast)
+    {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd < 0)
+        {
+            LOG("timerfd_create: %d\n", errno);
+            closeStream();
+            return false;
+        }
+        armTimer();
+    }
+    else
+    {
+        notify(); // 打开后先读一次，通道有空间就开始回放
+    }
+
+    m_open = true;
+    LOG("open %s: %u Hz, %u channels, %s, %u frames/period, %s\n", device, m_samplerate, m_channel,
+        pcm_format_name(m_format), m_periodFrames, m_fast ? "unpaced" : "real time");
+    return true;
+}
+
+void PcmTimedSource::close(void)
+{
+    if (!m_open)
+        return;
+    closeStream();
+    if (m_timerFd >= 0)
+    {
+        ::close(m_timerFd);
+        m_timerFd = -1;
+    }
+    m_open = false;
+}
+
+/* 下一个周期结束时到时，之后每个周期一次；用绝对时间，不随唤醒延迟漂移 */
+void PcmTimedSource::armTimer(void)
+{
+    struct itimerspec its;
+    long long period = frames_to_ns(m_periodFrames, m_samplerate) + 1; // 向上取整，到时时整个周期一定已到
+    long long first = m_startNs + frames_to_ns(m_produced + m_periodFrames, m_samplerate) + 1;
+
+    its.it_value.tv_sec = first / 1000000000LL;
+    its.it_value.tv_nsec = first % 1000000000LL;
+    its.it_interval.tv_sec = period / 1000000000LL;
+    its.it_interval.tv_nsec = period % 1000000000LL;
+    if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        LOG("timerfd_settime: %d\n", errno);
+}
+
+void PcmTimedSource::notify(void)
+{
+    uint64_t one = 1;
+    if (m_wakeFd >= 0)
+    {
+        ssize_t ret = write(m_wakeFd, &one, sizeof(one));
+        (void)ret; // 计数溢出时返回EAGAIN，此时已经处于可读状态
+    }
+}
+
+int PcmTimedSource::read(char *buffer, int buflen, long long *tstamp)
+{
+    if (!m_open)
+        return 0;
+
+    int frame_bytes = m_channel * pcm_format_bytes(m_format);
+    int frames = m_periodFrames;
+    if (frames > buflen / frame_bytes)
+        frames = buflen / frame_bytes;
+    if (frames <= 0)
+        return 0;
+
+    /* 按实时节奏：周期的最后一帧到时才能读，落后太多时从当前时刻重新计时 */
+    if (!m_fast)
+    {
+        long long now = pcm_now_ns();
+        long long due = m_startNs + frames_to_ns(m_produced + frames, m_samplerate);
+        if (now < due)
+        {
+            if (m_nonblock)
+                return PCM_CAPTURE_AGAIN;
+            struct timespec ts;
+            ts.tv_sec = due / 1000000000LL;
+            ts.tv_nsec = due % 1000000000LL;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+        }
+        else if (now - due > PCM_SOURCE_MAX_LAG_MS * 1000000LL)
+        {
+            LOG("overrun: %lld ms behind\n", (now - due) / 1000000);
+            pcm_stat_add(&m_xruns, 1);
+            m_startNs = now - frames_to_ns(m_produced + frames, m_samplerate);
+            armTimer();
+        }
+    }
+
+    int got = produce(buffer, frames);
+    if (got <= 0)
+        return PCM_CAPTURE_EOF;
+    if (got < frames)
+        pcm_stat_add(&m_shortReads, 1);
+    if (tstamp)
+        *tstamp = m_startNs + frames_to_ns(m_produced, m_samplerate);
+    m_produced += got;
+    return got * frame_bytes;
+}
+
+int PcmTimedSource::pollDescriptors(struct pollfd *pfds, int space)
+{
+    if (!m_open || space < 1)
+        return 0;
+    pfds[0].fd = m_fast ? m_wakeFd : m_timerFd;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    return 1;
+}
+
+/* 清掉timerfd的到时次数或eventfd的计数，是否有数据由read()按时钟判断 */
+unsigned short PcmTimedSource::pollRevents(struct pollfd *pfds, int count)
+{
+    if (count < 1)
+        return 0;
+    if (pfds[0].revents & POLLIN)
+    {
+        uint64_t value;
+        ssize_t ret = ::read(pfds[0].fd, &value, sizeof(value));
+        (void)ret;
+    }
+    return pfds[0].revents & (POLLIN | POLLERR);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PcmReplaySource::PcmReplaySource()
+{
+    m_fp = NULL;
+    memset(&m_info, 0, sizeof(m_info));
+    m_remain = -1;
+    m_loop = false;
+    m_conv = NULL;
+    memset(&m_map, 0, sizeof(m_map));
+    m_scratch = NULL;
+    m_scratchFrames = 0;
+}
+
+PcmReplaySource::~PcmReplaySource()
+{
+    close();
+}
+
+/* 打开spec第一个字段给出的文件，有WAV头时按头，否则按rate/channels/format选项作为裸PCM */
+bool PcmReplaySource::openFile(const char *spec, FILE **fp, PcmWavInfo_t *info)
+{
+    char path[512], value[32];
+    const char *end = strchr(spec, ',');
+    size_t len = end ? (size_t)(end - spec) : strlen(spec);
+    if (len == 0 || len >= sizeof(path))
+        return false;
+    memcpy(path, spec, len);
+    path[len] = '\0';
+
+    *fp = fopen(path, "rb");
+    if (!*fp)
+    {
+        LOG("open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (pcm_wav_read_header(*fp, info))
+        return true;
+
+    memset(info, 0, sizeof(*info));
+    info->format = PCM_FMT_S16;
+    if (option(spec, "rate", value, sizeof(value)))
+        info->samplerate = atoi(value);
+    if (option(spec, "channels", value, sizeof(value)))
+        info->channel = atoi(value);
+    if (option(spec, "format", value, sizeof(value)))
+        info->format = pcm_format_parse(value);
+    if (info->samplerate == 0 || info->channel == 0 || info->format < 0)
+    {
+        LOG("%s: not a wav file, raw pcm needs rate=/channels=[/format=]\n", path);
+        fclose(*fp);
+        *fp = NULL;
+        return false;
+    }
+    info->data_offset = 0;
+    info->data_bytes = -1;
+    rewind(*fp);
+    return true;
+}
+
+/* 只能按文件的采样率回放；只报告文件的声道数，自动协商时按原样回放，不会因通道变化重新打开而从头开始 */
+bool PcmReplaySource::probe(const char *device, int format, PcmCaptureCaps_t *caps)
+{
+    FILE *fp = NULL;
+    PcmWavInfo_t info;
+
+    (void)format;
+    memset(caps, 0, sizeof(*caps));
+    if (!openFile(spec(device), &fp, &info))
+        return false;
+    fclose(fp);
+
+    caps->rates[0] = info.samplerate;
+    caps->rate_count = 1;
+    caps->min_channels = caps->max_channels = info.channel;
+    return true;
+}
+
+bool PcmReplaySource::openStream(const char *spec)
+{
+    if (!openFile(spec, &m_fp, &m_info))
+        return false;
+
+    m_conv = NULL;
+    if (m_info.samplerate != m_samplerate)
+    {
+        LOG("file is %u Hz, can not replay at %u Hz\n", m_info.samplerate, m_samplerate);
+        closeStream();
+        return false;
+    }
+    if (m_info.format != m_format || m_info.channel != m_channel)
+    {
+        /* 多声道文件(如麦克风阵列录音)按默认映射下混/上混，与pcm_transcode相同 */
+        if (pcm_chmap_default(&m_map, m_info.channel, m_channel))
+            m_conv = pcm_mix_converter(m_info.format, m_format, &m_map);
+        if (!m_conv)
+        {
+            LOG("can not convert %s/%u to %s/%u\n", pcm_format_name(m_info.format), m_info.channel,
+                pcm_format_name(m_format), m_channel);
+            closeStream();
+            return false;
+        }
+    }
+    m_remain = m_info.data_bytes;
+    m_loop = option(spec, "loop", NULL, 0);
+    return true;
+}
+
+void PcmReplaySource::closeStream(void)
+{
+    if (m_fp)
+    {
+        fclose(m_fp);
+        m_fp = NULL;
+    }
+    if (m_scratch)
+    {
+        delete []m_scratch;
+        m_scratch = NULL;
+    }
+    m_scratchFrames = 0;
+}
+
+int PcmReplaySource::produce(char *buffer, int frames)
+{
+    int frame_bytes = m_info.channel * pcm_format_bytes(m_info.format);
+    char *dst = buffer;
+    if (m_conv)
+    {
+        if (m_scratchFrames < frames) // 第一次读取时按周期分配
+        {
+            delete []m_scratch;
+            m_scratch = new char[frames * frame_bytes];
+            m_scratchFrames = frames;
+        }
+        dst = m_scratch;
+    }
+
+    int got = 0;
+    bool rewound = false;
+    while (got < frames)
+    {
+        long long want = (long long)(frames - got) * frame_bytes;
+        if (m_remain >= 0 && want > m_remain)
+            want = m_remain - m_remain % frame_bytes;
+        size_t n = want > 0 ? fread(dst + got * frame_bytes, 1, want, m_fp) : 0;
+        n -= n % frame_bytes;
+        got += n / frame_bytes;
+        if (m_remain >= 0)
+            m_remain -= n;
+        if ((long long)n == want && want > 0)
+            continue;
+
+        /* 数据结束：循环时回到data块开始，一个字节都没读到又回绕说明文件没有数据 */
+        if (!m_loop || (rewound && n == 0))
+            break;
+        fseek(m_fp, m_info.data_offset, SEEK_SET);
+        m_remain = m_info.data_bytes;
+        rewound = true;
+    }
+
+    if (m_conv && got > 0)
+        m_conv(m_scratch, buffer, got, &m_map);
+    return got;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+PcmToneSource::PcmToneSource(bool noise)
+{
+    m_noise = noise;
+    m_freq = 1000;
+    m_amp = noise ? 0.1f : 0.5f;
+    m_phase = 0;
+    m_rand = 0x12345678;
+    m_conv = NULL;
+    m_scratch = NULL;
+    m_scratchSamples = 0;
+}
+
+PcmToneSource::~PcmToneSource()
+{
+    close();
+}
+
+bool PcmToneSource::probe(const char *device, int format, PcmCaptureCaps_t *caps)
+{
+    static const unsigned int std_rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000};
+
+    (void)device;
+    (void)format;
+    memset(caps, 0, sizeof(*caps));
+    for (unsigned int i = 0; i < sizeof(std_rates) / sizeof(std_rates[0]); i++)
+        caps->rates[caps->rate_count++] = std_rates[i];
+    caps->min_channels = 1;
+    caps->max_channels = 8;
+    return true;
+}
+
+bool PcmToneSource::openStream(const char *spec)
+{
+    char value[32];
+    if (!m_noise && spec[0] != '\0' && spec[0] != ',')
+        m_freq = atof(spec);
+    if (option(spec, "amp", value, sizeof(value)))
+        m_amp = atof(value);
+    if (m_freq <= 0 || m_freq >= m_samplerate / 2.0)
+    {
+        LOG("tone %.1f Hz out of range for %u Hz\n", m_freq, m_samplerate);
+        return false;
+    }
+
+    /* 在float上生成，所有声道的样本当作单声道一次转换为捕获格式 */
+    m_conv = pcm_format_converter(PCM_FMT_FLOAT, 1, m_format, 1);
+    m_phase = 0;
+    return m_conv != NULL;
+}
+
+void PcmToneSource::closeStream(void)
+{
+    if (m_scratch)
+    {
+        delete []m_scratch;
+        m_scratch = NULL;
+    }
+    m_scratchSamples = 0;
+}
+
+int PcmToneSource::produce(char *buffer, int frames)
+{
+    int samples = frames * m_channel;
+    if (m_scratchSamples < samples)
+    {
+        delete []m_scratch;
+        m_scratch = new float[samples];
+        m_scratchSamples = samples;
+    }
+
+    if (m_noise)
+    {
+        for (int i = 0; i < samples; i++)
+        {
+            m_rand ^= m_rand << 13;
+            m_rand ^= m_rand >> 17;
+            m_rand ^= m_rand << 5;
+            m_scratch[i] = m_amp * ((int)m_rand * (1.0f / 2147483648.0f));
+        }
+    }
+    else
+    {
+        double step = m_freq / m_samplerate;
+        for (int i = 0; i < frames; i++)
+        {
+            float v = m_amp * (float)sin(2 * M_PI * m_phase);
+            for (unsigned int c = 0; c < m_channel; c++)
+                m_scratch[i * m_channel + c] = v;
+            m_phase += step;
+            if (m_phase >= 1.0)
+                m_phase -= 1.0;
+        }
+    }
+    m_conv(m_scratch, buffer, samples);
+    return frames;
+}
+
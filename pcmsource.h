@@ -0,0 +1,229 @@
+/*
+ * 捕获源：ALSA设备、录音文件回放、信号发生器，按周期把数据写入共享缓冲
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_SOURCE_H__
+#define __FREE_PCM_SOURCE_H__
+#include <stdio.h>
+#include <poll.h>
+
+#include "pcmring.h"
+#include "pcmformat.h"
+#include "pcmwav.h"
+#include "pcmvad.h"
+
+#define PCM_CAPTURE_AGAIN -1 // 非阻塞模式下暂时没有一个完整周期
+#define PCM_CAPTURE_EOF -2 // 回放的文件已读完，不再有数据
+#define PCM_CAPTURE_MAX_RATES 16
+#define PCM_SOURCE_MAX_LAG_MS 500 // 按实时节奏回放时落后超过这个时间就不再追赶，计为一次溢出
+
+typedef enum PcmCaptureMode_t
+{
+    PCM_CAPTURE_READI = 0, // SND_PCM_ACCESS_RW_INTERLEAVED + snd_pcm_readi
+    PCM_CAPTURE_MMAP, // SND_PCM_ACCESS_MMAP_INTERLEAVED + snd_pcm_mmap_begin/commit
+}PcmCaptureMode_t;
+
+/* 捕获延迟配置，周期、ALSA缓冲、唤醒阈值和通道队列深度一起设置 */
+typedef enum PcmLatencyProfile_t
+{
+    PCM_PROFILE_DEFAULT = 0, // 周期为打开设备时的ptime，缓冲取设备最大值(不超过1s)，队列深度4
+    PCM_PROFILE_ULTRA_LOW, // 4ms周期，缓冲4个周期，队列深度2，用于语音交互，需要实时调度配合
+    PCM_PROFILE_BALANCED, // 10ms周期，缓冲8个周期，队列深度3
+    PCM_PROFILE_POWER_SAVE, // 40ms周期，缓冲1s，积满4个周期才唤醒一次，队列深度8
+    PCM_PROFILE_COUNT
+}PcmLatencyProfile_t;
+
+typedef struct PcmCaptureProfile_t
+{
+    const char *name;
+    unsigned int ptime; // 周期，单位ms，0表示使用打开设备时给的ptime
+    unsigned int buffer_periods; // ALSA缓冲的周期数，0表示设备最大值(不超过1s)
+    unsigned int avail_min; // sw_params avail_min，可读达到这么多周期才唤醒捕获线程，0为ALSA默认(一个周期)
+    unsigned int start_threshold; // sw_params start_threshold，单位帧，0为ALSA默认
+    int queue_depth; // 通道的默认队列深度，单位周期
+}PcmCaptureProfile_t;
+
+/* return：profile无效时返回NULL */
+const PcmCaptureProfile_t *pcm_capture_profile(int profile);
+/* 按名称查找，如"ultra_low"，不支持时返回-1 */
+int pcm_capture_profile_parse(const char *name);
+
+/* 设备不经重采样能直接支持的参数 */
+typedef struct PcmCaptureCaps_t
+{
+    unsigned int rates[PCM_CAPTURE_MAX_RATES]; // 支持的标准采样率，从小到大
+    int rate_count;
+    unsigned int min_channels;
+    unsigned int max_channels;
+}PcmCaptureCaps_t;
+
+/*
+ * 捕获源接口，PcmRecord只通过它读取数据，不关心数据来自声卡还是文件
+ * 非阻塞模式下由事件循环poll到可读后调用readFrame()
+ */
+class PcmSource
+{
+public:
+    PcmSource();
+    virtual ~PcmSource() {}
+
+    /* device：设备名，各实现自己解析；mode：PCM_CAPTURE_*，只对ALSA设备有意义 */
+    virtual bool open(const char *device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int mode) = 0;
+    virtual void close(void) = 0;
+    /* 查询不经转换能直接提供的采样率和声道数范围 */
+    virtual bool probe(const char *device, int format, PcmCaptureCaps_t *caps) = 0;
+    /*
+     * 读取一个周期，tstamp返回周期第一个采样的时间，CLOCK_MONOTONIC，单位ns，可为NULL
+     * return：字节数，失败返回0，非阻塞模式下暂无数据返回PCM_CAPTURE_AGAIN，数据结束返回PCM_CAPTURE_EOF
+     */
+    virtual int read(char *buffer, int buflen, long long *tstamp = NULL) = 0;
+    /* 读取一帧直接写入ring的下一个槽并发布；frame_seq：写入帧信息的捕获周期序号，由调用者计数；
+     * vad：不为NULL时发布前计量电平并做语音检测，结果随帧信息发布 */
+    int readFrame(PcmFrameRing_t *ring, unsigned long long frame_seq = 0, PcmVad *vad = NULL);
+
+    /* 非阻塞模式配合事件循环使用，open之前设置 */
+    void setNonblock(bool nonblock) {m_nonblock = nonblock;}
+    /* 缓冲和唤醒阈值，open之前设置，只对ALSA设备有意义 */
+    void setProfile(const PcmCaptureProfile_t *profile) {m_profile = profile;}
+    virtual int pollDescriptors(struct pollfd *pfds, int space) = 0;
+    /* 把poll得到的revents转换为PCM事件(POLLIN/POLLERR) */
+    virtual unsigned short pollRevents(struct pollfd *pfds, int count) = 0;
+
+    virtual bool isOpen(void) = 0;
+    virtual int mode(void) {return PCM_CAPTURE_READI;}
+    virtual unsigned int periodFrames(void) = 0;
+
+    /*
+     * 不按实时节奏的源(如全速回放)：数据随时可读，由调用者控制只在通道有空间时读取，
+     * 通道读走数据后调用notify()唤醒事件循环继续读
+     */
+    virtual bool unpaced(void) {return false;}
+    virtual void notify(void) {}
+
+    /* 统计，任意线程可读 */
+    unsigned long long xruns(void) {return __atomic_load_n(&m_xruns, __ATOMIC_RELAXED);}
+    unsigned long long shortReads(void) {return __atomic_load_n(&m_shortReads, __ATOMIC_RELAXED);}
+
+protected:
+    bool m_nonblock;
+    const PcmCaptureProfile_t *m_profile;
+    unsigned long long m_xruns; // 溢出次数，跨打开累计
+    unsigned long long m_shortReads; // 不足一个周期的读取次数
+};
+
+/*
+ * 按设备名创建捕获源：
+ * "replay:路径[,选项...]"：回放WAV或裸PCM文件，选项rate=/channels=/format=(裸PCM必须给出rate和channels)、
+ *     loop(循环回放)、fast(不按实时节奏，通道读得多快就回放多快)。ALSA的file插件占用了"file:"
+ * "tone[:频率Hz][,amp=幅度][,fast]"：正弦波，默认1000Hz、幅度0.5
+ * "noise[,amp=幅度][,fast]"：白噪声，默认幅度0.1
+ * 其他名称为ALSA PCM，如"default"、"plughw:1,0"
+ */
+PcmSource *pcm_source_create(const char *device);
+
+/*
+ * 按时钟产生周期的源：回放文件和信号发生器共用
+ * 按实时节奏时用timerfd在每个周期到时唤醒，否则用eventfd由notify()唤醒；
+ * 时间戳按已产生的帧数从打开时刻推算
+ */
+class PcmTimedSource : public PcmSource
+{
+public:
+    PcmTimedSource();
+    ~PcmTimedSource();
+
+    bool open(const char *device, unsigned int samplerate, unsigned int channel_cnt, int format, unsigned int ptime, int mode);
+    void close(void);
+    int read(char *buffer, int buflen, long long *tstamp = NULL);
+    int pollDescriptors(struct pollfd *pfds, int space);
+    unsigned short pollRevents(struct pollfd *pfds, int count);
+    bool isOpen(void) {return m_open;}
+    unsigned int periodFrames(void) {return m_periodFrames;}
+    bool unpaced(void) {return __atomic_load_n(&m_fast, __ATOMIC_RELAXED);}
+    void notify(void);
+
+protected:
+    /* 设备名去掉类型名和':'后的部分，如"replay:a.wav,fast"为"a.wav,fast"，"tone,fast"为",fast" */
+    static const char *spec(const char *device);
+    /* spec：见上；打开失败返回false */
+    virtual bool openStream(const char *spec) = 0;
+    virtual void closeStream(void) = 0;
+    /* 产生最多frames帧(m_channel声道、m_format格式)写入buffer，return：实际帧数，0表示数据结束 */
+    virtual int produce(char *buffer, int frames) = 0;
+
+    /* 取spec中第一个字段之后逗号分隔的选项key或key=value，value可为NULL，return：选项存在返回true */
+    static bool option(const char *spec, const char *key, char *value, int len);
+
+protected:
+    unsigned int m_samplerate;
+    unsigned int m_channel;
+    int m_format;
+
+private:
+    void armTimer(void);
+
+private:
+    bool m_open;
+    int m_timerFd; // 按实时节奏时每个周期到时可读
+    int m_wakeFd; // 不按实时节奏时由notify()写入；读取线程随时可能调用notify()，只在析构时关闭
+    bool m_fast;
+    unsigned int m_periodFrames;
+    long long m_startNs; // 第0帧的时间
+    unsigned long long m_produced; // 已产生的帧数
+};
+
+/* 回放WAV或裸PCM文件，采样率须与文件相同；指定的格式和单双声道与文件不同时转换 */
+class PcmReplaySource : public PcmTimedSource
+{
+public:
+    PcmReplaySource();
+    ~PcmReplaySource();
+    bool probe(const char *device, int format, PcmCaptureCaps_t *caps);
+
+protected:
+    bool openStream(const char *spec);
+    void closeStream(void);
+    int produce(char *buffer, int frames);
+
+private:
+    static bool openFile(const char *spec, FILE **fp, PcmWavInfo_t *info);
+
+private:
+    FILE *m_fp;
+    PcmWavInfo_t m_info; // 文件的格式和数据位置
+    long long m_remain; // data块中未读的字节数，<0表示读到文件结束
+    bool m_loop;
+    PcmMixConvFunc m_conv; // 文件格式和声道转为捕获格式，相同时为NULL
+    PcmChannelMap_t m_map; // 文件声道到捕获声道的默认映射
+    char *m_scratch; // 转换前的文件数据
+    int m_scratchFrames;
+};
+
+/* 信号发生器：正弦波或白噪声，所有声道相同的正弦波，噪声各声道独立 */
+class PcmToneSource : public PcmTimedSource
+{
+public:
+    PcmToneSource(bool noise);
+    ~PcmToneSource();
+    bool probe(const char *device, int format, PcmCaptureCaps_t *caps);
+
+protected:
+    bool openStream(const char *spec);
+    void closeStream(void);
+    int produce(char *buffer, int frames);
+
+private:
+    bool m_noise;
+    double m_freq;
+    float m_amp;
+    double m_phase; // 正弦波相位，单位周
+    unsigned int m_rand; // xorshift32状态
+    PcmFormatConvFunc m_conv; // float转为捕获格式
+    float *m_scratch;
+    int m_scratchSamples;
+};
+
+#endif
+
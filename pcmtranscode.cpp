@@ -0,0 +1,341 @@
+/*
+ * 离线批量转换：WAV/裸PCM文件的采样率、声道和采样格式转换，多个文件和长文件的分段在线程池中并行处理
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pcmtranscode.h"
+#include "pcmring.h"
+#include "resampler.h"
+#include "dspworker.h"
+#include "pcmlog.h"
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b)
+    {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+PcmTranscoder::PcmTranscoder(const PcmTranscodeOpt_t *opt)
+{
+    m_opt = *opt;
+    m_pending = 0;
+}
+
+PcmTranscoder::~PcmTranscoder()
+{
+    for (size_t i = 0; i < m_files.size(); i++)
+        delete m_files[i];
+    m_files.clear();
+}
+
+bool PcmTranscoder::addFile(const char *input, const char *output)
+{
+    PcmTranscodeFile_t *file = new PcmTranscodeFile_t;
+    file->input = input;
+    file->output = output;
+    file->chunks = 0;
+    file->failed = 0;
+    file->in_frames = file->out_frames = 0;
+
+    /* 输入：有WAV头按头，否则按裸PCM参数 */
+    FILE *fp = fopen(input, "rb");
+    if (!fp)
+    {
+        LOG("open %s: %s\n", input, strerror(errno));
+        delete file;
+        return false;
+    }
+    if (!pcm_wav_read_header(fp, &file->in))
+    {
+        if (m_opt.raw_rate == 0 || m_opt.raw_channel == 0 || pcm_format_bytes(m_opt.raw_format) == 0)
+        {
+            LOG("%s: not a wav file and no raw pcm parameters\n", input);
+            fclose(fp);
+            delete file;
+            return false;
+        }
+        file->in.samplerate = m_opt.raw_rate;
+        file->in.channel = m_opt.raw_channel;
+        file->in.format = m_opt.raw_format;
+        file->in.data_offset = 0;
+        file->in.data_bytes = -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long long size = ftell(fp) - file->in.data_offset;
+    fclose(fp);
+    if (file->in.data_bytes < 0 || file->in.data_bytes > size) // 未回填或被截断的文件按实际长度
+        file->in.data_bytes = size > 0 ? size : 0;
+
+    file->samplerate = m_opt.samplerate ? m_opt.samplerate : file->in.samplerate;
+    file->channel = m_opt.channel ? m_opt.channel : file->in.channel;
+    file->format = m_opt.format >= 0 ? m_opt.format : file->in.format;
+    file->mapped = (m_opt.chmap != NULL);
+    bool chan_ok = file->mapped ? pcm_chmap_parse(&file->map, file->in.channel, m_opt.chmap)
+        : pcm_chmap_default(&file->map, file->in.channel, file->channel);
+    if (!chan_ok)
+    {
+        LOG("%s: unsupported channel conversion from %u channels\n", input, file->in.channel);
+        delete file;
+        return false;
+    }
+    file->channel = file->map.out_chan;
+
+    unsigned int in_bytes = file->in.channel * pcm_format_bytes(file->in.format);
+    unsigned int out_bytes = file->channel * pcm_format_bytes(file->format);
+    unsigned int g = gcd(file->in.samplerate, file->samplerate);
+    unsigned int in_step = file->in.samplerate / g, out_step = file->samplerate / g; // 输入in_step帧对应输出out_step帧
+    file->in_frames = file->in.data_bytes / in_bytes;
+    file->out_frames = file->in_frames * file->samplerate / file->in.samplerate;
+    file->out_offset = m_opt.raw_out ? 0 : PCM_WAV_HEADER_BYTES;
+
+    /* 输出文件的长度事先确定，各分段按位置写入 */
+    int fd = ::open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        LOG("create %s: %s\n", output, strerror(errno));
+        delete file;
+        return false;
+    }
+    bool ok = true;
+    if (!m_opt.raw_out)
+    {
+        unsigned char header[PCM_WAV_HEADER_BYTES];
+        pcm_wav_make_header(header, file->samplerate, file->channel, file->format, (long long)(file->out_frames * out_bytes));
+        ok = pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    }
+    ok = ok && ftruncate(fd, file->out_offset + file->out_frames * out_bytes) == 0;
+    ::close(fd);
+    if (!ok)
+    {
+        LOG("write %s: %s\n", output, strerror(errno));
+        delete file;
+        return false;
+    }
+
+    unsigned long long chunk = file->in_frames;
+    if (m_opt.chunk_sec > 0)
+    {
+        chunk = (unsigned long long)m_opt.chunk_sec * file->in.samplerate;
+        chunk = (chunk + in_step - 1) / in_step * in_step;
+    }
+    if (chunk == 0)
+        chunk = in_step;
+
+    unsigned long long start = 0;
+    do
+    {
+        PcmTranscodeChunk_t c;
+        c.file = file;
+        c.in_start = start;
+        c.in_end = file->in_frames - start > chunk ? start + chunk : file->in_frames;
+        c.out_start = start / in_step * out_step;
+        c.out_end = c.in_end == file->in_frames ? file->out_frames : c.in_end / in_step * out_step;
+        m_chunks.push_back(c);
+        file->chunks++;
+        start = c.in_end;
+    } while (start < file->in_frames);
+
+    m_files.push_back(file);
+    return true;
+}
+
+void PcmTranscoder::ChunkTaskStub(void *obj, void *arg)
+{
+    PcmTranscoder *inst = (PcmTranscoder *)obj;
+    PcmTranscodeChunk_t *chunk = (PcmTranscodeChunk_t *)arg;
+    if (!inst->processChunk(chunk))
+        __atomic_store_n(&chunk->file->failed, 1, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&inst->m_pending, 1, __ATOMIC_ACQ_REL) == 0)
+        pcm_futex_wake(&inst->m_pending);
+}
+
+int PcmTranscoder::run(void)
+{
+    DspWorkerPool pool;
+    if (!pool.start(m_opt.threads))
+    {
+        LOG("start worker pool failed\n");
+        return (int)m_files.size();
+    }
+
+    __atomic_store_n(&m_pending, (unsigned int)m_chunks.size(), __ATOMIC_RELEASE);
+    for (size_t i = 0; i < m_chunks.size(); i++)
+        pool.submit(ChunkTaskStub, this, &m_chunks[i]);
+
+    unsigned int left;
+    while ((left = __atomic_load_n(&m_pending, __ATOMIC_ACQUIRE)) > 0)
+        pcm_futex_wait(&m_pending, left, 1000);
+    pool.stop();
+
+    int failed = 0;
+    for (size_t i = 0; i < m_files.size(); i++)
+        failed += m_files[i]->failed;
+    return failed;
+}
+
+/*
+ * 流式处理一个分段：读一块、转为float、重采样、转为输出格式、写到输出位置
+ * 重采样时从in_start前最多一个重叠长度开始读，到in_end后一个重叠长度结束，前面多出的输出丢掉
+ */
+bool PcmTranscoder::processChunk(PcmTranscodeChunk_t *chunk)
+{
+    PcmTranscodeFile_t *file = chunk->file;
+    const PcmWavInfo_t *in = &file->in;
+    bool resample = in->samplerate != file->samplerate;
+    unsigned int in_bytes = in->channel * pcm_format_bytes(in->format);
+    unsigned int out_bytes = file->channel * pcm_format_bytes(file->format);
+    unsigned int g = gcd(in->samplerate, file->samplerate);
+    unsigned int in_step = in->samplerate / g, out_step = file->samplerate / g;
+
+    /* 重采样在声道少的一侧做，指定了声道映射时先映射再重采样；不重采样时直接转换 */
+    unsigned int rchan = (file->mapped || !resample || file->channel < in->channel) ? file->channel : in->channel;
+    PcmChannelMap_t map_in, map_out;
+    if (file->mapped)
+        map_in = file->map;
+    else
+        pcm_chmap_default(&map_in, in->channel, rchan);
+    pcm_chmap_default(&map_out, rchan, file->channel);
+    PcmMixConvFunc conv_in = pcm_mix_converter(in->format, resample ? PCM_FMT_FLOAT : file->format, &map_in);
+    PcmMixConvFunc conv_out = resample ? pcm_mix_converter(PCM_FMT_FLOAT, file->format, &map_out) : NULL;
+    if (!conv_in || (resample && !conv_out))
+    {
+        LOG("%s: unsupported conversion %s/%u -> %s/%u\n", file->input.c_str(), pcm_format_name(in->format), in->channel,
+            pcm_format_name(file->format), file->channel);
+        return false;
+    }
+
+    unsigned long long overlap = 0;
+    if (resample)
+    {
+        overlap = (unsigned long long)in->samplerate * PCM_TRANSCODE_OVERLAP_MS / 1000;
+        overlap = (overlap + in_step - 1) / in_step * in_step;
+    }
+    unsigned long long pre = chunk->in_start < overlap ? chunk->in_start : overlap;
+    unsigned long long read_pos = chunk->in_start - pre;
+    unsigned long long read_end = file->in_frames - chunk->in_end < overlap ? file->in_frames : chunk->in_end + overlap;
+    unsigned long long discard = pre / in_step * out_step;
+    unsigned long long want = chunk->out_end - chunk->out_start, written = 0;
+
+    FILE *fp = fopen(file->input.c_str(), "rb");
+    int fd = ::open(file->output.c_str(), O_WRONLY);
+    if (!fp || fd < 0)
+    {
+        LOG("open %s/%s: %s\n", file->input.c_str(), file->output.c_str(), strerror(errno));
+        if (fp)
+            fclose(fp);
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    fseek(fp, in->data_offset + (long)(read_pos * in_bytes), SEEK_SET);
+
+    const unsigned int block = PCM_TRANSCODE_BLOCK_FRAMES;
+    unsigned int out_block = (unsigned int)((unsigned long long)block * file->samplerate / in->samplerate) + 64;
+    char *raw = new char[block * in_bytes];
+    float *fin = resample ? new float[block * rchan] : NULL;
+    float *fout = resample ? new float[out_block * rchan] : NULL;
+    char *obuf = new char[(resample ? out_block : block) * out_bytes];
+    CResampleEx resampler;
+    bool ok = true;
+
+    if (resample)
+    {
+        bool high = m_opt.quality != PCM_TRANSCODE_FAST;
+        bool large = m_opt.quality != PCM_TRANSCODE_MEDIUM;
+        ok = resampler.resample_create(high, large, rchan, in->samplerate, file->samplerate, block * rchan, RESAMPLE_ENGINE_SRC) == 0;
+    }
+
+    unsigned int avail = 0, used_off = 0;
+    while (ok && written < want)
+    {
+        if (avail == 0 && read_pos < read_end)
+        {
+            unsigned int n = read_end - read_pos > block ? block : (unsigned int)(read_end - read_pos);
+            unsigned int got = fread(raw, in_bytes, n, fp);
+            if (got < n) // 文件在处理期间被截断
+                read_end = read_pos + got;
+            read_pos += got;
+            avail = got;
+            used_off = 0;
+            if (got > 0)
+                conv_in(raw, resample ? (void *)fin : (void *)obuf, got, &map_in);
+        }
+        bool end = read_pos >= read_end;
+
+        unsigned int gen = avail, start = 0;
+        const void *src = obuf;
+        if (resample)
+        {
+            unsigned int used = 0;
+            int ret = resampler.resample_stream(fin + used_off * rchan, avail, &used, fout, out_block, end);
+            if (ret < 0)
+            {
+                ok = false;
+                break;
+            }
+            gen = ret;
+            used_off += used;
+            avail -= used;
+            if (gen == 0 && used == 0 && end) // 滤波器中剩余的点也已输出
+                break;
+        }
+        else
+        {
+            avail = 0;
+            if (gen == 0 && end)
+                break;
+        }
+
+        if (discard > 0)
+        {
+            start = discard < gen ? (unsigned int)discard : gen;
+            discard -= start;
+        }
+        unsigned int keep = gen - start;
+        if (keep > want - written)
+            keep = (unsigned int)(want - written);
+        if (keep == 0)
+            continue;
+        if (resample)
+            conv_out(fout + start * rchan, obuf, keep, &map_out);
+        else
+            src = obuf + start * out_bytes;
+
+        ssize_t len = (ssize_t)keep * out_bytes;
+        if (pwrite(fd, src, len, file->out_offset + (chunk->out_start + written) * out_bytes) != len)
+        {
+            LOG("write %s: %s\n", file->output.c_str(), strerror(errno));
+            ok = false;
+        }
+        written += keep;
+    }
+
+    /* 重采样器在输入结束时少给的点(不超过一两个)，输出文件已预先按长度建立，保持为0 */
+    if (ok && written + 4 < want)
+    {
+        LOG("%s: chunk %llu~%llu short %llu frames\n", file->input.c_str(), chunk->in_start, chunk->in_end, want - written);
+        ok = false;
+    }
+
+    delete []raw;
+    delete []fin;
+    delete []fout;
+    delete []obuf;
+    fclose(fp);
+    ::close(fd);
+    return ok;
+}
+
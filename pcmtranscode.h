@@ -0,0 +1,98 @@
+/*
+ * 离线批量转换：WAV/裸PCM文件的采样率、声道和采样格式转换，多个文件和长文件的分段在线程池中并行处理
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_TRANSCODE_H__
+#define __FREE_PCM_TRANSCODE_H__
+#include <vector>
+#include <string>
+
+#include "pcmformat.h"
+#include "pcmwav.h"
+
+#define PCM_TRANSCODE_BLOCK_FRAMES 4096 // 每次读取的输入帧数，内存占用与文件大小无关
+#define PCM_TRANSCODE_OVERLAP_MS 100 // 分段两侧多读的输入，远大于重采样滤波器的长度，接缝处与不分段的结果相同
+
+/* 重采样质量，对应libsamplerate的SRC_SINC_FASTEST/MEDIUM_QUALITY/BEST_QUALITY */
+enum
+{
+    PCM_TRANSCODE_FAST = 0,
+    PCM_TRANSCODE_MEDIUM,
+    PCM_TRANSCODE_BEST,
+};
+
+typedef struct PcmTranscodeOpt_t
+{
+    unsigned int samplerate; // 输出采样率，0表示与输入相同
+    unsigned int channel; // 输出声道数，0表示与输入相同，按pcm_chmap_default()转换
+    const char *chmap; // 声道映射，按每个输入文件的声道数用pcm_chmap_parse()解析，NULL表示默认映射，指定时忽略channel
+    int format; // 输出格式PCM_FMT_*，<0表示与输入相同
+    int quality; // PCM_TRANSCODE_*
+    int threads; // <=0使用在线CPU核数
+    unsigned int chunk_sec; // 长于这个时长的文件分段并行处理，0表示不分段
+    bool raw_out; // 输出不带WAV头
+    unsigned int raw_rate; // 没有WAV头的输入按以下参数读取，raw_rate为0时不接受裸PCM
+    unsigned int raw_channel;
+    int raw_format;
+}PcmTranscodeOpt_t;
+
+/* 一个文件的转换参数和结果 */
+typedef struct PcmTranscodeFile_t
+{
+    std::string input;
+    std::string output;
+    PcmWavInfo_t in; // 输入格式和数据位置
+    unsigned int samplerate; // 输出格式
+    unsigned int channel;
+    int format;
+    bool mapped; // 按map转换声道，否则按pcm_chmap_default()
+    PcmChannelMap_t map;
+    unsigned long long in_frames;
+    unsigned long long out_frames; // 输出帧数按比例由输入帧数确定，与分段无关
+    long out_offset; // 输出数据在文件中的偏移
+    int chunks;
+    int failed; // 任一分段失败时置1，由各分段原子写
+}PcmTranscodeFile_t;
+
+/* 一个分段：负责输入[in_start, in_end)对应的输出[out_start, out_end) */
+typedef struct PcmTranscodeChunk_t
+{
+    PcmTranscodeFile_t *file;
+    unsigned long long in_start, in_end;
+    unsigned long long out_start, out_end;
+}PcmTranscodeChunk_t;
+
+/*
+ * 分段的边界取在输入输出帧数都是整数的位置(输入是rate_in/gcd的倍数)，每段两侧各多读
+ * PCM_TRANSCODE_OVERLAP_MS的输入，重采样后丢掉多出的输出，各段按输出位置直接写入文件，拼接处没有接缝。
+ * 各段读写都是流式的，每个线程只占用几个PCM_TRANSCODE_BLOCK_FRAMES大小的缓冲
+ */
+class PcmTranscoder
+{
+public:
+    PcmTranscoder(const PcmTranscodeOpt_t *opt);
+    ~PcmTranscoder();
+
+    /* 读取输入的文件头，划分分段，建立长度已定的输出文件；return：格式不支持或文件打不开返回false */
+    bool addFile(const char *input, const char *output);
+    /* 所有分段投递到线程池并等待完成；return：失败的文件数 */
+    int run(void);
+
+    int files(void) {return (int)m_files.size();}
+    const PcmTranscodeFile_t *file(int index) {return m_files[index];}
+
+private:
+    static void ChunkTaskStub(void *obj, void *arg);
+    bool processChunk(PcmTranscodeChunk_t *chunk);
+
+private:
+    PcmTranscodeOpt_t m_opt;
+    std::vector<PcmTranscodeFile_t *> m_files;
+    std::vector<PcmTranscodeChunk_t> m_chunks;
+    unsigned int m_pending; // 未完成的分段数，归零时唤醒run()
+};
+
+#endif
+
@@ -0,0 +1,190 @@
+/*
+ * 捕获端语音检测：每个捕获周期计量一次峰值和均方根电平，按自适应噪声底判断语音，带拖尾(hangover)
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <math.h>
+
+#include "pcmvad.h"
+#include "pcmkernel.h"
+
+#define PCM_VAD_CHUNK 256 // 非16bit格式每次转换的样本数，在栈上转换
+
+void pcm_vad_default_config(PcmVadConfig_t *cfg)
+{
+    cfg->threshold_db = 9.0f;
+    cfg->floor_db = -55.0f;
+    cfg->hangover_ms = 300;
+    cfg->attack_ms = 0;
+}
+
+static float level_db(float level)
+{
+    float db = level > 0 ? 20.0f * log10f(level) : PCM_VAD_MIN_DB;
+    return db < PCM_VAD_MIN_DB ? PCM_VAD_MIN_DB : db;
+}
+
+static void store_db(int *counter, float db)
+{
+    __atomic_store_n(counter, (int)lrintf(db * 100.0f), __ATOMIC_RELAXED);
+}
+
+PcmVad::PcmVad()
+{
+    pcm_vad_default_config(&m_cfg);
+    m_samplerate = 0;
+    m_channel = 0;
+    m_format = PCM_FMT_S16;
+    m_toFloat = NULL;
+    m_peakCdb = m_rmsCdb = m_noiseCdb = (int)(PCM_VAD_MIN_DB * 100);
+    m_speechNow = 0;
+    m_speechPeriods = m_silencePeriods = m_segments = 0;
+    reset();
+}
+
+void PcmVad::configure(const PcmVadConfig_t *cfg)
+{
+    m_cfg = *cfg;
+    reset();
+}
+
+void PcmVad::setFormat(unsigned int samplerate, unsigned int channel, int format)
+{
+    if (samplerate == m_samplerate && channel == m_channel && format == m_format)
+        return;
+    m_samplerate = samplerate;
+    m_channel = channel;
+    m_format = format;
+    m_toFloat = format == PCM_FMT_S16 ? NULL : pcm_format_converter(format, 1, PCM_FMT_FLOAT, 1);
+    reset();
+}
+
+void PcmVad::reset(void)
+{
+    m_speech = false;
+    m_primed = false;
+    m_noise = PCM_VAD_MIN_DB;
+    m_activeUs = m_quietUs = 0;
+    __atomic_store_n(&m_speechNow, 0, __ATOMIC_RELAXED);
+}
+
+/* 16bit用SIMD内核，其他格式分块转为float后计量 */
+void PcmVad::measure(const char *data, int samples, float *peak, float *rms)
+{
+    if (m_format == PCM_FMT_S16)
+    {
+        int pk = 0;
+        unsigned long long sumsq = 0;
+        pcm_kernels()->level_s16((const short *)data, samples, &pk, &sumsq);
+        *peak = pk / 32768.0f;
+        *rms = sqrtf((float)((double)sumsq / samples)) / 32768.0f;
+        return;
+    }
+
+    float buf[PCM_VAD_CHUNK];
+    float pk = 0;
+    double sumsq = 0;
+    int bytes = pcm_format_bytes(m_format);
+    for (int i = 0; i < samples; i += PCM_VAD_CHUNK)
+    {
+        int n = samples - i < PCM_VAD_CHUNK ? samples - i : PCM_VAD_CHUNK;
+        const float *in = buf;
+        if (m_format == PCM_FMT_FLOAT)
+            in = (const float *)(data + (size_t)i * bytes);
+        else
+            m_toFloat(data + (size_t)i * bytes, buf, n);
+        float chunk_pk = 0, chunk_sq = 0;
+        for (int k = 0; k < n; k++)
+        {
+            float v = fabsf(in[k]);
+            chunk_pk = v > chunk_pk ? v : chunk_pk;
+            chunk_sq += in[k] * in[k];
+        }
+        pk = chunk_pk > pk ? chunk_pk : pk;
+        sumsq += chunk_sq;
+    }
+    *peak = pk;
+    *rms = sqrtf((float)(sumsq / samples));
+}
+
+/*
+ * 电平高于floor_db且高出噪声底threshold_db为语音；噪声底在电平低于它时较快跟随，
+ * 高于它时每秒最多上升PCM_VAD_NOISE_RISE_DB。
+ * 语音持续attack_ms后开始语音段(START)，静音超过hangover_ms后结束(END标在第一个静音周期上)
+ */
+void PcmVad::process(const char *data, int size, PcmFrameInfo_t *info)
+{
+    int samples = (m_channel && m_format >= 0) ? size / pcm_format_bytes(m_format) : 0;
+    int frames = m_channel ? samples / m_channel : 0;
+    if (frames <= 0 || !m_samplerate || (m_format != PCM_FMT_S16 && !m_toFloat))
+        return;
+
+    float peak, rms;
+    measure(data, samples, &peak, &rms);
+    float level = level_db(rms);
+    long long period_us = (long long)frames * 1000000 / m_samplerate;
+    float period_s = period_us / 1000000.0f;
+
+    if (!m_primed)
+    {
+        m_noise = level;
+        m_primed = true;
+    }
+    bool active = level > m_cfg.floor_db && level > m_noise + m_cfg.threshold_db;
+    if (level < m_noise)
+    {
+        float k = period_s * 1000.0f / PCM_VAD_NOISE_FALL_MS;
+        m_noise += (level - m_noise) * (k < 1.0f ? k : 1.0f);
+    }
+    else
+    {
+        float rise = PCM_VAD_NOISE_RISE_DB * period_s;
+        m_noise += (level - m_noise) < rise ? (level - m_noise) : rise;
+    }
+
+    int vad = 0;
+    if (!m_speech)
+    {
+        m_activeUs = active ? m_activeUs + period_us : 0;
+        if (active && m_activeUs >= (long long)m_cfg.attack_ms * 1000)
+        {
+            m_speech = true;
+            m_quietUs = 0;
+            vad |= PCM_VAD_START;
+            pcm_stat_add(&m_segments, 1);
+        }
+    }
+    else
+    {
+        m_quietUs = active ? 0 : m_quietUs + period_us;
+        if (m_quietUs > (long long)m_cfg.hangover_ms * 1000)
+        {
+            m_speech = false;
+            m_activeUs = 0;
+            vad |= PCM_VAD_END;
+        }
+    }
+    vad |= m_speech ? PCM_VAD_SPEECH : PCM_VAD_SILENCE;
+
+    info->peak = peak;
+    info->rms = rms;
+    info->vad = vad;
+
+    store_db(&m_peakCdb, level_db(peak));
+    store_db(&m_rmsCdb, level);
+    store_db(&m_noiseCdb, m_noise);
+    __atomic_store_n(&m_speechNow, m_speech ? 1 : 0, __ATOMIC_RELAXED);
+    pcm_stat_add(m_speech ? &m_speechPeriods : &m_silencePeriods, 1);
+}
+
+void PcmVad::getStats(PcmVadStat_t *stat)
+{
+    stat->peak_db = __atomic_load_n(&m_peakCdb, __ATOMIC_RELAXED) / 100.0f;
+    stat->rms_db = __atomic_load_n(&m_rmsCdb, __ATOMIC_RELAXED) / 100.0f;
+    stat->noise_db = __atomic_load_n(&m_noiseCdb, __ATOMIC_RELAXED) / 100.0f;
+    stat->speech = __atomic_load_n(&m_speechNow, __ATOMIC_RELAXED);
+    stat->speech_periods = __atomic_load_n(&m_speechPeriods, __ATOMIC_RELAXED);
+    stat->silence_periods = __atomic_load_n(&m_silencePeriods, __ATOMIC_RELAXED);
+    stat->segments = __atomic_load_n(&m_segments, __ATOMIC_RELAXED);
+}
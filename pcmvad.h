@@ -0,0 +1,84 @@
+/*
+ * 捕获端语音检测：每个捕获周期计量一次峰值和均方根电平，按自适应噪声底判断语音，带拖尾(hangover)
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_VAD_H__
+#define __FREE_PCM_VAD_H__
+#include "pcmring.h"
+#include "pcmformat.h"
+
+#define PCM_VAD_MIN_DB -120.0f // 电平下限，全零的周期按这个值计
+#define PCM_VAD_NOISE_RISE_DB 1.0f // 噪声底每秒最多上升的dB数，持续的语音不会很快被当作噪声
+#define PCM_VAD_NOISE_FALL_MS 100 // 电平低于噪声底时噪声底跟随的时间常数
+
+typedef struct PcmVadConfig_t
+{
+    float threshold_db; // 电平高出噪声底这么多判为语音
+    float floor_db; // 低于这个电平(dBFS)的总是静音
+    unsigned int hangover_ms; // 语音结束后继续判为语音的时长，避免词间停顿把一句话切断
+    unsigned int attack_ms; // 连续这么长的语音才开始一个语音段，0表示第一个语音周期就开始
+}PcmVadConfig_t;
+
+/* 默认：高出噪声底9dB且高于-55dBFS为语音，拖尾300ms */
+void pcm_vad_default_config(PcmVadConfig_t *cfg);
+
+/* 电平和检测统计 */
+typedef struct PcmVadStat_t
+{
+    float peak_db; // 最近一个周期的峰值，dBFS
+    float rms_db; // 最近一个周期的均方根电平，dBFS
+    float noise_db; // 当前的噪声底估计
+    int speech; // 1：当前处于语音段
+    unsigned long long speech_periods; // 判为语音(含拖尾)的周期数
+    unsigned long long silence_periods; // 判为静音的周期数
+    unsigned long long segments; // 语音段数
+}PcmVadStat_t;
+
+/*
+ * 只在捕获线程中调用process()，统计可以在任意线程读取
+ */
+class PcmVad
+{
+public:
+    PcmVad();
+
+    /* 修改参数并重新开始检测 */
+    void configure(const PcmVadConfig_t *cfg);
+    /* 设置捕获格式，格式改变时重新开始检测 */
+    void setFormat(unsigned int samplerate, unsigned int channel, int format);
+    void reset(void);
+
+    /* 计量一个捕获周期(交错数据，所有声道一起计)，结果写入info的peak/rms/vad */
+    void process(const char *data, int size, PcmFrameInfo_t *info);
+    void getStats(PcmVadStat_t *stat);
+
+private:
+    void measure(const char *data, int samples, float *peak, float *rms);
+
+private:
+    PcmVadConfig_t m_cfg;
+    unsigned int m_samplerate;
+    unsigned int m_channel;
+    int m_format;
+    PcmFormatConvFunc m_toFloat; // 非16bit格式按单声道逐样本转为float后计量
+
+    bool m_speech; // 处于语音段
+    bool m_primed; // 已用第一个周期初始化噪声底
+    float m_noise; // 噪声底，dBFS
+    long long m_activeUs; // 未进入语音段时连续语音的时长
+    long long m_quietUs; // 语音段内连续静音的时长
+
+    /* 统计，只由捕获线程写；电平为百分之一dB */
+    int m_peakCdb;
+    int m_rmsCdb;
+    int m_noiseCdb;
+    int m_speechNow;
+    unsigned long long m_speechPeriods;
+    unsigned long long m_silencePeriods;
+    unsigned long long m_segments;
+};
+
+#endif
+
@@ -0,0 +1,125 @@
+/*
+ * WAV文件头：解析RIFF/WAVE的fmt和data块
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <string.h>
+
+#include "pcmwav.h"
+#include "pcmlog.h"
+
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+static unsigned int wav_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int wav_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void wav_put16(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void wav_put32(unsigned char *p, unsigned int v)
+{
+    wav_put16(p, v & 0xffff);
+    wav_put16(p + 2, v >> 16);
+}
+
+static int wav_format(unsigned int tag, unsigned int bits)
+{
+    if (tag == WAV_FORMAT_PCM)
+    {
+        switch (bits)
+        {
+        case 16: return PCM_FMT_S16;
+        case 24: return PCM_FMT_S24_3LE;
+        case 32: return PCM_FMT_S32;
+        default: return -1;
+        }
+    }
+    if (tag == WAV_FORMAT_FLOAT && bits == 32)
+        return PCM_FMT_FLOAT;
+    return -1;
+}
+
+bool pcm_wav_read_header(FILE *fp, PcmWavInfo_t *info)
+{
+    unsigned char head[12], chunk[8], fmt[40];
+    bool has_fmt = false;
+
+    memset(info, 0, sizeof(*info));
+    if (fread(head, 1, sizeof(head), fp) != sizeof(head) || memcmp(head, "RIFF", 4) || memcmp(head + 8, "WAVE", 4))
+        return false;
+
+    /* 块按偶数字节对齐，fmt之前可能有LIST等其他块 */
+    while (fread(chunk, 1, sizeof(chunk), fp) == sizeof(chunk))
+    {
+        unsigned int size = wav_le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4))
+        {
+            unsigned int len = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (len < 16 || fread(fmt, 1, len, fp) != len)
+                return false;
+            if (size > len)
+                fseek(fp, size - len, SEEK_CUR);
+            if (size & 1)
+                fseek(fp, 1, SEEK_CUR);
+
+            unsigned int tag = wav_le16(fmt);
+            unsigned int bits = wav_le16(fmt + 14);
+            if (tag == WAV_FORMAT_EXTENSIBLE && len >= 26)
+                tag = wav_le16(fmt + 24); // SubFormat GUID的前两字节
+            info->format = wav_format(tag, bits);
+            info->channel = wav_le16(fmt + 2);
+            info->samplerate = wav_le32(fmt + 4);
+            if (info->format < 0 || info->channel == 0 || info->samplerate == 0)
+            {
+                LOG("unsupported wav format: tag %u, %u bits, %u channels\n", tag, bits, info->channel);
+                return false;
+            }
+            has_fmt = true;
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            if (!has_fmt)
+                return false;
+            info->data_offset = ftell(fp);
+            info->data_bytes = (size == 0 || size == 0xFFFFFFFFu) ? -1 : (long long)size;
+            return true;
+        }
+        else if (fseek(fp, size + (size & 1), SEEK_CUR) != 0)
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+void pcm_wav_make_header(unsigned char *header, unsigned int samplerate, unsigned int channel, int format, long long data_bytes)
+{
+    unsigned int bytes = pcm_format_bytes(format);
+    unsigned int size = (data_bytes < 0 || data_bytes > 0xFFFFFFFFLL - 36) ? 0xFFFFFFFFu : (unsigned int)data_bytes;
+
+    memcpy(header, "RIFF", 4);
+    wav_put32(header + 4, size == 0xFFFFFFFFu ? size : size + 36);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    wav_put32(header + 16, 16);
+    wav_put16(header + 20, format == PCM_FMT_FLOAT ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM);
+    wav_put16(header + 22, channel);
+    wav_put32(header + 24, samplerate);
+    wav_put32(header + 28, samplerate * channel * bytes);
+    wav_put16(header + 32, channel * bytes);
+    wav_put16(header + 34, bytes * 8);
+    memcpy(header + 36, "data", 4);
+    wav_put32(header + 40, size);
+}
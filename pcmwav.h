@@ -0,0 +1,34 @@
+/*
+ * WAV文件头：解析RIFF/WAVE的fmt和data块
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __FREE_PCM_WAV_H__
+#define __FREE_PCM_WAV_H__
+#include <stdio.h>
+
+#include "pcmformat.h"
+
+#define PCM_WAV_HEADER_BYTES 44 // pcm_wav_make_header()生成的文件头长度
+
+typedef struct PcmWavInfo_t
+{
+    unsigned int samplerate;
+    unsigned int channel;
+    int format; // PCM_FMT_*
+    long data_offset; // data块数据的文件偏移
+    long long data_bytes; // data块长度，<0表示到文件结束(录音中途停止时长度字段未回填)
+}PcmWavInfo_t;
+
+/*
+ * 读取WAV文件头，支持PCM 16/24/32位和IEEE float 32位，含WAVE_FORMAT_EXTENSIBLE
+ * return：成功时fp位于data块数据开始处，不是WAV或格式不支持返回false
+ */
+bool pcm_wav_read_header(FILE *fp, PcmWavInfo_t *info);
+
+/* 生成PCM_WAV_HEADER_BYTES字节的文件头，data_bytes超过4GB时长度字段填0xFFFFFFFF */
+void pcm_wav_make_header(unsigned char *header, unsigned int samplerate, unsigned int channel, int format, long long data_bytes);
+
+#endif
+
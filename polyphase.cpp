@@ -0,0 +1,264 @@
+/*
+ * 定点多相FIR重采样：滤波器系数表在编译期生成，只支持常用的固定比例
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "polyphase.h"
+#include "pcmkernel.h"
+
+#if __cplusplus < 201402L
+#error "polyphase.cpp needs C++14 constexpr (g++ -std=gnu++14 or newer)"
+#endif
+
+//////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+// 编译期数学函数，<math.h>中的函数不是constexpr
+#define PP_PI 3.14159265358979323846
+#define PP_CUTOFF 0.90 // 截止频率，相对较低一侧的奈奎斯特频率
+#define PP_BETA 8.0 // Kaiser窗参数，阻带约80dB
+#define PP_SHIFT 14 // 系数为Q14，低通系数绝对值之和接近2，Q15时32位累加可能溢出
+#define PP_ONE (1 << PP_SHIFT)
+
+static constexpr double cx_sin(double x)
+{
+    long long n = (long long)(x / (2 * PP_PI) + (x >= 0 ? 0.5 : -0.5));
+    x -= n * 2 * PP_PI; // [-pi, pi]
+    double term = x, sum = x;
+    for (int i = 1; term > 1e-18 || term < -1e-18; i++)
+    {
+        term *= -x * x / ((2 * i) * (2 * i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+static constexpr double cx_sqrt(double x)
+{
+    if (x <= 0)
+        return 0;
+    double r = x > 1 ? x : 1, last = 0;
+    while (r != last)
+    {
+        last = r;
+        r = (r + x / r) / 2;
+    }
+    return r;
+}
+
+/* 第一类零阶修正贝塞尔函数 */
+static constexpr double cx_bessel_i0(double x)
+{
+    double term = 1, sum = 1;
+    for (int k = 1; term > sum * 1e-17; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * 原型低通滤波器工作在L倍输入采样率上，共L*K个抽头，截止频率为
+ * PP_CUTOFF/(2*R)(R=max(L,M))，Kaiser窗。拆成L相，每相K个抽头，
+ * 每相单独归一化使直流增益恰为1(Q14整数和为16384)，避免插值后出现周期性纹波
+ */
+template <int L, int R, int K>
+struct PolyphaseTable
+{
+    short coefs[L][K];
+    int abs_sum; // 各相系数绝对值之和的最大值，决定32位累加是否会溢出
+
+    constexpr PolyphaseTable() : coefs(), abs_sum(0)
+    {
+        const int N = L * K;
+        const double fc = PP_CUTOFF / (2.0 * R);
+        const double center = (N - 1) / 2.0;
+        const double i0_beta = cx_bessel_i0(PP_BETA);
+
+        for (int p = 0; p < L; p++)
+        {
+            double tmp[K] = {};
+            double sum = 0;
+            for (int k = 0; k < K; k++)
+            {
+                int n = p + k * L;
+                double x = 2 * fc * (n - center);
+                double sinc = (x == 0) ? 1.0 : cx_sin(PP_PI * x) / (PP_PI * x);
+                double r = 2.0 * n / (N - 1) - 1;
+                double w = cx_bessel_i0(PP_BETA * cx_sqrt(1 - r * r)) / i0_beta;
+                tmp[K - 1 - k] = sinc * w; // 倒排，输出点 = coefs[phase]与输入的正向点积
+                sum += sinc * w;
+            }
+
+            int isum = 0, imax = 0, asum = 0;
+            for (int m = 0; m < K; m++)
+            {
+                double v = tmp[m] / sum * PP_ONE;
+                int q = (int)(v + (v >= 0 ? 0.5 : -0.5));
+                coefs[p][m] = (short)(q > 32767 ? 32767 : (q < -32768 ? -32768 : q));
+                isum += coefs[p][m];
+                if (tmp[m] > tmp[imax])
+                    imax = m;
+            }
+            coefs[p][imax] += PP_ONE - isum; // 舍入误差补到中心抽头
+            for (int m = 0; m < K; m++)
+                asum += coefs[p][m] < 0 ? -coefs[p][m] : coefs[p][m];
+            if (asum > abs_sum)
+                abs_sum = asum;
+        }
+    }
+};
+
+/* 相同的L和max(L,M)共用一张表，如16k->44.1k与16k->22.05k，16k->8k与32k->16k */
+static constexpr PolyphaseTable<1, 2, 96> s_table_1_2 = PolyphaseTable<1, 2, 96>();
+static constexpr PolyphaseTable<2, 2, 48> s_table_2_2 = PolyphaseTable<2, 2, 48>();
+static constexpr PolyphaseTable<1, 3, 144> s_table_1_3 = PolyphaseTable<1, 3, 144>();
+static constexpr PolyphaseTable<1, 6, 288> s_table_1_6 = PolyphaseTable<1, 6, 288>();
+static constexpr PolyphaseTable<441, 441, 48> s_table_441 = PolyphaseTable<441, 441, 48>();
+
+/* 点积用int32累加：|样本|<=2^15，系数绝对值之和<2^16就不会溢出 */
+static_assert(s_table_1_2.abs_sum < 65536, "polyphase table 1/2 may overflow");
+static_assert(s_table_2_2.abs_sum < 65536, "polyphase table 2/2 may overflow");
+static_assert(s_table_1_3.abs_sum < 65536, "polyphase table 1/3 may overflow");
+static_assert(s_table_1_6.abs_sum < 65536, "polyphase table 1/6 may overflow");
+static_assert(s_table_441.abs_sum < 65536, "polyphase table 441 may overflow");
+
+static const PolyphaseFilter_t s_filters[] =
+{
+    {1, 2, 96, &s_table_1_2.coefs[0][0]}, // 16k->8k, 48k->24k
+    {2, 1, 48, &s_table_2_2.coefs[0][0]}, // 8k->16k, 22.05k->44.1k
+    {1, 3, 144, &s_table_1_3.coefs[0][0]}, // 48k->16k
+    {1, 6, 288, &s_table_1_6.coefs[0][0]}, // 48k->8k
+    {441, 160, 48, &s_table_441.coefs[0][0]}, // 16k->44.1k
+    {441, 320, 48, &s_table_441.coefs[0][0]}, // 16k->22.05k, 8k->11.025k
+};
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b)
+    {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+//////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+// polyphase impl
+CPolyphaseResampler::CPolyphaseResampler()
+{
+    filter = NULL;
+    dot = NULL;
+    channels = 1;
+    in_frames = out_frames = 0;
+    pos = 0;
+    history = NULL;
+}
+
+CPolyphaseResampler::~CPolyphaseResampler()
+{
+    destroy();
+}
+
+const PolyphaseFilter_t *CPolyphaseResampler::find_filter(unsigned int rate_in, unsigned int rate_out, unsigned int frames)
+{
+    if (!rate_in || !rate_out)
+        return NULL;
+
+    unsigned int g = gcd(rate_in, rate_out);
+    unsigned int up = rate_out / g, down = rate_in / g;
+    if (frames % down) // 每帧输出点数不是整数，相位会逐帧漂移
+        return NULL;
+
+    for (unsigned int i = 0; i < sizeof(s_filters)/sizeof(s_filters[0]); i++)
+    {
+        if (s_filters[i].up == up && s_filters[i].down == down)
+            return &s_filters[i];
+    }
+    return NULL;
+}
+
+int CPolyphaseResampler::create(unsigned int channel_count, unsigned int rate_in, unsigned int rate_out, unsigned int frames)
+{
+    filter = find_filter(rate_in, rate_out, frames);
+    if (!filter)
+    {
+        printf("Error creating polyphase resample: %u->%u, %u frames not supported\n", rate_in, rate_out, frames);
+        return -1;
+    }
+
+    channels = channel_count;
+    in_frames = frames;
+    out_frames = frames / filter->down * filter->up;
+    pos = 0;
+    dot = pcm_kernels()->dot_s16;
+    history = (short *)calloc((filter->taps - 1 + in_frames) * channels, sizeof(short));
+
+    printf("type=polyphase (fixed-point %u taps/phase, %u phases), ch=%u, in/out rate=%u/%u\n",
+        filter->taps, filter->up, channel_count, rate_in, rate_out);
+    return 0;
+}
+
+/*
+ * 输出第n点对应上采样时间n*M，落在输入base=pos/L之后、相位pos%L上，
+ * 即coefs[phase]与输入[base-K+1, base]的点积；历史点放在最前面，下标整体偏移K-1
+ */
+void CPolyphaseResampler::run(const short *input, unsigned int in_map, short *output, unsigned int out_map)
+{
+    if (!filter)
+        return;
+
+    const unsigned int taps = filter->taps;
+    const unsigned int stride = taps - 1 + in_frames;
+
+    /* 去交错追加到各声道的历史点之后 */
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        short *dst = history + c * stride + taps - 1;
+        if (in_map == 1)
+            memcpy(dst, input, in_frames * sizeof(short));
+        else
+        {
+            for (unsigned int i = 0; i < in_frames; i++)
+                dst[i] = input[i * in_map + c];
+        }
+    }
+
+    for (unsigned int n = 0; n < out_frames; n++)
+    {
+        const short *coefs = filter->coefs + (pos % filter->up) * taps;
+        const unsigned int base = pos / filter->up;
+        for (unsigned int c = 0; c < channels; c++)
+        {
+            int acc = dot(coefs, history + c * stride + base, taps);
+            acc = (acc + (PP_ONE >> 1)) >> PP_SHIFT;
+            short v = (short)(acc > 32767 ? 32767 : (acc < -32768 ? -32768 : acc));
+            output[n * out_map + c] = v;
+            if (out_map != channels) // 单声道复制到右声道
+                output[n * out_map + 1] = v;
+        }
+        pos += filter->down;
+    }
+    pos -= in_frames * filter->up; // 每帧输出点数为整数，这里回到0
+
+    /* 保留最后taps-1个输入点作为下一帧的历史 */
+    for (unsigned int c = 0; c < channels; c++)
+    {
+        short *h = history + c * stride;
+        memmove(h, h + in_frames, (taps - 1) * sizeof(short));
+    }
+}
+
+void CPolyphaseResampler::destroy(void)
+{
+    if (history)
+        free(history);
+    history = NULL;
+    filter = NULL;
+}
+
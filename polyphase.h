@@ -0,0 +1,46 @@
+/*
+ * 定点多相FIR重采样：滤波器系数表在编译期生成，只支持常用的固定比例
+ * Copyright FreeCode. All Rights Reserved.
+ * MIT License (https://opensource.org/licenses/MIT)
+ * 2024 by liuqingshuige
+ */
+#ifndef __AUDIO_POLYPHASE_H__
+#define __AUDIO_POLYPHASE_H__
+
+/* 插值L倍、抽取M倍的多相滤波器，coefs[phase][taps]，Q14，已按点积顺序倒排 */
+typedef struct PolyphaseFilter_t
+{
+    unsigned int up; // L
+    unsigned int down; // M
+    unsigned int taps; // 每相抽头数
+    const short *coefs;
+}PolyphaseFilter_t;
+
+class CPolyphaseResampler
+{
+public:
+    CPolyphaseResampler();
+    ~CPolyphaseResampler();
+
+public:
+    /* 查找rate_in->rate_out的内置滤波器，frames为每帧输入的帧数(每声道采样点数)，
+     * 每帧输出点数必须是整数，否则返回NULL */
+    static const PolyphaseFilter_t *find_filter(unsigned int rate_in, unsigned int rate_out, unsigned int frames);
+
+    int create(unsigned int channel_count, unsigned int rate_in, unsigned int rate_out, unsigned int frames);
+    /* in_map/out_map：输入/输出的声道数，单声道重采样时可以是2(输入取左声道/输出复制) */
+    void run(const short *input, unsigned int in_map, short *output, unsigned int out_map);
+    unsigned int get_output_frames(void) {return out_frames;}
+    void destroy(void);
+
+private:
+    const PolyphaseFilter_t *filter;
+    int (*dot)(const short *a, const short *b, int n);
+    unsigned int channels;
+    unsigned int in_frames, out_frames;
+    unsigned int pos; // 下一个输出点在本帧输入中的位置，单位1/L个输入点
+    short *history; // 每声道taps-1个历史点+本帧输入，按声道分开存放
+};
+
+#endif
+
@@ -1,5 +1,5 @@
 /*
- * 音频重采样封装：libsamplerate实现
+ * 音频重采样封装：libsamplerate实现，常用比例可选内置定点多相FIR实现
  * Copyright FreeCode. All Rights Reserved.
  * MIT License (https://opensource.org/licenses/MIT)
  * 2024 by liuqingshuige
@@ -10,16 +10,30 @@
 
 #include "resampler.h"
 #include "samplerate.h"
+#include "pcmkernel.h"
+#include "polyphase.h"
+#include "pcmdsp.h"
 
 //////>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
 // libsamplerate impl
 CResampleEx::CResampleEx()
 {
     state = NULL;
+    fixed = NULL;
+    fixed_in = fixed_out = NULL;
+    engine = RESAMPLE_ENGINE_SRC;
     in_samples = out_samples = 8000;
     frame_in = frame_out = NULL;
-    in_extra = out_extra = 0;
+    in_pending = out_pending = out_start = out_capacity = 0;
+    slot_at = NULL;
+    phase = 0;
+    delay = 0;
+    batch = 1;
+    channels = 1;
+    in_map = out_map = 1;
+    dsp = NULL;
     ratio = 1.0;
+    rate_in = rate_out = 8000;
 }
 
 CResampleEx::~CResampleEx()
@@ -33,10 +47,34 @@ int CResampleEx::resample_create(
     unsigned int channel_count,
     unsigned int rate_in,
     unsigned int rate_out,
-    unsigned int samples_per_frame)
+    unsigned int samples_per_frame,
+    int engine)
 {
     int type, err;
 
+    channels = channel_count;
+    in_map = out_map = channel_count;
+    in_samples = samples_per_frame;
+    this->rate_in = rate_in;
+    this->rate_out = rate_out;
+    this->engine = RESAMPLE_ENGINE_SRC;
+
+    /* 内置定点实现，比例不支持时退回libsamplerate */
+    if (engine == RESAMPLE_ENGINE_FIXED)
+    {
+        if (CPolyphaseResampler::find_filter(rate_in, rate_out, samples_per_frame / channel_count))
+        {
+            fixed = new CPolyphaseResampler();
+            fixed->create(channel_count, rate_in, rate_out, samples_per_frame / channel_count);
+            out_samples = fixed->get_output_frames() * channel_count;
+            fixed_in = (short *)calloc(in_samples, sizeof(short));
+            fixed_out = (short *)calloc(out_samples, sizeof(short));
+            this->engine = RESAMPLE_ENGINE_FIXED;
+            return 0;
+        }
+        printf("polyphase resample %u->%u not supported, use libsamplerate\n", rate_in, rate_out);
+    }
+
     /* Select conversion type */
     if (high_quality)
         type = large_filter ? SRC_SINC_BEST_QUALITY : SRC_SINC_MEDIUM_QUALITY;
@@ -54,12 +92,9 @@ int CResampleEx::resample_create(
     /* Calculate ratio */
     ratio = rate_out * 1.0 / rate_in;
 
-    /* Calculate number of samples for input and output */
-    in_samples = samples_per_frame; /* 160 samples  */
-    out_samples = rate_out / (rate_in / samples_per_frame);
-
-    frame_in = (float *)calloc(in_samples + 8, sizeof(float));
-    frame_out = (float *)calloc(out_samples + 8, sizeof(float));
+    /* Calculate number of samples for input and output,
+     * samples_per_frame counts interleaved samples of all channels */
+    out_samples = (unsigned int)((unsigned long long)rate_out * (samples_per_frame / channels) / rate_in) * channels;
 
     /* Set the converter ratio */
     err = src_set_ratio((SRC_STATE *)state, ratio);
@@ -69,6 +104,10 @@ int CResampleEx::resample_create(
         return -1;
     }
 
+    delay = measure_delay();
+    alloc_frames(1);
+    reset_stream();
+
     /* Done */
     printf("type=%s (%s), ch=%d, in/out rate=%d/%d\n", 
         src_get_name(type), src_get_description(type),
@@ -76,64 +115,289 @@ int CResampleEx::resample_create(
     return 0;
 }
 
-void CResampleEx::resample_run(const short *input, short *output)
+/*
+ * 仅支持单声道重采样时输入为双声道(取左声道)或输出为双声道(复制)
+ */
+void CResampleEx::resample_set_mapping(unsigned int in_channels, unsigned int out_channels)
 {
-    SRC_DATA src_data;
-
-    /* Check! */
-    if (!state)
-        return;
+    in_map = (channels == 1 && in_channels == 2) ? 2 : channels;
+    out_map = (channels == 1 && out_channels == 2) ? 2 : channels;
+}
 
-    /* Convert samples to float */
-    src_short_to_float_array(input, frame_in, in_samples);
+/*
+ * 按count个周期分配，已有的待处理数据保留：frame_in开头多留一个周期给上次没用完的输入，
+ * frame_out多留滤波器延迟和一个周期给上次多生成的输出
+ */
+void CResampleEx::alloc_frames(unsigned int count)
+{
+    float *in = (float *)calloc(in_samples * (count + 1) + 8 * channels, sizeof(float));
+    unsigned int capacity = out_samples * (count + 1) + (delay + 8) * channels;
+    float *out = (float *)calloc(capacity, sizeof(float));
 
-    if (in_extra)
+    if (frame_in)
     {
-        for (unsigned int i=0; i<in_extra; ++i)
-            frame_in[in_samples+i] = frame_in[in_samples-1];
+        memcpy(in, frame_in, in_pending * sizeof(float));
+        free(frame_in);
     }
+    if (frame_out)
+    {
+        memcpy(out, frame_out, out_pending * sizeof(float));
+        free(frame_out);
+    }
+    if (slot_at)
+        free(slot_at);
+    frame_in = in;
+    frame_out = out;
+    out_capacity = capacity;
+    slot_at = (unsigned int *)calloc(count, sizeof(unsigned int));
+    batch = count;
+}
+
+/*
+ * libsamplerate要看到后面若干帧输入才能输出对应的点，用静音测出这部分延迟，单位为输出帧。
+ * 测完后复位，不影响之后的处理
+ */
+unsigned int CResampleEx::measure_delay(void)
+{
+    SRC_DATA src_data;
+    unsigned int frames = in_samples / channels * 2;
+    if (frames < 8192)
+        frames = 8192;
+    unsigned int expect = (unsigned int)((unsigned long long)frames * rate_out / rate_in);
+    float *in = (float *)calloc(frames * channels, sizeof(float));
+    float *out = (float *)calloc((expect + 16) * channels, sizeof(float));
 
-    /* Prepare SRC_DATA */
+    memset(&src_data, 0, sizeof(src_data));
+    src_data.data_in = in;
+    src_data.data_out = out;
+    src_data.input_frames = frames;
+    src_data.output_frames = expect + 16;
+    src_data.src_ratio = ratio;
+    src_process((SRC_STATE *)state, &src_data);
+    src_reset((SRC_STATE *)state);
+    free(in);
+    free(out);
+
+    unsigned int gen = src_data.output_frames_gen;
+    return expect > gen ? expect - gen : 0;
+}
+
+/* 从头开始：输出先放入滤波器延迟加2帧的静音，之后每个周期都能取满，不需要补点 */
+void CResampleEx::reset_stream(void)
+{
+    in_pending = 0;
+    out_pending = (delay + 2) * channels;
+    memset(frame_out, 0, out_pending * sizeof(float));
+    out_start = 0;
+    phase = 0;
+}
+
+/*
+ * frame_in中是上次没用完的输入和新装入的count个周期，全部送入src_process，
+ * 生成的点接在frame_out中尚未取走的点之后，没用完的输入移到frame_in开头留给下一次
+ */
+void CResampleEx::process(unsigned int count)
+{
+    SRC_DATA src_data;
+    unsigned int total_in = in_pending + in_samples * count;
+
+    /* 丢掉之前的周期已经取走的输出；生成不足时out_start可能超过out_pending，从这里重新对齐 */
+    unsigned int drop = out_start < out_pending ? out_start : out_pending;
+    if (drop)
+        memmove(frame_out, frame_out + drop, (out_pending - drop) * sizeof(float));
+    out_pending -= drop;
+    out_start = 0;
+
+    /* Prepare SRC_DATA, libsamplerate counts frames, not samples */
     memset(&src_data, 0, sizeof(src_data));
     src_data.data_in = frame_in;
-    src_data.data_out = frame_out;
-    src_data.input_frames = in_samples + in_extra;
-    src_data.output_frames = out_samples + out_extra;
+    src_data.data_out = frame_out + out_pending;
+    src_data.input_frames = total_in / channels;
+    src_data.output_frames = (out_capacity - out_pending) / channels;
     src_data.src_ratio = ratio;
 
     /* Process! */
     src_process((SRC_STATE *)state, &src_data);
 
-    /* Convert output back to short */
-    src_float_to_short_array(frame_out, output, src_data.output_frames_gen);
+    unsigned int used = src_data.input_frames_used * channels;
+    in_pending = total_in - used;
+    if (in_pending > in_samples) // 只有输出缓冲满时才会剩下，最多保留一个周期
+    {
+        used += in_pending - in_samples;
+        in_pending = in_samples;
+    }
+    if (in_pending)
+        memmove(frame_in, frame_in + used, in_pending * sizeof(float));
+    out_pending += src_data.output_frames_gen * channels;
+}
+
+void CResampleEx::resample_run(const short *input, short *output)
+{
+    if (fixed)
+    {
+        fixed->run(input, in_map, output, out_map);
+        if (dsp) // 定点引擎没有float中间结果，处理链自己转换
+            dsp->runS16(output, output, out_samples / channels, out_map);
+        return;
+    }
+
+    /* Check! */
+    if (!state)
+        return;
+
+    /* 与批量处理走同一条路径，逐个周期和批量的输出相同 */
+    resample_load(0, input);
+    resample_run_batch(1);
+    resample_fetch(0, output);
+}
+
+/*
+ * 浮点输入输出，不做声道映射，用于16bit以外的采样格式
+ * 定点引擎只能处理16bit，输入先量化为16bit
+ */
+void CResampleEx::resample_run_float(const float *input, float *output)
+{
+    const PcmKernels_t *kernels = pcm_kernels();
 
-    /* Replay last sample if conversion couldn't fill up the whole 
-     * frame. This could happen for example with 22050 to 16000 conversion.
-     */
-    if (src_data.output_frames_gen < (int)out_samples)
+    if (fixed)
     {
-        if (in_extra < 4)
-            in_extra++;
+        kernels->float_to_s16(input, fixed_in, in_samples);
+        fixed->run(fixed_in, channels, fixed_out, channels);
+        kernels->s16_to_float(fixed_out, output, out_samples);
+        return;
+    }
+
+    if (!state)
+        return;
+
+    memcpy(resample_batch_input(0), input, in_samples * sizeof(float));
+    resample_run_batch(1);
+    memcpy(output, resample_batch_output(0), out_samples * sizeof(float));
+}
+
+unsigned int CResampleEx::resample_set_batch(unsigned int max_frames)
+{
+    if (fixed || !state || max_frames <= 1)
+        return 1;
+    if (max_frames != batch)
+        alloc_frames(max_frames);
+    return batch;
+}
+
+/* 第index个周期转为float装入frame_in，按resample_set_mapping()做声道转换 */
+void CResampleEx::resample_load(unsigned int index, const short *input)
+{
+    const PcmKernels_t *kernels = pcm_kernels();
+    float *dst = resample_batch_input(index);
+
+    if (in_map != channels)
+        kernels->stereo_to_float_mono(input, dst, in_samples);
+    else
+        kernels->s16_to_float(input, dst, in_samples);
+}
+
+float *CResampleEx::resample_batch_input(unsigned int index)
+{
+    return frame_in + in_pending + index * in_samples;
+}
+
+/*
+ * 一次处理已装入的count个周期，第k个周期的输出起点按周期序号累计in_frames*rate_out/rate_in帧，
+ * 与分几次处理无关；比例不是整数时个别周期之间跳过一帧，不累积延迟
+ */
+void CResampleEx::resample_run_batch(unsigned int count)
+{
+    if (!state || count == 0 || count > batch)
+        return;
 
-        for (unsigned int i=src_data.output_frames_gen; i<out_samples; ++i)
+    process(count);
+    for (unsigned int i=0; i<count; ++i)
+    {
+        slot_at[i] = out_start;
+        unsigned int end = out_start + out_samples;
+        if (end > out_pending) // 预留了滤波器延迟，正常不会生成不足，不足时重复最后一个点
         {
-            output[i] = output[src_data.output_frames_gen-1];
+            for (unsigned int k=(out_start > out_pending ? out_start : out_pending); k<end; ++k)
+                frame_out[k] = out_pending ? frame_out[out_pending-channels+k%channels] : 0;
         }
+        phase += (unsigned long long)(in_samples / channels) * rate_out;
+        out_start += (unsigned int)(phase / rate_in) * channels;
+        phase %= rate_in;
+    }
+}
+
+void CResampleEx::resample_fetch(unsigned int index, short *output)
+{
+    const PcmKernels_t *kernels = pcm_kernels();
+    float *src = resample_batch_output(index);
+
+    if (dsp && out_map == channels)
+        dsp->runToS16(src, output, out_samples / channels, channels);
+    else if (out_map != channels)
+    {
+        if (dsp)
+            dsp->run(src, src, out_samples / channels, channels);
+        kernels->float_mono_to_stereo(src, output, out_samples);
     }
+    else
+        kernels->float_to_s16(src, output, out_samples);
 }
 
+float *CResampleEx::resample_batch_output(unsigned int index)
+{
+    return frame_out + slot_at[index];
+}
+
+int CResampleEx::resample_stream(const float *input, unsigned int in_frames, unsigned int *in_used,
+    float *output, unsigned int out_frames, bool end)
+{
+    SRC_DATA src_data;
+
+    *in_used = 0;
+    if (!state)
+        return -1;
+
+    memset(&src_data, 0, sizeof(src_data));
+    src_data.data_in = (float *)input; // 旧版samplerate.h的data_in不是const
+    src_data.data_out = output;
+    src_data.input_frames = in_frames;
+    src_data.output_frames = out_frames;
+    src_data.src_ratio = ratio;
+    src_data.end_of_input = end ? 1 : 0;
+    if (src_process((SRC_STATE *)state, &src_data) != 0)
+        return -1;
+
+    *in_used = src_data.input_frames_used;
+    return src_data.output_frames_gen;
+}
+
+/* 按resample_set_mapping()设置的输入/输出声道数计算的采样点数 */
 unsigned int CResampleEx::resample_get_input_size(void)
 {
-    return in_samples;
+    return in_samples / channels * in_map;
 }
 
 unsigned int CResampleEx::resample_get_output_size(void)
 {
-    return out_samples;
+    return out_samples / channels * out_map;
 }
 
 void CResampleEx::resample_destroy(void)
 {
+    if (fixed)
+    {
+        delete fixed;
+        fixed = NULL;
+    }
+
+    if (fixed_in)
+        free(fixed_in);
+    fixed_in = NULL;
+
+    if (fixed_out)
+        free(fixed_out);
+    fixed_out = NULL;
+
     if (state)
     {
         src_delete((SRC_STATE *)state);
@@ -147,6 +411,10 @@ void CResampleEx::resample_destroy(void)
     if (frame_out)
         free(frame_out);
     frame_out = NULL;
+
+    if (slot_at)
+        free(slot_at);
+    slot_at = NULL;
 }
 
 
@@ -1,5 +1,5 @@
 /*
- * 音频重采样封装：libsamplerate实现
+ * 音频重采样封装：libsamplerate实现，常用比例可选内置定点多相FIR实现
  * Copyright FreeCode. All Rights Reserved.
  * MIT License (https://opensource.org/licenses/MIT)
  * 2024 by liuqingshuige
@@ -7,6 +7,16 @@
 #ifndef __AUDIO_RESAMPLE_EX_H__
 #define __AUDIO_RESAMPLE_EX_H__
 
+class CPolyphaseResampler;
+class PcmDsp;
+
+/* 重采样引擎 */
+enum
+{
+    RESAMPLE_ENGINE_SRC = 0, // libsamplerate浮点sinc，支持任意比例
+    RESAMPLE_ENGINE_FIXED, // 内置定点多相FIR，仅支持常用比例，不支持时退回libsamplerate
+};
+
 class CResampleEx
 {
 public:
@@ -20,19 +30,69 @@ public:
         unsigned int channel_count,
         unsigned int rate_in,
         unsigned int rate_out,
-        unsigned int samples_per_frame);
+        unsigned int samples_per_frame,
+        int engine = RESAMPLE_ENGINE_SRC);
+    /* 输入/输出的声道数与重采样声道数不同(单双声道)时，在int16/float转换的同一遍完成声道转换 */
+    void resample_set_mapping(unsigned int in_channels, unsigned int out_channels);
+    /* 16bit输出前的处理链，在float到int16的转换中一并完成，NULL表示不处理；不影响浮点接口 */
+    void resample_set_dsp(PcmDsp *dsp) {this->dsp = dsp;}
     void resample_run(const short *input, short *output);
+    /* 浮点交错数据，输入输出均为channel_count声道，忽略resample_set_mapping() */
+    void resample_run_float(const float *input, float *output);
+
+    /*
+     * 批量：积压的多个周期依次装入，一次src_process处理完再逐个取出，调用次数与周期数无关
+     * resample_set_batch()返回实际可批量的周期数，定点引擎逐帧处理，总是返回1
+     * libsamplerate按连续的流处理：没用完的输入留到下一次，多生成的输出留给下一个周期，
+     * 每个周期输出的起点只由周期序号决定，所以批量与逐个周期resample_run()的输出相同
+     */
+    unsigned int resample_set_batch(unsigned int max_frames);
+    void resample_load(unsigned int index, const short *input);
+    float *resample_batch_input(unsigned int index); // 浮点数据直接写入，channel_count声道
+    void resample_run_batch(unsigned int count);
+    void resample_fetch(unsigned int index, short *output);
+    float *resample_batch_output(unsigned int index); // 可就地处理后再取走
+
+    /*
+     * 离线流式处理：输入输出帧数不固定，不补点，输出与输入严格按比例对齐；只用于libsamplerate引擎
+     * in_frames/out_frames单位为帧(channel_count声道)；end：输入已结束，输出滤波器中剩余的点
+     * in_used：返回消耗的输入帧数；return：生成的帧数，失败返回-1
+     */
+    int resample_stream(const float *input, unsigned int in_frames, unsigned int *in_used,
+        float *output, unsigned int out_frames, bool end);
+
     unsigned int resample_get_input_size(void);
     unsigned int resample_get_output_size(void);
+    int resample_get_engine(void) {return engine;} // 实际使用的引擎
     void resample_destroy(void);
 
+private:
+    void process(unsigned int count);
+    void alloc_frames(unsigned int count);
+    unsigned int measure_delay(void);
+    void reset_stream(void);
+
 private:
     void *state;
+    CPolyphaseResampler *fixed;
+    short *fixed_in, *fixed_out; // 定点引擎处理浮点数据时的临时缓冲
+    int engine;
     unsigned int in_samples;
     unsigned int out_samples;
     float *frame_in, *frame_out;
-    unsigned in_extra, out_extra;
+    unsigned int in_pending; // frame_in开头上次没用完的输入点数
+    unsigned int out_pending; // frame_out中已生成、尚未丢弃的输出点数
+    unsigned int out_start; // 下一个周期的输出在frame_out中的起点
+    unsigned int out_capacity; // frame_out的点数
+    unsigned int *slot_at; // 本批各周期的输出在frame_out中的起点
+    unsigned long long phase; // 周期输出起点的小数部分，单位1/rate_in帧
+    unsigned int delay; // 滤波器延迟(帧)，输出开头先放这么多帧静音
+    unsigned int batch; // frame_in/frame_out能容纳的周期数
+    unsigned int channels;
+    unsigned int in_map, out_map; // 输入/输出的声道数
+    PcmDsp *dsp; // 16bit输出的处理链
     double ratio;
+    unsigned int rate_in, rate_out;
 };
 
 
@@ -0,0 +1,150 @@
+/*
+ * 离线批量转换工具：多个文件并行转换，长文件分段并行
+ * 用法：pcm_transcode [选项] 输入文件...
+ *   -o 目录      输出目录，默认当前目录，文件名为输入文件名换成.wav(-w时为.pcm)
+ *   -r 采样率    输出采样率，默认与输入相同
+ *   -c 声道数    输出声道数(1~8)，默认与输入相同，按默认映射转换(多声道转单声道取平均)
+ *   -m 映射      按输入声道选取/混合，如"2,0"取第3、第1声道，"0.5*0+0.5*1"下混为单声道，见pcm_chmap_parse()
+ *   -f 格式      输出格式s16/s24_3le/s32/float，默认与输入相同
+ *   -q 质量      fast/medium/best，默认best
+ *   -j 线程数    默认在线CPU核数
+ *   -s 秒        长于这个时长的文件分段处理，默认30，0表示不分段
+ *   -i 采样率,声道数[,格式]  没有WAV头的输入按此读取，格式默认s16
+ *   -w           输出裸PCM，不写WAV头
+ * 每个文件输出一行key=value，最后一行为汇总
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "pcmtranscode.h"
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-o dir] [-r rate] [-c channels] [-m map] [-f s16|s24_3le|s32|float] [-q fast|medium|best]\n"
+        "       [-j threads] [-s chunk_sec] [-i rate,channels[,format]] [-w] input...\n", prog);
+}
+
+static bool parse_raw(const char *arg, PcmTranscodeOpt_t *opt)
+{
+    char fmt[16] = "s16";
+    if (sscanf(arg, "%u,%u,%15s", &opt->raw_rate, &opt->raw_channel, fmt) < 2)
+        return false;
+    opt->raw_format = pcm_format_parse(fmt);
+    return opt->raw_rate > 0 && opt->raw_channel > 0 && opt->raw_format >= 0;
+}
+
+static std::string output_name(const char *dir, const char *input, bool raw)
+{
+    const char *base = strrchr(input, '/');
+    std::string name = base ? base + 1 : input;
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0)
+        name.erase(dot);
+    name += raw ? ".pcm" : ".wav";
+    return std::string(dir) + "/" + name;
+}
+
+int main(int argc, char *argv[])
+{
+    PcmTranscodeOpt_t opt;
+    const char *dir = ".";
+    int c;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.format = -1;
+    opt.quality = PCM_TRANSCODE_BEST;
+    opt.chunk_sec = 30;
+
+    while ((c = getopt(argc, argv, "o:r:c:m:f:q:j:s:i:w")) != -1)
+    {
+        switch (c)
+        {
+        case 'o': dir = optarg; break;
+        case 'r': opt.samplerate = atoi(optarg); break;
+        case 'c': opt.channel = atoi(optarg); break;
+        case 'm': opt.chmap = optarg; break;
+        case 'f':
+            opt.format = pcm_format_parse(optarg);
+            if (opt.format < 0)
+            {
+                fprintf(stderr, "unknown format: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'q':
+            if (!strcmp(optarg, "fast"))
+                opt.quality = PCM_TRANSCODE_FAST;
+            else if (!strcmp(optarg, "medium"))
+                opt.quality = PCM_TRANSCODE_MEDIUM;
+            else if (!strcmp(optarg, "best"))
+                opt.quality = PCM_TRANSCODE_BEST;
+            else
+            {
+                fprintf(stderr, "unknown quality: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'j': opt.threads = atoi(optarg); break;
+        case 's': opt.chunk_sec = atoi(optarg); break;
+        case 'i':
+            if (!parse_raw(optarg, &opt))
+            {
+                fprintf(stderr, "bad raw input parameters: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w': opt.raw_out = true; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    PcmTranscoder transcoder(&opt);
+    int rejected = 0;
+    for (int i = optind; i < argc; i++)
+    {
+        std::string out = output_name(dir, argv[i], opt.raw_out);
+        if (!transcoder.addFile(argv[i], out.c_str()))
+        {
+            printf("file=%s status=rejected\n", argv[i]);
+            rejected++;
+        }
+    }
+
+    double t0 = now_sec();
+    int failed = transcoder.run();
+    double wall = now_sec() - t0;
+
+    double audio = 0;
+    for (int i = 0; i < transcoder.files(); i++)
+    {
+        const PcmTranscodeFile_t *f = transcoder.file(i);
+        double sec = (double)f->in_frames / f->in.samplerate;
+        audio += sec;
+        printf("file=%s output=%s in=%u/%u/%s out=%u/%u/%s audio_sec=%.3f chunks=%d status=%s\n",
+            f->input.c_str(), f->output.c_str(), f->in.samplerate, f->in.channel, pcm_format_name(f->in.format),
+            f->samplerate, f->channel, pcm_format_name(f->format), sec, f->chunks, f->failed ? "failed" : "ok");
+    }
+    printf("files=%d failed=%d audio_sec=%.3f wall_sec=%.3f realtime_x=%.1f threads=%d\n",
+        transcoder.files() + rejected, failed + rejected, audio, wall, wall > 0 ? audio / wall : 0.0,
+        opt.threads > 0 ? opt.threads : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    return failed + rejected ? 1 : 0;
+}
+